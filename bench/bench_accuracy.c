@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_fixed.h"
+#include "libimu/imu_math.h"
+#include "libimu/imu_sim.h"
+
+#define DURATION        30.0
+// seconds the engines get to converge from identity to the initial tilt
+#define SETTLE          1.0
+
+
+////////////////////////////////////////////
+
+
+typedef struct scenario
+{
+    const char * name;
+    imu_sim_t sim;
+    // tilt rms (deg) every engine has to stay below
+    double budget;
+} scenario_t;
+
+
+// runs n samples through an engine, writes orientation after every sample, returns ns/sample
+typedef double (*engine_fn)(const imu_sim_t * sim, const imu_sample_t * samples, size_t n, imu_quaternion_t * out);
+
+
+typedef struct engine
+{
+    const char * name;
+    engine_fn run;
+} engine_t;
+
+
+////////////////////////////////////////////
+
+
+static double run_imu(const imu_sim_t * sim, const imu_sample_t * samples, size_t n, imu_quaternion_t * out, int8_t fast, int8_t engine)
+{
+    imu_t imu = imu_init(IMU_CALIBMODE_NEVER, (imu_real_t)sim->scale_factor_accelerometer, (imu_real_t)sim->scale_factor_gyro);
+    imu_set_state(&imu, IMU_STATE_READY);
+    imu_set_fast_math(&imu, fast);
+    imu_set_estimation_mode(&imu, IMU_ESTIMODE_GYRO | IMU_ESTIMODE_ACCELEROMETER | engine);
+
+    double t0 = get_time_sec();
+    imu_process_batch(&imu, samples, n, out);
+    return 1e9 * (get_time_sec() - t0) / n;
+}
+
+
+static double run_complementary(const imu_sim_t * sim, const imu_sample_t * samples, size_t n, imu_quaternion_t * out)
+{
+    return run_imu(sim, samples, n, out, 0, 0);
+}
+
+
+static double run_complementary_fast(const imu_sim_t * sim, const imu_sample_t * samples, size_t n, imu_quaternion_t * out)
+{
+    return run_imu(sim, samples, n, out, 1, 0);
+}
+
+
+static double run_complementary_decimated(const imu_sim_t * sim, const imu_sample_t * samples, size_t n, imu_quaternion_t * out)
+{
+    imu_t imu = imu_init(IMU_CALIBMODE_NEVER, (imu_real_t)sim->scale_factor_accelerometer, (imu_real_t)sim->scale_factor_gyro);
+    imu_set_state(&imu, IMU_STATE_READY);
+    imu_set_correction_divider(&imu, 4);
+
+    double t0 = get_time_sec();
+    imu_process_batch(&imu, samples, n, out);
+    return 1e9 * (get_time_sec() - t0) / n;
+}
+
+
+static double run_madgwick(const imu_sim_t * sim, const imu_sample_t * samples, size_t n, imu_quaternion_t * out)
+{
+    return run_imu(sim, samples, n, out, 0, IMU_ESTIMODE_MADGWICK);
+}
+
+
+static double run_mahony(const imu_sim_t * sim, const imu_sample_t * samples, size_t n, imu_quaternion_t * out)
+{
+    return run_imu(sim, samples, n, out, 0, IMU_ESTIMODE_MAHONY);
+}
+
+
+static double run_ekf(const imu_sim_t * sim, const imu_sample_t * samples, size_t n, imu_quaternion_t * out)
+{
+    return run_imu(sim, samples, n, out, 0, IMU_ESTIMODE_EKF);
+}
+
+
+// noise of a datasheet instead of the defaults: 5e-5 rad/s/sqrt(Hz) is the 0.1 deg/s per
+// sample of sensor() at 1 kHz. the float covariance used to lose positive definiteness here.
+static double run_ekf_datasheet(const imu_sim_t * sim, const imu_sample_t * samples, size_t n, imu_quaternion_t * out)
+{
+    imu_t imu = imu_init(IMU_CALIBMODE_NEVER, (imu_real_t)sim->scale_factor_accelerometer, (imu_real_t)sim->scale_factor_gyro);
+    imu_set_state(&imu, IMU_STATE_READY);
+    imu_set_estimation_mode(&imu, IMU_ESTIMODE_GYRO | IMU_ESTIMODE_ACCELEROMETER | IMU_ESTIMODE_EKF);
+    imu_set_ekf_noise(&imu, IMU_R(5e-5), IMU_R(1e-5), IMU_R(0.004));
+
+    double t0 = get_time_sec();
+    imu_process_batch(&imu, samples, n, out);
+    return 1e9 * (get_time_sec() - t0) / n;
+}
+
+
+static double run_integrator(const imu_sim_t * sim, const imu_sample_t * samples, size_t n, imu_quaternion_t * out, int8_t integrator)
+{
+    imu_t imu = imu_init(IMU_CALIBMODE_NEVER, (imu_real_t)sim->scale_factor_accelerometer, (imu_real_t)sim->scale_factor_gyro);
+    imu_set_state(&imu, IMU_STATE_READY);
+    imu_set_integrator(&imu, integrator);
+
+    double t0 = get_time_sec();
+    imu_process_batch(&imu, samples, n, out);
+    return 1e9 * (get_time_sec() - t0) / n;
+}
+
+
+static double run_fixed(const imu_sim_t * sim, const imu_sample_t * samples, size_t n, imu_quaternion_t * out)
+{
+    imu_fixed_t imu = imu_fixed_init(IMU_CALIBMODE_NEVER, IMU_FIXED_Q30(sim->scale_factor_gyro));
+    imu_fixed_set_state(&imu, IMU_STATE_READY);
+
+    double t0 = get_time_sec();
+    for(size_t i = 0; i < n; i++)
+    {
+        imu_fixed_set_accelerometer_raw(&imu, (int32_t)samples[i].ax, (int32_t)samples[i].ay, (int32_t)samples[i].az);
+        imu_fixed_set_gyro_raw(&imu, (int32_t)samples[i].gx, (int32_t)samples[i].gy, (int32_t)samples[i].gz);
+        imu_fixed_main_loop_ts(&imu, (uint32_t)llround(samples[i].ts * 1e6));
+        out[i] = imu_fixed_get_orientation(&imu);
+    }
+    return 1e9 * (get_time_sec() - t0) / n;
+}
+
+
+////////////////////////////////////////////
+
+
+// a 16 bit sensor with mpu6050 like noise
+static imu_sim_t sensor(double rate, double tilt, int8_t motion, double amplitude, double frequency)
+{
+    imu_sim_t sim = imu_sim_init(rate, DURATION);
+    sim.tilt = tilt;
+    sim.motion = motion;
+    sim.amplitude = amplitude;
+    sim.frequency = frequency;
+    sim.gyro_noise = 0.1;
+    sim.accelerometer_noise = 0.004;
+    return sim;
+}
+
+
+////////////////////////////////////////////
+
+
+// gyro integrators of the complementary filter on noise free sensors, where the heading drift is
+// all integration error. cost is cpu time per second of motion, ns/sample times the rate.
+// coning3 at a quarter of the rate has to do at least as well as euler at the full rate.
+static int check_integrators()
+{
+    const struct
+    {
+        const char * name;
+        int8_t integrator;
+    } integrators[] = {
+        {"euler", IMU_INTEGRATOR_EULER},
+        {"midpoint", IMU_INTEGRATOR_MIDPOINT},
+        {"coning", IMU_INTEGRATOR_CONING},
+        {"rk4", IMU_INTEGRATOR_RK4},
+        {"coning3", IMU_INTEGRATOR_CONING3},
+    };
+    const double rates[] = {1000.0, 500.0, 250.0};
+    const struct
+    {
+        const char * name;
+        int8_t motion;
+        double amplitude, frequency;
+    } motions[] = {
+        {"fast tumble", IMU_SIM_TUMBLE, 250.0, 2.0},
+        {"sinusoidal tilts", IMU_SIM_TILT, 30.0, 0.5},
+    };
+
+    int ok = 1;
+    printf("gyro integrators, complementary filter, noise free sensors, %.0f s\n", DURATION);
+    printf("  %-18s %-10s %8s %8s %10s %12s\n", "scenario", "integrator", "rate", "rms", "ns/sample", "us/s motion");
+
+    for(size_t m = 0; m < sizeof(motions) / sizeof(motions[0]); m++)
+    {
+        double reference = 0.0, coning = 0.0;
+        for(size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+        {
+            imu_sim_t sim = sensor(rates[r], 0.0, motions[m].motion, motions[m].amplitude, motions[m].frequency);
+            sim.gyro_noise = 0.0;
+            sim.accelerometer_noise = 0.0;
+            sim.quantize = 0;
+
+            size_t n = imu_sim_count(&sim);
+            imu_sample_t * samples = malloc(n * sizeof(imu_sample_t));
+            imu_quaternion_t * truth = malloc(n * sizeof(imu_quaternion_t));
+            imu_quaternion_t * out = malloc(n * sizeof(imu_quaternion_t));
+            imu_sim_generate(&sim, samples, truth);
+
+            for(size_t i = 0; i < sizeof(integrators) / sizeof(integrators[0]); i++)
+            {
+                double ns = run_integrator(&sim, samples, n, out, integrators[i].integrator);
+                double rms = imu_sim_error(out, truth, n, 0).rms * 180.0 / PI;
+                if(r == 0 && integrators[i].integrator == IMU_INTEGRATOR_EULER)
+                {
+                    reference = rms;
+                }
+                if(r == 2 && integrators[i].integrator == IMU_INTEGRATOR_CONING3)
+                {
+                    coning = rms;
+                }
+
+                printf("  %-18s %-10s %8.0f %8.4f %10.1f %12.1f\n", r == 0 && i == 0 ? motions[m].name : "", integrators[i].name,
+                    rates[r], rms, ns, ns * rates[r] * 1e-3);
+            }
+
+            free(out);
+            free(truth);
+            free(samples);
+        }
+
+        int pass = coning <= reference;
+        ok &= pass;
+        printf("  %-18s coning3 at %.0f Hz %.4f deg, euler at %.0f Hz %.4f deg  %s\n", "", rates[2], coning, rates[0], reference, pass ? "" : "FAILED");
+    }
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+// output products: selecting them must not change the filter, the lazy getters must give the
+// same values as the fields, the gl matrix has to be the rotation matrix, and they have to agree with each other and with the truth.
+// linear acceleration of a vibrating sensor has to come out as the vibration, on its axes only.
+static int check_outputs()
+{
+    imu_sim_t sim = sensor(1000.0, 20.0, IMU_SIM_STATIC, 0.0, 0.0);
+    sim.vibration = 0.3;
+    sim.vibration_frequency = 40.0;
+    size_t n = imu_sim_count(&sim);
+    imu_sample_t * samples = malloc(n * sizeof(imu_sample_t));
+    imu_quaternion_t * truth = malloc(n * sizeof(imu_quaternion_t));
+    imu_sim_generate(&sim, samples, truth);
+
+    imu_t all = imu_init(IMU_CALIBMODE_NEVER, (imu_real_t)sim.scale_factor_accelerometer, (imu_real_t)sim.scale_factor_gyro);
+    imu_set_state(&all, IMU_STATE_READY);
+    imu_set_estimation_mode(&all, IMU_ESTIMODE_GYRO | IMU_ESTIMODE_ACCELEROMETER | IMU_ESTIMODE_EKF);
+    imu_t lazy = all;
+    imu_set_outputs(&all, IMU_OUTPUT_EULER | IMU_OUTPUT_MATRIX | IMU_OUTPUT_GL_MATRIX | IMU_OUTPUT_GRAVITY | IMU_OUTPUT_LINEAR);
+    imu_set_outputs(&lazy, IMU_OUTPUT_QUATERNION);
+
+    int same = 1;
+    double up = 0.0, linear_sq = 0.0, cross_sq = 0.0;
+    size_t count = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        imu_process_batch(&all, &samples[i], 1, NULL);
+        imu_process_batch(&lazy, &samples[i], 1, NULL);
+
+        imu_euler_t e = imu_get_euler(&lazy);
+        imu_mat3_t m = imu_get_matrix(&lazy);
+        imu_mat4_t gl = imu_get_gl_matrix(&lazy);
+        imu_vec3_t g = imu_get_gravity(&lazy), l = imu_get_linear_acceleration(&lazy);
+        same &= memcmp(&all.orientation_quat, &lazy.orientation_quat, sizeof(imu_quaternion_t)) == 0 &&
+            memcmp(&all.orientation, &e, sizeof(e)) == 0 && memcmp(&all.orientation_matrix, &m, sizeof(m)) == 0 &&
+            memcmp(&all.gravity, &g, sizeof(g)) == 0 && memcmp(&all.linear_acceleration, &l, sizeof(l)) == 0 &&
+            memcmp(&all.orientation_gl, &gl, sizeof(gl)) == 0;
+
+        // gl matrix is the rotation matrix, column major
+        for(int c = 0; c < 3; c++)
+        {
+            for(int r = 0; r < 3; r++)
+            {
+                same &= gl.m[4 * c + r] == (float)m.m[r][c];
+            }
+            same &= gl.m[4 * c + 3] == 0.f && gl.m[12 + c] == 0.f;
+        }
+        same &= gl.m[15] == 1.f;
+
+        // matrix turns body gravity into world up
+        const imu_real_t (*r)[3] = all.orientation_matrix.m;
+        const imu_vec3_t * b = &all.gravity;
+        double ux = r[0][0] * b->x + r[0][1] * b->y + r[0][2] * b->z;
+        double uy = r[1][0] * b->x + r[1][1] * b->y + r[1][2] * b->z;
+        double uz = r[2][0] * b->x + r[2][1] * b->y + r[2][2] * b->z;
+        up = fmax(up, sqrt(ux * ux + uy * uy + (uz - 1.0) * (uz - 1.0)));
+
+        if(i >= (size_t)(SETTLE * sim.rate))
+        {
+            // the sensor shakes along body x and y by the same amount, never along z
+            const imu_vec3_t * a = &all.linear_acceleration;
+            double v = 0.5 * (a->x + a->y);
+            linear_sq += v * v;
+            cross_sq += (a->x - v) * (a->x - v) + a->z * a->z;
+            count++;
+        }
+    }
+    // a sine of amplitude a has rms a / sqrt(2)
+    double linear = sqrt(2.0 * linear_sq / count), cross = sqrt(cross_sq / count);
+
+    int ok = same && up < 1e-5 && fabs(linear - sim.vibration) < 0.01 && cross < 0.01;
+    printf("output products, ekf, static tilt with %.1f g vibration at %.0f Hz\n", sim.vibration, sim.vibration_frequency);
+    printf("  lazy getters %s the fields, matrix * gravity off world up by %.1e, vibration %.3f g, rms %.4f g on other axes  %s\n",
+        same ? "equal to" : "DIFFERENT FROM", up, linear, cross, ok ? "" : "FAILED");
+
+    free(truth);
+    free(samples);
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    scenario_t scenarios[] = {
+        {"static tilt", sensor(1000.0, 20.0, IMU_SIM_STATIC, 0.0, 0.0), 0.25},
+        {"constant spin", sensor(1000.0, 10.0, IMU_SIM_SPIN, 90.0, 0.0), 0.25},
+        {"sinusoidal tilts", sensor(1000.0, 5.0, IMU_SIM_TILT, 30.0, 0.5), 0.25},
+        {"fast tumble", sensor(1000.0, 0.0, IMU_SIM_TUMBLE, 250.0, 2.0), 0.5},
+        {"vibration", sensor(1000.0, 20.0, IMU_SIM_STATIC, 0.0, 0.0), 4.0},
+        {"bias drift", sensor(1000.0, 5.0, IMU_SIM_TILT, 30.0, 0.5), 0.25},
+        {"tilts at 100 Hz", sensor(100.0, 5.0, IMU_SIM_TILT, 30.0, 0.5), 0.25},
+    };
+    scenarios[4].sim.vibration = 0.3;
+    scenarios[4].sim.vibration_frequency = 40.0;
+    scenarios[5].sim.gyro_bias[0] = 0.5;
+    scenarios[5].sim.gyro_bias[1] = -0.3;
+    scenarios[5].sim.gyro_bias[2] = 0.2;
+    scenarios[5].sim.gyro_drift[0] = 0.02;
+    scenarios[5].sim.gyro_drift[1] = 0.01;
+
+    const engine_t engines[] = {
+        {"complementary", run_complementary},
+        {"complementary fast", run_complementary_fast},
+        {"complementary 1/4", run_complementary_decimated},
+        {"fixed point", run_fixed},
+        {"madgwick", run_madgwick},
+        {"mahony", run_mahony},
+        {"ekf", run_ekf},
+        {"ekf datasheet noise", run_ekf_datasheet},
+    };
+
+    int ok = 1;
+    printf("accuracy against ground truth, %.0f s per scenario, first %.0f s left out\n", DURATION, SETTLE);
+    printf("  %-18s %-20s %8s %8s %8s %8s %10s %10s\n", "scenario", "engine", "rms", "max", "tilt rms", "tilt max", "ns/sample", "samples/s");
+
+    for(size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++)
+    {
+        const imu_sim_t * sim = &scenarios[s].sim;
+        size_t n = imu_sim_count(sim);
+        imu_sample_t * samples = malloc(n * sizeof(imu_sample_t));
+        imu_quaternion_t * truth = malloc(n * sizeof(imu_quaternion_t));
+        imu_quaternion_t * out = malloc(n * sizeof(imu_quaternion_t));
+        imu_sim_generate(sim, samples, truth);
+
+        for(size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+        {
+            double ns = engines[e].run(sim, samples, n, out);
+            imu_sim_error_t err = imu_sim_error(out, truth, n, (size_t)(SETTLE * sim->rate));
+            double tilt_rms = err.tilt_rms * 180.0 / PI;
+            int pass = tilt_rms <= scenarios[s].budget;
+            ok &= pass;
+
+            printf("  %-18s %-20s %8.3f %8.3f %8.3f %8.3f %10.1f %10.0f  %s\n", e == 0 ? scenarios[s].name : "", engines[e].name,
+                err.rms * 180.0 / PI, err.max * 180.0 / PI, tilt_rms, err.tilt_max * 180.0 / PI, ns, 1e9 / ns, pass ? "" : "OVER BUDGET");
+        }
+
+        free(out);
+        free(truth);
+        free(samples);
+    }
+
+    printf("  errors in degrees. rms and max include heading, which drifts without a magnetometer.\n");
+
+    ok &= check_integrators();
+    ok &= check_outputs();
+    printf("  %s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
@@ -0,0 +1,105 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_dispatch.h"
+#include "bench_harness.h"
+
+#define COUNT       1024
+
+
+////////////////////////////////////////////
+
+
+static imu_quaternion_t qa[COUNT];
+static imu_mat4_t mr[COUNT], mscalar[COUNT];
+
+
+////////////////////////////////////////////
+
+
+static float frand(float lo, float hi)
+{
+    return lo + (hi - lo) * (float)rand() / (float)RAND_MAX;
+}
+
+
+////////////////////////////////////////////
+
+
+// makes the outputs escape, as in bench_micro.c
+#define OP_BARRIER() __asm__ volatile("" : : "r"(mr) : "memory")
+
+// batch kernel, timed per matrix. 1023 leaves a tail for the scalar code.
+static void op_quaternion_to_matrices4(size_t rounds)
+{
+    for(size_t r = 0; r < rounds; r++)
+    {
+        imu_quaternion_to_matrices4(qa, mr, COUNT - 1);
+        OP_BARRIER();
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    int failed = 0;
+
+    srand(1);
+    for(int i = 0; i < COUNT; i++)
+    {
+        qa[i] = imu_quaternion_create(frand(-1.f, 1.f), frand(-1.f, 1.f), frand(-1.f, 1.f), frand(-1.f, 1.f));
+        qa[i] = imu_quaternion_normalize(&qa[i]);
+    }
+
+    const bench_op_t ops[] = {
+        {"imu_quaternion_to_matrices4", op_quaternion_to_matrices4, COUNT - 1},
+    };
+
+    int cpu = bench_pin(sched_getcpu());
+    printf("cpu supports up to %s, selected %s, cpu %d, median of %d\n", imu_dispatch_isa_name(imu_dispatch_cpu_isa()),
+        imu_dispatch_isa_name(imu_dispatch_get_isa()), cpu, BENCH_REPETITIONS);
+
+    for(int8_t isa = IMU_ISA_SCALAR; isa <= IMU_ISA_AVX512; isa++)
+    {
+        if(imu_dispatch_set_isa(isa))
+        {
+            printf("%s: not available\n", imu_dispatch_isa_name(isa));
+            continue;
+        }
+
+        printf("%s:\n", imu_dispatch_isa_name(isa));
+
+        for(size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); k++)
+        {
+            bench_result_t r = bench_measure(&ops[k], BENCH_REPETITIONS, 0);
+            bench_print(&r);
+            printf("\n");
+        }
+
+        op_quaternion_to_matrices4(1);
+        if(isa == IMU_ISA_SCALAR)
+        {
+            for(int i = 0; i < COUNT - 1; i++) mscalar[i] = mr[i];
+        }
+        float dmat = 0.f;
+        for(int i = 0; i < COUNT - 1; i++)
+        {
+            for(int k = 0; k < 16; k++)
+            {
+                dmat = fmaxf(dmat, fabsf(mr[i].m[k] - mscalar[i].m[k]));
+            }
+        }
+
+        printf("  matrices max diff vs scalar %.2e\n", dmat);
+        failed |= dmat > 1e-6f;
+    }
+
+    printf("  %s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_math.h"
+#include "libimu/imu_sim.h"
+
+#define RATE            1000.0
+#define DURATION        60.0
+#define SAMPLES         ((size_t)(RATE * DURATION))
+
+#define SCALE_ACCL      (2.f / 16384.f)
+#define SCALE_GYRO      (2.f / 131.f)
+
+// max angle between exact and fast math orientation
+#define ERROR_BUDGET    1e-3
+
+// points of the sweep checking each approximation against double libm
+#define SWEEP_POINTS    1000000
+
+// bounds stated in imu_math.h
+#define BOUND_SIN       2e-7
+#define BOUND_COS       2e-7
+#define BOUND_ACOS      6e-7
+#define BOUND_ASIN      6e-7
+#define BOUND_ATAN2     4e-7
+
+// exact and fast runs of a trajectory alternate this many times, timings are their medians
+#define REPEATS         7
+
+
+////////////////////////////////////////////
+
+
+typedef struct trajectory
+{
+    const char * name;
+    // initial tilt (deg) about x axis
+    double tilt;
+    // IMU_SIM_* with its peak rate (deg/s) and frequency (Hz)
+    int8_t motion;
+    double amplitude;
+    double frequency;
+} trajectory_t;
+
+
+////////////////////////////////////////////
+
+
+// noise free 16 bit sensor, both engines see the same samples
+static void generate(const trajectory_t * tr, imu_sample_t * samples)
+{
+    imu_sim_t sim = imu_sim_init(RATE, DURATION);
+    sim.scale_factor_gyro = SCALE_GYRO;
+    sim.scale_factor_accelerometer = SCALE_ACCL;
+    sim.tilt = tr->tilt;
+    sim.motion = tr->motion;
+    sim.amplitude = tr->amplitude;
+    sim.frequency = tr->frequency;
+    imu_sim_generate(&sim, samples, NULL);
+}
+
+
+////////////////////////////////////////////
+
+
+static double run(int8_t fast, const imu_sample_t * samples, imu_quaternion_t * out)
+{
+    imu_t imu = imu_init(IMU_CALIBMODE_NEVER, SCALE_ACCL, SCALE_GYRO);
+    imu_set_state(&imu, IMU_STATE_READY);
+    imu_set_fast_math(&imu, fast);
+
+    double t0 = get_time_sec();
+    imu_process_batch(&imu, samples, SAMPLES, out);
+    return 1e9 * (get_time_sec() - t0) / SAMPLES;
+}
+
+
+////////////////////////////////////////////
+
+
+// max |f(x) - ref(x)| over [lo, hi]
+static double sweep(imu_real_t (*f)(imu_real_t), double (*ref)(double), double lo, double hi)
+{
+    double maxerr = 0;
+    for(size_t i = 0; i <= SWEEP_POINTS; i++)
+    {
+        imu_real_t x = (imu_real_t)(lo + (hi - lo) * (double)i / SWEEP_POINTS);
+        double err = fabs((double)f(x) - ref((double)x));
+        maxerr = err > maxerr ? err : maxerr;
+    }
+    return maxerr;
+}
+
+
+static imu_real_t fast_sin(imu_real_t x) { return imu_math_fast_sin(x); }
+static imu_real_t fast_cos(imu_real_t x) { return imu_math_fast_cos(x); }
+static imu_real_t fast_acos(imu_real_t x) { return imu_math_fast_acos(x); }
+static imu_real_t fast_asin(imu_real_t x) { return imu_math_fast_asin(x); }
+// atan2 over the angle of a point on the unit circle, all quadrants and both octants of each
+static imu_real_t fast_atan2(imu_real_t t) { return imu_math_fast_atan2((imu_real_t)sin((double)t), (imu_real_t)cos((double)t)); }
+static double atan2_ref(double t) { return atan2((double)(imu_real_t)sin(t), (double)(imu_real_t)cos(t)); }
+
+
+static int compare(const void * a, const void * b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    const trajectory_t trajectories[] = {
+        {"static tilt", 20.0, IMU_SIM_STATIC, 0.0, 0.0},
+        {"constant spin", 10.0, IMU_SIM_SPIN, 90.0, 0.0},
+        {"sinusoidal wobble", 5.0, IMU_SIM_TILT, 30.0, 0.5},
+        {"fast tumble", 0.0, IMU_SIM_TUMBLE, 250.0, 2.0},
+    };
+
+    imu_sample_t * samples = malloc(SAMPLES * sizeof(imu_sample_t));
+    imu_quaternion_t * exact = malloc(SAMPLES * sizeof(imu_quaternion_t));
+    imu_quaternion_t * fast = malloc(SAMPLES * sizeof(imu_quaternion_t));
+    int failed = 0;
+
+    const struct { const char * name; double err; double bound; } sweeps[] = {
+        {"sin", sweep(fast_sin, sin, -PI / 2, PI / 2), BOUND_SIN},
+        {"cos", sweep(fast_cos, cos, -PI / 2, PI / 2), BOUND_COS},
+        {"acos", sweep(fast_acos, acos, -1.0, 1.0), BOUND_ACOS},
+        {"asin", sweep(fast_asin, asin, -1.0, 1.0), BOUND_ASIN},
+        {"atan2", sweep(fast_atan2, atan2_ref, -PI, PI), BOUND_ATAN2},
+    };
+
+    printf("fast math approximations vs libm, %d points each\n", SWEEP_POINTS);
+    for(size_t i = 0; i < sizeof(sweeps) / sizeof(sweeps[0]); i++)
+    {
+        int ok = sweeps[i].err < sweeps[i].bound;
+        failed |= !ok;
+        printf("  %-20s max err %.2e  bound %.1e  %s\n", sweeps[i].name, sweeps[i].err, sweeps[i].bound, ok ? "ok" : "OVER BOUND");
+    }
+
+    printf("fast math vs exact filter, default outputs, %zu samples at %.0f Hz, budget %.1e rad, median of %d alternating runs\n",
+        SAMPLES, RATE, ERROR_BUDGET, REPEATS);
+
+    for(size_t t = 0; t < sizeof(trajectories) / sizeof(trajectories[0]); t++)
+    {
+        generate(&trajectories[t], samples);
+
+        double ns_exact[REPEATS], ns_fast[REPEATS];
+        for(int r = 0; r < REPEATS; r++)
+        {
+            ns_exact[r] = run(0, samples, exact);
+            ns_fast[r] = run(1, samples, fast);
+        }
+        qsort(ns_exact, REPEATS, sizeof(double), compare);
+        qsort(ns_fast, REPEATS, sizeof(double), compare);
+
+        double maxerr = imu_sim_error(fast, exact, SAMPLES, 0).max;
+
+        int ok = maxerr <= ERROR_BUDGET;
+        failed |= !ok;
+        printf("  %-20s max err %.2e rad  exact %7.2f ns/sample  fast %7.2f ns/sample  %5.2fx  %s\n", trajectories[t].name, maxerr,
+            ns_exact[REPEATS / 2], ns_fast[REPEATS / 2], ns_exact[REPEATS / 2] / ns_fast[REPEATS / 2], ok ? "ok" : "OVER BUDGET");
+    }
+
+    free(fast);
+    free(exact);
+    free(samples);
+    return failed;
+}
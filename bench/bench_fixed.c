@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_sim.h"
+#include "libimu/imu_fixed.h"
+
+#define RATE            1000.0
+#define DURATION        60.0
+#define SAMPLES         ((size_t)(RATE * DURATION))
+
+#define SCALE_ACCL      (2.f / 16384.f)
+#define SCALE_GYRO      (2.f / 131.f)
+
+// max angle between float and fixed point orientation
+#define ERROR_BUDGET    1e-3
+
+
+////////////////////////////////////////////
+
+
+typedef struct trajectory
+{
+    const char * name;
+    // initial tilt (deg) about x axis
+    double tilt;
+    // IMU_SIM_* with its peak rate (deg/s) and frequency (Hz)
+    int8_t motion;
+    double amplitude;
+    double frequency;
+} trajectory_t;
+
+
+////////////////////////////////////////////
+
+
+// noise free 16 bit sensor, both engines see the same samples
+static void generate(const trajectory_t * tr, imu_sample_t * samples)
+{
+    imu_sim_t sim = imu_sim_init(RATE, DURATION);
+    sim.scale_factor_gyro = SCALE_GYRO;
+    sim.scale_factor_accelerometer = SCALE_ACCL;
+    sim.tilt = tr->tilt;
+    sim.motion = tr->motion;
+    sim.amplitude = tr->amplitude;
+    sim.frequency = tr->frequency;
+    imu_sim_generate(&sim, samples, NULL);
+}
+
+
+////////////////////////////////////////////
+
+
+static double run_float(const imu_sample_t * samples, imu_quaternion_t * out)
+{
+    imu_t imu = imu_init(IMU_CALIBMODE_NEVER, SCALE_ACCL, SCALE_GYRO);
+    imu_set_state(&imu, IMU_STATE_READY);
+
+    double t0 = get_time_sec();
+    imu_process_batch(&imu, samples, SAMPLES, out);
+    return 1e9 * (get_time_sec() - t0) / SAMPLES;
+}
+
+
+////////////////////////////////////////////
+
+
+static double run_fixed(const imu_sample_t * samples, imu_quaternion_t * out)
+{
+    imu_fixed_t imu = imu_fixed_init(IMU_CALIBMODE_NEVER, IMU_FIXED_Q30(SCALE_GYRO));
+    imu_fixed_set_state(&imu, IMU_STATE_READY);
+
+    // raw counts as a microcontroller would read them, converted ahead of the timed loop
+    int32_t (*raw)[6] = malloc(SAMPLES * sizeof(*raw));
+    uint32_t * ts = malloc(SAMPLES * sizeof(uint32_t));
+    for(size_t i = 0; i < SAMPLES; i++)
+    {
+        raw[i][0] = (int32_t)samples[i].ax;
+        raw[i][1] = (int32_t)samples[i].ay;
+        raw[i][2] = (int32_t)samples[i].az;
+        raw[i][3] = (int32_t)samples[i].gx;
+        raw[i][4] = (int32_t)samples[i].gy;
+        raw[i][5] = (int32_t)samples[i].gz;
+        ts[i] = (uint32_t)llround(samples[i].ts * 1e6);
+    }
+
+    double t0 = get_time_sec();
+    for(size_t i = 0; i < SAMPLES; i++)
+    {
+        imu_fixed_set_accelerometer_raw(&imu, raw[i][0], raw[i][1], raw[i][2]);
+        imu_fixed_set_gyro_raw(&imu, raw[i][3], raw[i][4], raw[i][5]);
+        imu_fixed_main_loop_ts(&imu, ts[i]);
+        out[i].w = imu.orientation_quat.w;
+        out[i].x = imu.orientation_quat.x;
+        out[i].y = imu.orientation_quat.y;
+        out[i].z = imu.orientation_quat.z;
+    }
+    double ns = 1e9 * (get_time_sec() - t0) / SAMPLES;
+
+    // scaled after timing, imu_sim_error() doesn't need unit quaternions but float precision does
+    for(size_t i = 0; i < SAMPLES; i++)
+    {
+        imu_fixed_t q;
+        q.orientation_quat.w = (imu_q30_t)out[i].w;
+        q.orientation_quat.x = (imu_q30_t)out[i].x;
+        q.orientation_quat.y = (imu_q30_t)out[i].y;
+        q.orientation_quat.z = (imu_q30_t)out[i].z;
+        out[i] = imu_fixed_get_orientation(&q);
+    }
+
+    free(ts);
+    free(raw);
+    return ns;
+}
+
+
+////////////////////////////////////////////
+
+
+// one gyro step of 10 ms to the 1 s limit at a few hundred deg/s, against the exact rotation.
+// the half angle reaches 3 rad, past the range of q1.30 and of the sin/cos series.
+static int check_long_steps()
+{
+    const int32_t raw[3] = {15000, -10000, 5000};
+    const uint32_t steps_us[] = {10000, 100000, 250000, 500000, 1000000};
+
+    imu_fixed_t imu = imu_fixed_init(IMU_CALIBMODE_NEVER, IMU_FIXED_Q30(SCALE_GYRO));
+    imu_fixed_set_state(&imu, IMU_STATE_READY);
+    // no gravity reading, gyro only
+    imu_fixed_set_accelerometer_raw(&imu, 0, 0, 0);
+    imu_fixed_set_gyro_raw(&imu, raw[0], raw[1], raw[2]);
+
+    double wx = raw[0] * (double)SCALE_GYRO * PI / 180.0, wy = raw[1] * (double)SCALE_GYRO * PI / 180.0, wz = raw[2] * (double)SCALE_GYRO * PI / 180.0;
+    double w = sqrt(wx * wx + wy * wy + wz * wz);
+
+    int ok = 1;
+    uint32_t ts = 0;
+    for(size_t i = 0; i < sizeof(steps_us) / sizeof(steps_us[0]); i++)
+    {
+        imu.orientation_quat.w = IMU_FIXED_Q30_ONE;
+        imu.orientation_quat.x = imu.orientation_quat.y = imu.orientation_quat.z = 0;
+        ts += steps_us[i];
+        imu_fixed_main_loop_ts(&imu, ts);
+
+        double a = w * steps_us[i] * 1e-6 / 2.0;
+        imu_quaternion_t q = imu_fixed_get_orientation(&imu);
+        // angle of conj(exact) * q from its vector part, acos of the dot product can't resolve it
+        double ew = cos(a), ex = sin(a) / w * wx, ey = sin(a) / w * wy, ez = sin(a) / w * wz;
+        double rx = ew * q.x - ex * q.w - ey * q.z + ez * q.y;
+        double ry = ew * q.y + ex * q.z - ey * q.w - ez * q.x;
+        double rz = ew * q.z - ex * q.y + ey * q.x - ez * q.w;
+        double err = 2.0 * asin(fmin(sqrt(rx * rx + ry * ry + rz * rz), 1.0));
+
+        int pass = err <= ERROR_BUDGET;
+        ok &= pass;
+        printf("  %4u ms step at %.0f deg/s, half angle %.2f rad, err %.2e rad  %s\n", steps_us[i] / 1000, w * 180.0 / PI, a, err,
+            pass ? "ok" : "OVER BUDGET");
+    }
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    const trajectory_t trajectories[] = {
+        {"static tilt", 20.0, IMU_SIM_STATIC, 0.0, 0.0},
+        {"constant spin", 10.0, IMU_SIM_SPIN, 90.0, 0.0},
+        {"sinusoidal wobble", 5.0, IMU_SIM_TILT, 30.0, 0.5},
+        {"fast tumble", 0.0, IMU_SIM_TUMBLE, 250.0, 2.0},
+    };
+
+    imu_sample_t * samples = malloc(SAMPLES * sizeof(imu_sample_t));
+    imu_quaternion_t * ref = malloc(SAMPLES * sizeof(imu_quaternion_t));
+    imu_quaternion_t * fixed = malloc(SAMPLES * sizeof(imu_quaternion_t));
+    int failed = 0;
+
+    printf("fixed point vs float filter, %zu samples at %.0f Hz, budget %.1e rad\n", SAMPLES, RATE, ERROR_BUDGET);
+
+    for(size_t t = 0; t < sizeof(trajectories) / sizeof(trajectories[0]); t++)
+    {
+        generate(&trajectories[t], samples);
+
+        double ns_float = run_float(samples, ref);
+        double ns_fixed = run_fixed(samples, fixed);
+
+        double maxerr = imu_sim_error(fixed, ref, SAMPLES, 0).max;
+
+        int ok = maxerr <= ERROR_BUDGET;
+        failed |= !ok;
+        printf("  %-20s max err %.2e rad  float %7.2f ns/sample  fixed %7.2f ns/sample  %s\n",
+            trajectories[t].name, maxerr, ns_float, ns_fixed, ok ? "ok" : "OVER BUDGET");
+    }
+
+    failed |= !check_long_steps();
+
+    free(fixed);
+    free(ref);
+    free(samples);
+    return failed;
+}
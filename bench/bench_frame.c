@@ -0,0 +1,325 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_frame.h"
+#include "libimu/imu_ingest.h"
+
+#define FRAMES      100000
+#define PERIOD_US   500
+// sequence and device time start close to their wrap
+#define SEQ0        65000
+#define TS0         0xfff00000u
+
+
+////////////////////////////////////////////
+
+
+typedef struct stream
+{
+    uint8_t * bytes;
+    size_t length;
+
+    imu_frame_t * frames;
+    // frame k left the sensor untouched
+    uint8_t * intact;
+    size_t omitted;
+    size_t corrupted;
+} stream_t;
+
+
+typedef struct writer
+{
+    int master;
+    const stream_t * s;
+} writer_t;
+
+
+////////////////////////////////////////////
+
+
+// frames with random values, a few lost on the way, some damaged, garbage in between
+static stream_t make_stream()
+{
+    stream_t s;
+    s.bytes = malloc((size_t)FRAMES * (IMU_FRAME_ENCODED + 8) + 64);
+    s.frames = calloc(FRAMES, sizeof(imu_frame_t));
+    s.intact = calloc(FRAMES, 1);
+    s.length = s.omitted = s.corrupted = 0;
+
+    srand(13);
+
+    // receiver starts in the middle of a frame
+    for(int i = 0; i < 9; i++)
+    {
+        s.bytes[s.length++] = (uint8_t)(rand() | 1);
+    }
+
+    for(size_t k = 0; k < FRAMES; k++)
+    {
+        imu_frame_t * f = s.frames + k;
+        f->seq = (uint16_t)(SEQ0 + k);
+        f->ts_us = TS0 + (uint32_t)(k * PERIOD_US);
+        for(int i = 0; i < 3; i++)
+        {
+            // zeros now and then, they are what cobs has to encode
+            f->accelerometer[i] = (int16_t)(rand() % 8 ? rand() : 0);
+            f->gyro[i] = (int16_t)(rand() % 8 ? rand() : 0);
+        }
+
+        uint8_t * out = s.bytes + s.length;
+        size_t len = imu_frame_encode(f, out);
+        int event = rand() % 100;
+        s.intact[k] = 1;
+
+        if(event == 0)
+        {
+            // never sent
+            s.omitted++;
+            s.intact[k] = 0;
+            continue;
+        }
+        else if(event == 1)
+        {
+            // bit errors, possibly in the delimiter
+            out[rand() % len] ^= (uint8_t)(1 + rand() % 255);
+            s.intact[k] = 0;
+        }
+        else if(event == 2)
+        {
+            // cut short
+            len -= 1 + rand() % (len - 2);
+            out[len - 1] = 0x00;
+            s.intact[k] = 0;
+        }
+        else if(event == 3)
+        {
+            // noise on the line between frames
+            int n = 1 + rand() % 8;
+            for(int i = 0; i < n; i++)
+            {
+                out[len++] = (uint8_t)rand();
+            }
+            out[len++] = 0x00;
+        }
+
+        s.corrupted += event >= 1 && event <= 3;
+        s.length += len;
+    }
+
+    return s;
+}
+
+
+////////////////////////////////////////////
+
+
+static void * writer_main(void * arg)
+{
+    writer_t * w = arg;
+    size_t sent = 0;
+
+    while(sent < w->s->length)
+    {
+        size_t chunk = w->s->length - sent < 4096 ? w->s->length - sent : 4096;
+        ssize_t n = write(w->master, w->s->bytes + sent, chunk);
+        if(n <= 0)
+        {
+            break;
+        }
+        sent += (size_t)n;
+    }
+
+    return NULL;
+}
+
+
+////////////////////////////////////////////
+
+
+static int open_pty(int * master, int * slave)
+{
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(*master < 0 || grantpt(*master) < 0 || unlockpt(*master) < 0)
+    {
+        return -1;
+    }
+
+    *slave = open(ptsname(*master), O_RDWR | O_NOCTTY);
+    if(*slave < 0)
+    {
+        return -1;
+    }
+
+    struct termios tios;
+    tcgetattr(*slave, &tios);
+    cfmakeraw(&tios);
+    tcsetattr(*slave, TCSANOW, &tios);
+    return 0;
+}
+
+
+////////////////////////////////////////////
+
+
+static int same(const imu_sample_t * a, const imu_frame_t * f)
+{
+    return a->ax == f->accelerometer[0] && a->ay == f->accelerometer[1] && a->az == f->accelerometer[2] &&
+        a->gx == f->gyro[0] && a->gy == f->gyro[1] && a->gz == f->gyro[2];
+}
+
+
+////////////////////////////////////////////
+
+
+static int run(const stream_t * s)
+{
+    int master, slave;
+    if(open_pty(&master, &slave) < 0)
+    {
+        printf("  cannot open a pseudo terminal, skipped\n");
+        return 1;
+    }
+
+    imu_ingest_t in = imu_ingest_init(slave);
+    imu_ingest_set_format(&in, IMU_INGEST_FORMAT_BINARY);
+
+    writer_t w = {master, s};
+    pthread_t thread;
+    double t0 = get_time_sec();
+    pthread_create(&thread, NULL, writer_main, &w);
+
+    // every frame is identified by its device time
+    uint8_t * seen = calloc(FRAMES, 1);
+    imu_sample_t samples[64];
+    size_t undetected = 0;
+    long first = -1, last = -1;
+
+    for(;;)
+    {
+        int n = imu_ingest_poll(&in, samples, 64, 200);
+        if(n <= 0)
+        {
+            break;
+        }
+
+        for(int i = 0; i < n; i++)
+        {
+            long k = lround((samples[i].ts * 1e6 - TS0) / PERIOD_US);
+            if(k < 0 || k >= FRAMES || seen[k] || !same(samples + i, s->frames + k))
+            {
+                undetected++;
+                continue;
+            }
+            seen[k] = 1;
+            first = first < 0 ? k : first;
+            last = k;
+        }
+    }
+
+    // the last wait timed out
+    double dt = get_time_sec() - t0 - 0.2;
+    pthread_join(thread, NULL);
+
+    size_t lost = 0, intact = 0;
+    for(size_t k = 0; k < FRAMES; k++)
+    {
+        intact += s->intact[k];
+        lost += s->intact[k] && !seen[k];
+    }
+
+    size_t gaps = (size_t)(last - first + 1) - (in.received - undetected);
+    int ok = undetected == 0 && lost <= s->corrupted && in.dropped == gaps;
+
+    printf("  %8zu frames/s %7.2f MB/s over the pty\n", (size_t)(in.received / dt), s->length / dt / 1e6);
+    printf("  received %zu of %zu intact, %zu frames damaged, %zu never sent\n", in.received, intact, s->corrupted, s->omitted);
+    printf("  intact frames lost next to damage %zu, damaged frames accepted %zu, errors %zu, sequence gaps %zu (expected %zu)\n",
+        lost, undetected, in.errors, in.dropped, gaps);
+
+    imu_ingest_free(&in);
+    close(slave);
+    close(master);
+    free(seen);
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+static int codec()
+{
+    int ok = 1;
+
+    // crc-16/ccitt-false check value
+    const uint8_t check[] = "123456789";
+    ok &= imu_frame_crc(check, 9) == 0x29b1;
+
+    // all zero payload fields, the most cobs blocks
+    imu_frame_t zero = {0}, back;
+    uint8_t buf[IMU_FRAME_ENCODED];
+    size_t len = imu_frame_encode(&zero, buf);
+    ok &= len == IMU_FRAME_ENCODED && buf[len - 1] == 0x00 && memchr(buf, 0, len - 1) == NULL;
+    ok &= imu_frame_decode(buf, len - 1, &back) == 0 && memcmp(&zero, &back, sizeof(back)) == 0;
+
+    imu_frame_t full = {0xffff, 0xffffffffu, {-32768, 32767, -1}, {1, 0, -2}};
+    len = imu_frame_encode(&full, buf);
+    ok &= imu_frame_decode(buf, len - 1, &back) == 0 && memcmp(&full, &back, sizeof(back)) == 0;
+
+    // decode cost against the text parser
+    const int reps = 1000000;
+    uint8_t enc[IMU_FRAME_ENCODED], work[IMU_FRAME_ENCODED];
+    len = imu_frame_encode(&full, enc);
+    volatile int sink = 0;
+    double t0 = get_time_sec();
+    for(int r = 0; r < reps; r++)
+    {
+        memcpy(work, enc, len);
+        sink += imu_frame_decode(work, len - 1, &back) + back.gyro[0];
+    }
+    double t_frame = get_time_sec() - t0;
+
+    const char * line = "-32768,32767,-1,1,0,-2,4294.967295";
+    imu_sample_t sample;
+    t0 = get_time_sec();
+    for(int r = 0; r < reps; r++)
+    {
+        sink += imu_ingest_parse_line(line, line + strlen(line), &sample);
+    }
+    double t_text = get_time_sec() - t0;
+
+    printf("  decode %6.1f ns/frame, text line %6.1f ns, %s\n", 1e9 * t_frame / reps, 1e9 * t_text / reps, ok ? "round trips ok" : "ROUND TRIP FAILED");
+    printf("  %d bytes/frame against %zu/line: %.0f against %.0f samples/s at 115200 8N1\n",
+        IMU_FRAME_ENCODED, strlen(line) + 2, 11520.0 / IMU_FRAME_ENCODED, 11520.0 / (strlen(line) + 2));
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    stream_t s = make_stream();
+    int ok = 1;
+
+    printf("binary frames\n");
+    ok &= codec();
+
+    printf("%d frames (%.2f MB) with losses, bit errors, truncation and noise\n", FRAMES, s.length / 1e6);
+    ok &= run(&s);
+
+    free(s.bytes);
+    free(s.frames);
+    free(s.intact);
+
+    printf("  %s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
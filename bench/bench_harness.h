@@ -0,0 +1,208 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+// timing harness shared by the benchmarks: warm-up, pinned to one cpu, median of repeated runs.
+// include after defining _GNU_SOURCE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "libimu/imu.h"
+
+#define BENCH_REPETITIONS   11
+// length of one timed repetition
+#define BENCH_TARGET_SEC    0.005
+#define BENCH_WARMUP_SEC    0.02
+
+
+////////////////////////////////////////////
+
+
+typedef struct bench_op
+{
+    const char * name;
+    // runs ops operations rounds times
+    void (*run)(size_t rounds);
+    size_t ops;
+} bench_op_t;
+
+
+typedef struct bench_result
+{
+    const char * name;
+    double min, median, mean, stddev;   // ns/op
+    double cycles, instructions;        // per op, < 0 without counters
+} bench_result_t;
+
+
+////////////////////////////////////////////
+
+
+// pins the calling thread, returns the cpu or -1 if it runs unpinned
+static int bench_pin(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(sched_setaffinity(0, sizeof(set), &set) < 0)
+    {
+        printf("cannot pin to cpu %d, running unpinned\n", cpu);
+        return -1;
+    }
+    return cpu;
+}
+
+
+////////////////////////////////////////////
+
+
+static int bench_perf_open(struct perf_event_attr * attr, int group)
+{
+    return (int)syscall(__NR_perf_event_open, attr, 0, -1, group, 0);
+}
+
+
+// cycles and instructions of this thread in user space, -1 if the kernel doesn't allow it
+static int bench_perf_init(int * instructions)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    int cycles = bench_perf_open(&attr, -1);
+    if(cycles < 0)
+    {
+        return -1;
+    }
+
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 0;
+    *instructions = bench_perf_open(&attr, cycles);
+    if(*instructions < 0)
+    {
+        close(cycles);
+        return -1;
+    }
+
+    return cycles;
+}
+
+
+////////////////////////////////////////////
+
+
+static int bench_compare(const void * a, const void * b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+// repetitions is clamped to [1, BENCH_REPETITIONS * 4]
+static bench_result_t bench_measure(const bench_op_t * op, int repetitions, int perf)
+{
+    bench_result_t res = {op->name, 0, 0, 0, 0, -1, -1};
+    repetitions = repetitions < 1 ? 1 : repetitions > BENCH_REPETITIONS * 4 ? BENCH_REPETITIONS * 4 : repetitions;
+
+    // warm-up, doubling rounds until one run takes a measurable time
+    size_t rounds = 1;
+    double t0 = get_time_sec(), dt = 0.0;
+    for(;;)
+    {
+        double t = get_time_sec();
+        op->run(rounds);
+        dt = get_time_sec() - t;
+        if(dt >= BENCH_TARGET_SEC / 8 && get_time_sec() - t0 >= BENCH_WARMUP_SEC)
+        {
+            break;
+        }
+        rounds = dt < BENCH_TARGET_SEC / 8 ? rounds * 2 : rounds;
+    }
+    rounds = (size_t)ceil(rounds * BENCH_TARGET_SEC / dt);
+
+    double ns[BENCH_REPETITIONS * 4];
+    uint64_t cycles = 0, instructions = 0;
+    int perf_instructions = -1;
+    int perf_cycles = perf ? bench_perf_init(&perf_instructions) : -1;
+
+    for(int k = 0; k < repetitions; k++)
+    {
+        if(perf_cycles >= 0)
+        {
+            ioctl(perf_cycles, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(perf_cycles, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        double t = get_time_sec();
+        op->run(rounds);
+        ns[k] = 1e9 * (get_time_sec() - t) / ((double)rounds * op->ops);
+
+        if(perf_cycles >= 0)
+        {
+            ioctl(perf_cycles, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            uint64_t values[3];
+            if(read(perf_cycles, values, sizeof(values)) == sizeof(values))
+            {
+                cycles += values[1];
+                instructions += values[2];
+            }
+        }
+    }
+
+    if(perf_cycles >= 0)
+    {
+        double n = (double)rounds * op->ops * repetitions;
+        res.cycles = cycles / n;
+        res.instructions = instructions / n;
+        close(perf_instructions);
+        close(perf_cycles);
+    }
+
+    for(int k = 0; k < repetitions; k++)
+    {
+        res.mean += ns[k] / repetitions;
+    }
+    for(int k = 0; k < repetitions; k++)
+    {
+        res.stddev += (ns[k] - res.mean) * (ns[k] - res.mean) / (repetitions > 1 ? repetitions - 1 : 1);
+    }
+    res.stddev = sqrt(res.stddev);
+
+    qsort(ns, (size_t)repetitions, sizeof(double), bench_compare);
+    res.min = ns[0];
+    res.median = ns[repetitions / 2];
+
+    return res;
+}
+
+
+////////////////////////////////////////////
+
+
+// one line per result: median, rate and relative spread
+static void bench_print(const bench_result_t * r)
+{
+    printf("  %-40s %9.2f ns/op %14.0f op/s  +-%5.1f%%", r->name, r->median, 1e9 / r->median, 100.0 * r->stddev / r->mean);
+    if(r->cycles >= 0)
+    {
+        printf("  %7.1f cycles %7.1f instructions  ipc %.2f", r->cycles, r->instructions, r->instructions / r->cycles);
+    }
+}
+
+
+////////////////////////////////////////////
+
+#endif
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_history.h"
+#include "libimu/imu_sim.h"
+
+// truth is simulated at RATE * OVERSAMPLE, every OVERSAMPLE-th sample goes into the history
+// and the ones in between are looked up
+#define RATE            1000.0
+#define OVERSAMPLE      8
+#define CAPACITY        1024
+#define TIERS           2
+
+
+////////////////////////////////////////////
+
+
+// rotation angle between two quaternions, deg. from the vector part of conj(a) b, acos of
+// their dot product can't resolve less than about 0.05 deg for float quaternions.
+static double angle(const imu_quaternion_t * a, const imu_quaternion_t * b)
+{
+    double aw = a->w, ax = a->x, ay = a->y, az = a->z, bw = b->w, bx = b->x, by = b->y, bz = b->z;
+    double w = aw * bw + ax * bx + ay * by + az * bz;
+    double x = aw * bx - ax * bw - ay * bz + az * by;
+    double y = aw * by + ax * bz - ay * bw - az * bx;
+    double z = aw * bz - ax * by + ay * bx - az * bw;
+    return 2.0 * atan2(sqrt(x * x + y * y + z * z), fabs(w)) * 180.0 / PI;
+}
+
+
+////////////////////////////////////////////
+
+
+// looks up every timestamp of the oversampled truth over the whole span of the history and
+// reports the error by the tier it came from
+static int check_interpolation(const char * name, int8_t motion, double amplitude, double frequency)
+{
+    imu_sim_t sim = imu_sim_init(RATE * OVERSAMPLE, 80.0);
+    sim.motion = motion;
+    sim.amplitude = amplitude;
+    sim.frequency = frequency;
+
+    size_t n = imu_sim_count(&sim);
+    imu_sample_t * samples = malloc(n * sizeof(imu_sample_t));
+    imu_quaternion_t * truth = malloc(n * sizeof(imu_quaternion_t));
+    imu_sim_generate(&sim, samples, truth);
+
+    imu_history_t h = imu_history_init(CAPACITY, TIERS);
+    for(size_t i = 0; i < n; i += OVERSAMPLE)
+    {
+        imu_history_push(&h, samples[i].ts, &truth[i]);
+    }
+
+    // tier of a lookup by its age in pushed samples
+    double oldest, latest;
+    imu_history_span(&h, &oldest, &latest);
+    const double latest_ts = samples[(n - 1) / OVERSAMPLE * OVERSAMPLE].ts;
+
+    int ok = 1;
+    for(int8_t interpolation = IMU_HISTORY_SLERP; interpolation <= IMU_HISTORY_NLERP; interpolation++)
+    {
+        double max[TIERS + 1] = {0}, rms[TIERS + 1] = {0}, exact = 0.0;
+        size_t count[TIERS + 1] = {0}, missing = 0;
+
+        for(size_t i = 0; i < n; i++)
+        {
+            if(samples[i].ts < oldest || samples[i].ts > latest)
+            {
+                continue;
+            }
+
+            imu_quaternion_t q;
+            if(imu_history_lookup(&h, samples[i].ts, interpolation, &q) != 0)
+            {
+                missing++;
+                continue;
+            }
+
+            double age = (latest_ts - samples[i].ts) * RATE;
+            int tier = 0;
+            for(double reach = CAPACITY - 2; tier < TIERS && age >= reach; reach *= IMU_HISTORY_TIER_DIVIDER)
+            {
+                tier++;
+            }
+
+            double e = angle(&q, &truth[i]);
+            max[tier] = fmax(max[tier], e);
+            rms[tier] += e * e;
+            count[tier]++;
+            if(tier == 0 && i % OVERSAMPLE == 0)
+            {
+                exact = fmax(exact, e);
+            }
+        }
+
+        printf("  %-8s %s\n", name, interpolation == IMU_HISTORY_SLERP ? "slerp" : "nlerp");
+        for(int k = 0; k <= TIERS; k++)
+        {
+            rms[k] = sqrt(rms[k] / count[k]);
+            printf("    tier %d  %4.0f Hz  %6zu lookups  rms %8.5f deg  max %8.5f deg\n", k, RATE / pow(IMU_HISTORY_TIER_DIVIDER, k),
+                count[k], rms[k], max[k]);
+        }
+
+        // pushed samples come back as they were, between them the error is that of the sampling
+        // rate. a tier IMU_HISTORY_TIER_DIVIDER times coarser lets it grow about that squared.
+        int tier_ok = max[0] < 0.001 && max[1] < 0.01 && max[2] < 0.5;
+        ok &= missing == 0 && exact < 1e-3 && tier_ok;
+        if(missing || exact >= 1e-3 || !tier_ok)
+        {
+            printf("    FAILED: %zu missing, %.5f deg at pushed samples\n", missing, exact);
+        }
+    }
+
+    imu_history_free(&h);
+    free(truth);
+    free(samples);
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+// out of range lookups, span, dropped samples and a history attached to an imu_t
+static int check_api()
+{
+    int ok = 1;
+    imu_history_t h = imu_history_init(100, 1);
+    imu_quaternion_t q = imu_quaternion_create(1.f, 0.f, 0.f, 0.f), r;
+    double oldest, latest;
+
+    ok &= h.capacity == 128 && h.tiers == 2;
+    ok &= imu_history_lookup(&h, 0.0, IMU_HISTORY_SLERP, &r) == -1 && imu_history_span(&h, &oldest, &latest) == -1;
+
+    for(int i = 0; i < 2000; i++)
+    {
+        ok &= imu_history_push(&h, 10.0 + i * 1e-3, &q) == 0;
+    }
+    ok &= imu_history_push(&h, 10.0 + 1999 * 1e-3, &q) == -1 && h.dropped == 1;
+
+    // full rate tier keeps the latest capacity - 1 samples, the one below every 8th of the last 127 * 8
+    ok &= imu_history_span(&h, &oldest, &latest) == 0;
+    ok &= fabs(latest - 11.999) < 1e-9 && fabs(oldest - (10.0 + (1999 / 8 - 126) * 8 * 1e-3)) < 1e-9;
+    ok &= imu_history_lookup(&h, oldest - 1e-6, IMU_HISTORY_SLERP, &r) == -1;
+    ok &= imu_history_lookup(&h, latest + 1e-6, IMU_HISTORY_SLERP, &r) == -1;
+    ok &= imu_history_lookup(&h, oldest, IMU_HISTORY_SLERP, &r) == 0 && imu_history_lookup(&h, latest, IMU_HISTORY_NLERP, &r) == 0;
+    imu_history_free(&h);
+
+    // every filter step of an attached imu_t is recorded at its sample timestamp
+    imu_sim_t sim = imu_sim_init(RATE, 2.0);
+    sim.motion = IMU_SIM_TILT;
+    sim.amplitude = 60.0;
+    sim.frequency = 0.5;
+    size_t n = imu_sim_count(&sim);
+    imu_sample_t * samples = malloc(n * sizeof(imu_sample_t));
+    imu_quaternion_t * out = malloc(n * sizeof(imu_quaternion_t));
+    imu_sim_generate(&sim, samples, NULL);
+
+    h = imu_history_init(4096, 0);
+    imu_t imu = imu_init(IMU_CALIBMODE_NEVER, (imu_real_t)sim.scale_factor_accelerometer, (imu_real_t)sim.scale_factor_gyro);
+    imu_set_state(&imu, IMU_STATE_READY);
+    imu_set_history(&imu, &h);
+    imu_process_batch(&imu, samples, n, out);
+
+    for(size_t i = 0; i < n; i++)
+    {
+        ok &= imu_history_lookup(&h, samples[i].ts, IMU_HISTORY_SLERP, &r) == 0;
+        ok &= memcmp(&r, &out[i], sizeof(r)) == 0;
+    }
+
+    imu_set_history(&imu, NULL);
+    imu_main_loop_ts(&imu, samples[n - 1].ts + 1.0);
+    ok &= imu_history_span(&h, &oldest, &latest) == 0 && latest == samples[n - 1].ts;
+
+    printf("  range, span, dropped samples, attached to imu_t (%zu steps)  %s\n", n, ok ? "" : "FAILED");
+
+    imu_history_free(&h);
+    free(out);
+    free(samples);
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+typedef struct stress
+{
+    imu_history_t h;
+    volatile int stop;
+} stress_t;
+
+
+typedef struct reader
+{
+    stress_t * s;
+    pthread_t thread;
+    uint32_t seed;
+    size_t lookups;
+    size_t misses;
+    size_t wrong;
+} reader_t;
+
+
+// rotation about z by ts radians, slerp between two of them is the same rotation at the
+// interpolated time, so a lookup has an exact answer
+static imu_quaternion_t spin(double ts)
+{
+    return imu_quaternion_create((imu_real_t)cos(ts / 2), 0, 0, (imu_real_t)sin(ts / 2));
+}
+
+
+static void * reader_main(void * arg)
+{
+    reader_t * r = arg;
+    stress_t * s = r->s;
+
+    while(!s->stop)
+    {
+        double oldest, latest;
+        if(imu_history_span(&s->h, &oldest, &latest) != 0)
+        {
+            continue;
+        }
+
+        // anywhere in the span, oldest end included, which the writer overwrites soonest
+        r->seed = r->seed * 1664525u + 1013904223u;
+        double ts = oldest + (latest - oldest) * (r->seed >> 8) / (double)(1u << 24);
+
+        imu_quaternion_t q;
+        if(imu_history_lookup(&s->h, ts, IMU_HISTORY_SLERP, &q) != 0)
+        {
+            // overtaken by the writer between span and lookup
+            r->misses++;
+            continue;
+        }
+
+        imu_quaternion_t t = spin(ts);
+        r->wrong += angle(&q, &t) > 0.05;
+        r->lookups++;
+    }
+
+    return NULL;
+}
+
+
+// one writer pushes as fast as it can into a small history while readers look up
+static int check_concurrent(size_t readers)
+{
+    stress_t * s = aligned_alloc(64, (sizeof(stress_t) + 63) / 64 * 64);
+    memset(s, 0, sizeof(*s));
+    s->h = imu_history_init(256, 2);
+    reader_t rd[8];
+
+    for(size_t i = 0; i < readers; i++)
+    {
+        memset(&rd[i], 0, sizeof(rd[i]));
+        rd[i].s = s;
+        rd[i].seed = 12345u + (uint32_t)i;
+        pthread_create(&rd[i].thread, NULL, reader_main, &rd[i]);
+    }
+
+    const size_t pushes = 4000000;
+    double t0 = get_time_sec();
+    for(size_t k = 0; k < pushes; k++)
+    {
+        double ts = k * 1e-4;
+        imu_quaternion_t q = spin(ts);
+        imu_history_push(&s->h, ts, &q);
+    }
+    double seconds = get_time_sec() - t0;
+
+    s->stop = 1;
+    size_t lookups = 0, misses = 0, wrong = 0;
+    for(size_t i = 0; i < readers; i++)
+    {
+        pthread_join(rd[i].thread, NULL);
+        lookups += rd[i].lookups;
+        misses += rd[i].misses;
+        wrong += rd[i].wrong;
+    }
+
+    int ok = wrong == 0 && lookups > 0;
+    printf("  %zu reader%s  %zu pushes in %.2f s  %zu lookups  %zu overtaken  %zu wrong  %s\n", readers, readers == 1 ? " " : "s",
+        pushes, seconds, lookups, misses, wrong, ok ? "" : "FAILED");
+
+    imu_history_free(&s->h);
+    free(s);
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+static volatile imu_real_t sink;
+
+
+static void timing()
+{
+    const size_t n = 1 << 20;
+    imu_history_t h = imu_history_init(CAPACITY, TIERS);
+    double t0 = get_time_sec();
+    for(size_t k = 0; k < n; k++)
+    {
+        double ts = k * 1e-3;
+        imu_quaternion_t q = spin(ts);
+        imu_history_push(&h, ts, &q);
+    }
+    double push = 1e9 * (get_time_sec() - t0) / n;
+
+    double oldest, latest;
+    imu_history_span(&h, &oldest, &latest);
+    printf("  push (cos/sin of the test rotation included)  %6.1f ns\n", push);
+
+    // lookups in the full rate tier and in the coarsest one
+    const double ages[2] = {0.5, (latest - oldest) * 0.9};
+    for(int a = 0; a < 2; a++)
+    {
+        for(int8_t interpolation = IMU_HISTORY_SLERP; interpolation <= IMU_HISTORY_NLERP; interpolation++)
+        {
+            const size_t m = 1 << 20;
+            imu_quaternion_t q, sum = imu_quaternion_create(0, 0, 0, 0);
+            t0 = get_time_sec();
+            for(size_t k = 0; k < m; k++)
+            {
+                imu_history_lookup(&h, latest - ages[a] + (k & 1023) * 1.7e-5, interpolation, &q);
+                sum = imu_quaternion_sum(&sum, &q);
+            }
+            double ns = 1e9 * (get_time_sec() - t0) / m;
+            sink = sum.w;
+            printf("  lookup %5.1f s back, %s  %6.1f ns\n", ages[a], interpolation == IMU_HISTORY_SLERP ? "slerp" : "nlerp", ns);
+        }
+    }
+
+    imu_history_free(&h);
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    int ok = 1;
+
+    printf("orientation history, %d entries a tier, %d downsampled tier%s, pushed at %.0f Hz, looked up at %.0f Hz\n",
+        CAPACITY, TIERS, TIERS == 1 ? "" : "s", RATE, RATE * OVERSAMPLE);
+    ok &= check_interpolation("tilt", IMU_SIM_TILT, 60.0, 0.2);
+    ok &= check_interpolation("tumble", IMU_SIM_TUMBLE, 100.0, 0.3);
+    ok &= check_api();
+
+    printf("one writer, lock-free readers\n");
+    ok &= check_concurrent(1);
+    ok &= check_concurrent(3);
+
+    printf("cost\n");
+    timing();
+
+    printf("  %s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
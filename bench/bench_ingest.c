@@ -0,0 +1,331 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_ingest.h"
+
+#define LINES       50000
+#define PARSE_REPS  20
+
+
+////////////////////////////////////////////
+
+
+typedef struct stream
+{
+    char * text;
+    size_t length;
+
+    // reference values, what sscanf() makes of every line
+    imu_sample_t * expected;
+    int * fields;
+} stream_t;
+
+
+typedef struct writer
+{
+    int master;
+    const stream_t * s;
+} writer_t;
+
+
+////////////////////////////////////////////
+
+
+// mpu6050 style lines, every third one without timestamp, some with \r\n
+static stream_t make_stream()
+{
+    stream_t s;
+    s.text = malloc((size_t)LINES * 64);
+    s.expected = calloc(LINES, sizeof(imu_sample_t));
+    s.fields = calloc(LINES, sizeof(int));
+    s.length = 0;
+
+    srand(12);
+    for(size_t k = 0; k < LINES; k++)
+    {
+        int v[6];
+        for(int i = 0; i < 6; i++)
+        {
+            v[i] = rand() % 65536 - 32768;
+        }
+
+        char * line = s.text + s.length;
+        int len;
+        if(k % 3 == 2)
+        {
+            len = sprintf(line, "%d,%d,%d,%d,%d,%d", v[0], v[1], v[2], v[3], v[4], v[5]);
+        }
+        else
+        {
+            len = sprintf(line, "%d,%d,%d,%d,%d,%d,%.6f", v[0], v[1], v[2], v[3], v[4], v[5], 1000.0 + k * 0.001);
+        }
+        len += sprintf(line + len, k % 5 == 0 ? "\r\n" : "\n");
+
+        int ax, ay, az, gx, gy, gz;
+        double ts = 0.0;
+        s.fields[k] = sscanf(line, "%d,%d,%d,%d,%d,%d,%lf", &ax, &ay, &az, &gx, &gy, &gz, &ts);
+        s.expected[k] = (imu_sample_t){ax, ay, az, gx, gy, gz, ts};
+        s.length += (size_t)len;
+    }
+
+    return s;
+}
+
+
+////////////////////////////////////////////
+
+
+static int same(const imu_sample_t * a, const imu_sample_t * b, int ts)
+{
+    return a->ax == b->ax && a->ay == b->ay && a->az == b->az &&
+        a->gx == b->gx && a->gy == b->gy && a->gz == b->gz &&
+        (!ts || fabs(a->ts - b->ts) < 1e-9);
+}
+
+
+////////////////////////////////////////////
+
+
+static void * writer_main(void * arg)
+{
+    writer_t * w = arg;
+    size_t sent = 0;
+
+    while(sent < w->s->length)
+    {
+        size_t chunk = w->s->length - sent < 4096 ? w->s->length - sent : 4096;
+        ssize_t n = write(w->master, w->s->text + sent, chunk);
+        if(n <= 0)
+        {
+            break;
+        }
+        sent += (size_t)n;
+    }
+
+    return NULL;
+}
+
+
+////////////////////////////////////////////
+
+
+// pseudo terminal in raw mode standing in for the serial port
+static int open_pty(int * master, int * slave)
+{
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(*master < 0 || grantpt(*master) < 0 || unlockpt(*master) < 0)
+    {
+        return -1;
+    }
+
+    *slave = open(ptsname(*master), O_RDWR | O_NOCTTY);
+    if(*slave < 0)
+    {
+        return -1;
+    }
+
+    struct termios tios;
+    tcgetattr(*slave, &tios);
+    cfmakeraw(&tios);
+    tcsetattr(*slave, TCSANOW, &tios);
+    return 0;
+}
+
+
+////////////////////////////////////////////
+
+
+// runner_serial() before imu_ingest_t: 1 byte reads and sscanf(), without its usleep(1000)
+static size_t read_legacy(int fd, const stream_t * s)
+{
+    size_t mismatches = 0;
+
+    for(size_t k = 0; k < LINES; k++)
+    {
+        char buffer[128] = {0x00};
+        int index = 0;
+        unsigned char c = 0x00;
+        while(index < (int)sizeof(buffer) - 1 && read(fd, &c, 1) == 1)
+        {
+            buffer[index++] = c;
+            if(c == 0x0A)
+                break;
+        }
+
+        int ax, ay, az, gx, gy, gz;
+        double ts = 0.0;
+        int fields = sscanf(buffer, "%d,%d,%d,%d,%d,%d,%lf", &ax, &ay, &az, &gx, &gy, &gz, &ts);
+        imu_sample_t sample = {ax, ay, az, gx, gy, gz, ts};
+        mismatches += fields != s->fields[k] || !same(&sample, s->expected + k, fields == 7);
+    }
+
+    return mismatches;
+}
+
+
+////////////////////////////////////////////
+
+
+static size_t read_ingest(int fd, const stream_t * s)
+{
+    imu_ingest_t in = imu_ingest_init(fd);
+    imu_sample_t samples[64];
+    size_t mismatches = 0, k = 0;
+
+    while(k < LINES)
+    {
+        int n = imu_ingest_poll(&in, samples, 64, 1000);
+        if(n <= 0)
+        {
+            break;
+        }
+
+        for(int i = 0; i < n; i++, k++)
+        {
+            mismatches += !same(samples + i, s->expected + k, s->fields[k] == 7);
+        }
+    }
+
+    mismatches += (LINES - k) + in.errors;
+    imu_ingest_free(&in);
+    return mismatches;
+}
+
+
+////////////////////////////////////////////
+
+
+static int run(const stream_t * s, int ingest)
+{
+    int master, slave;
+    if(open_pty(&master, &slave) < 0)
+    {
+        printf("  cannot open a pseudo terminal, skipped\n");
+        return 1;
+    }
+
+    writer_t w = {master, s};
+    pthread_t thread;
+    double t0 = get_time_sec();
+    pthread_create(&thread, NULL, writer_main, &w);
+
+    size_t mismatches = ingest ? read_ingest(slave, s) : read_legacy(slave, s);
+
+    double dt = get_time_sec() - t0;
+    pthread_join(thread, NULL);
+    close(slave);
+    close(master);
+
+    printf("  %-26s %10.0f lines/s %8.2f MB/s  mismatches %zu\n", ingest ? "imu_ingest (epoll, blocks)" : "read 1 byte + sscanf",
+        LINES / dt, s->length / dt / 1e6, mismatches);
+    return mismatches == 0;
+}
+
+
+////////////////////////////////////////////
+
+
+// parser alone over the whole stream in memory
+static int parse_only(const stream_t * s)
+{
+    volatile imu_real_t sink = 0;
+    int ok = 1;
+
+    double t0 = get_time_sec();
+    for(int r = 0; r < PARSE_REPS; r++)
+    {
+        const char * p = s->text;
+        for(size_t k = 0; k < LINES; k++)
+        {
+            // sscanf() measures the whole string first, lines get their own buffer like in the demo
+            char buffer[128];
+            const char * eol = strchr(p, '\n');
+            memcpy(buffer, p, (size_t)(eol - p));
+            buffer[eol - p] = 0;
+
+            int ax, ay, az, gx, gy, gz;
+            double ts;
+            sscanf(buffer, "%d,%d,%d,%d,%d,%d,%lf", &ax, &ay, &az, &gx, &gy, &gz, &ts);
+            sink += ax;
+            p = eol + 1;
+        }
+    }
+    double t_sscanf = get_time_sec() - t0;
+
+    t0 = get_time_sec();
+    for(int r = 0; r < PARSE_REPS; r++)
+    {
+        const char * p = s->text;
+        for(size_t k = 0; k < LINES; k++)
+        {
+            const char * eol = strchr(p, '\n');
+            imu_sample_t sample;
+            int fields = imu_ingest_parse_line(p, eol, &sample);
+            if(r == 0)
+            {
+                ok &= fields == s->fields[k] && same(&sample, s->expected + k, fields == 7);
+            }
+            sink += sample.ax;
+            p = eol + 1;
+        }
+    }
+    double t_ingest = get_time_sec() - t0;
+
+    double n = (double)LINES * PARSE_REPS;
+    printf("  %-26s %8.1f ns/line\n", "sscanf", 1e9 * t_sscanf / n);
+    printf("  %-26s %8.1f ns/line  (%.1fx)\n", "imu_ingest_parse_line", 1e9 * t_ingest / n, t_sscanf / t_ingest);
+
+    // lines the parser must refuse
+    const char * bad[] = {"", "1,2,3,4,5", "1,2,3,4,5,x", "1,2,3,4,5,6,", "1,2,3,4,5,6,7,8", "1,,3,4,5,6", "1234567890,2,3,4,5,6",
+        "-99999999999999999999,2,3,4,5,6"};
+    for(size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        imu_sample_t sample;
+        if(imu_ingest_parse_line(bad[i], bad[i] + strlen(bad[i]), &sample) != 0)
+        {
+            printf("  accepted malformed line \"%s\"\n", bad[i]);
+            ok = 0;
+        }
+    }
+
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    stream_t s = make_stream();
+    int ok = 1;
+
+    printf("serial ingest, %d lines (%.2f MB) over a pseudo terminal\n", LINES, s.length / 1e6);
+    ok &= run(&s, 0);
+    ok &= run(&s, 1);
+    printf("  the demo's usleep(1000) after every line capped the old path at 1000 lines/s\n");
+
+    printf("line parser\n");
+    ok &= parse_only(&s);
+
+    free(s.text);
+    free(s.expected);
+    free(s.fields);
+
+    if(!ok)
+    {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    printf("  ok\n");
+    return 0;
+}
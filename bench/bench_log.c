@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_log.h"
+
+#define RATE        1000.0
+#define DURATION    600.0
+#define SAMPLES     ((size_t)(RATE * DURATION))
+#define SEEKS       100000
+
+#define SCALE_ACCL  (2.f / 16384.f)
+#define SCALE_GYRO  (2.f / 131.f)
+
+// a day at RATE must replay within this many seconds
+#define DAY_BUDGET  120.0
+
+
+////////////////////////////////////////////
+
+
+static float frand()
+{
+    return (float)rand() / RAND_MAX * 2.f - 1.f;
+}
+
+
+////////////////////////////////////////////
+
+
+// still for calibration, then slow turns with sensor noise. raw counts like an mpu6050.
+static imu_sample_t * make_samples()
+{
+    imu_sample_t * s = malloc(SAMPLES * sizeof(imu_sample_t));
+    srand(14);
+
+    for(size_t i = 0; i < SAMPLES; i++)
+    {
+        double t = 100.0 + i / RATE;
+        float turning = i > 10 * RATE && fmod(t, 20.0) < 5.0;
+        s[i].ax = 40.f + 20.f * frand();
+        s[i].ay = -30.f + 20.f * frand();
+        s[i].az = 8192.f + 20.f * frand();
+        s[i].gx = 12.f + 3.f * frand();
+        s[i].gy = -7.f + 3.f * frand() + 900.f * turning;
+        s[i].gz = 3.f + 3.f * frand();
+        s[i].ts = t;
+    }
+
+    return s;
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    const char * path = "/tmp/bench_log.imulog";
+    imu_sample_t * samples = make_samples();
+    int ok = 1;
+
+    imu_t reference = imu_init(IMU_CALIBMODE_ONCE, SCALE_ACCL, SCALE_GYRO);
+    imu_t recorded = reference;
+
+    printf("sample log, %.0f s at %.0f Hz\n", DURATION, RATE);
+
+    // recording while the filter runs, like the demo does
+    imu_log_writer_t w = imu_log_writer_open(path, &recorded);
+    if(w.fd < 0)
+    {
+        printf("  FAILED\n");
+        return 1;
+    }
+
+    double t0 = get_time_sec();
+    for(size_t i = 0; i < SAMPLES; i++)
+    {
+        ok &= imu_log_append(&w, samples + i) == 0;
+    }
+    double t_append = get_time_sec() - t0;
+
+    // a recorder that never got closed, e.g. killed by power loss
+    imu_log_t crashed = imu_log_open(path);
+    ok &= crashed.count == SAMPLES && crashed.index_count == (SAMPLES + IMU_LOG_INDEX_STRIDE - 1) / IMU_LOG_INDEX_STRIDE;
+    imu_log_close(&crashed);
+
+    ok &= imu_log_writer_close(&w) == 0;
+    printf("  record   %6.1f ns/sample\n", 1e9 * t_append / SAMPLES);
+
+    // replay must reproduce the live run exactly
+    imu_process_batch(&reference, samples, SAMPLES, NULL);
+
+    imu_log_t log = imu_log_open(path);
+    ok &= log.count == SAMPLES;
+    imu_t replayed = imu_log_init_imu(&log);
+
+    t0 = get_time_sec();
+    imu_sample_t chunk[1024];
+    for(uint64_t i = 0; i < log.count; i += 1024)
+    {
+        size_t n = log.count - i < 1024 ? (size_t)(log.count - i) : 1024;
+        for(size_t k = 0; k < n; k++)
+        {
+            chunk[k] = imu_log_sample(&log, i + k);
+        }
+        imu_process_batch(&replayed, chunk, n, NULL);
+    }
+    double t_replay = get_time_sec() - t0;
+
+    int same = memcmp(&reference.orientation_quat, &replayed.orientation_quat, sizeof(imu_quaternion_t)) == 0;
+    ok &= same;
+    double day = t_replay / SAMPLES * RATE * 86400.0;
+    ok &= day < DAY_BUDGET;
+    printf("  replay   %6.1f ns/sample, %.0fx real time, 24 h at %.0f Hz in %.1f s, %s live run\n",
+        1e9 * t_replay / SAMPLES, DURATION / t_replay, RATE, day, same ? "matches" : "DIFFERS FROM");
+
+    // seeking by time against a plain search
+    size_t wrong = 0;
+    t0 = get_time_sec();
+    for(int k = 0; k < SEEKS; k++)
+    {
+        double ts = 99.0 + (DURATION + 2.0) * rand() / RAND_MAX;
+        uint64_t i = imu_log_seek(&log, ts);
+        wrong += (i < log.count && log.records[i].ts < ts) || (i > 0 && log.records[i - 1].ts >= ts);
+    }
+    double t_seek = get_time_sec() - t0;
+    ok &= wrong == 0;
+    printf("  seek     %6.1f ns, %zu wrong\n", 1e9 * t_seek / SEEKS, wrong);
+
+    imu_log_close(&log);
+    unlink(path);
+    free(samples);
+
+    printf("  %s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
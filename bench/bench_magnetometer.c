@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_magcal.h"
+#include "libimu/imu_sim.h"
+
+#define RATE            1000.0
+// magnetometer runs at RATE / MAG_DIVIDER
+#define MAG_DIVIDER     10
+
+
+////////////////////////////////////////////
+
+
+static imu_sim_t sensor(int8_t motion, double amplitude, double frequency, double duration)
+{
+    imu_sim_t sim = imu_sim_init(RATE, duration);
+    sim.motion = motion;
+    sim.amplitude = amplitude;
+    sim.frequency = frequency;
+    sim.tilt = 10.0;
+    sim.gyro_noise = 0.1;
+    sim.accelerometer_noise = 0.004;
+    sim.magnetometer_noise = 0.3;
+
+    // iron of a small board: offsets larger than the field, 10% scale and cross coupling
+    sim.hard_iron[0] = 60.0;
+    sim.hard_iron[1] = -35.0;
+    sim.hard_iron[2] = 80.0;
+    const double soft[9] = {1.10, 0.05, -0.02, 0.05, 0.93, 0.04, -0.02, 0.04, 1.02};
+    for(int k = 0; k < 9; k++)
+    {
+        sim.soft_iron[k] = soft[k];
+    }
+    return sim;
+}
+
+
+////////////////////////////////////////////
+
+
+// fits the calibrator over a stream, reports offset error (uT), field length error of the
+// corrected samples and their direction error against the true field (deg)
+static int check_calibration(const char * name, const imu_sim_t * sim, int expect_fit, imu_magcal_t * fitted)
+{
+    size_t n = imu_sim_count(sim);
+    imu_sample_t * samples = malloc(n * sizeof(imu_sample_t));
+    imu_quaternion_t * truth = malloc(n * sizeof(imu_quaternion_t));
+    imu_vec3_t * mag = malloc(n * sizeof(imu_vec3_t));
+    imu_sim_generate(sim, samples, truth);
+    imu_sim_magnetometer(sim, truth, n, mag);
+
+    imu_magcal_t cal = imu_magcal_init();
+    double add_ns = 0.0, fit_ns = 0.0, t0 = get_time_sec();
+    for(size_t i = 0; i < n; i += MAG_DIVIDER)
+    {
+        imu_magcal_add(&cal, &mag[i]);
+    }
+    add_ns = 1e9 * (get_time_sec() - t0) / (n / MAG_DIVIDER);
+
+    // worst case of a single fit, the only step that isn't a handful of multiply-adds
+    for(int r = 0; r < 1000; r++)
+    {
+        imu_magcal_t c = cal;
+        t0 = get_time_sec();
+        imu_magcal_fit(&c);
+        double ns = 1e9 * (get_time_sec() - t0);
+        fit_ns = r == 0 || ns < fit_ns ? ns : fit_ns;
+    }
+
+    int ok = expect_fit ? cal.valid : !cal.valid;
+    if(fitted)
+    {
+        *fitted = cal;
+    }
+    if(!cal.valid)
+    {
+        printf("  %-22s no fit (%u window%s)  add %5.1f ns  fit %6.0f ns  %s\n", name, (unsigned)(n / MAG_DIVIDER / IMU_MAGCAL_WINDOW),
+            n / MAG_DIVIDER / IMU_MAGCAL_WINDOW == 1 ? "" : "s", add_ns, fit_ns, ok ? "" : "SHOULD HAVE FITTED");
+        free(mag);
+        free(truth);
+        free(samples);
+        return ok;
+    }
+
+    const double b = sqrt(sim->magnetic_field[0] * sim->magnetic_field[0] + sim->magnetic_field[1] * sim->magnetic_field[1] +
+                          sim->magnetic_field[2] * sim->magnetic_field[2]);
+    double offset_err = 0.0;
+    const double offset[3] = {cal.offset.x, cal.offset.y, cal.offset.z};
+    for(int k = 0; k < 3; k++)
+    {
+        offset_err = fmax(offset_err, fabs(offset[k] * sim->scale_factor_magnetometer - sim->hard_iron[k]));
+    }
+
+    // noise free copy of the stream for the direction check
+    imu_sim_t clean = *sim;
+    clean.magnetometer_noise = 0.0;
+    clean.quantize = 0;
+    imu_sim_magnetometer(&clean, truth, n, mag);
+
+    double len_rms = 0.0, dir_max = 0.0;
+    size_t count = 0;
+    for(size_t i = 0; i < n; i += MAG_DIVIDER)
+    {
+        imu_vec3_t m = imu_magcal_apply(&cal, &mag[i]);
+        double len = sqrt((double)m.x * m.x + (double)m.y * m.y + (double)m.z * m.z);
+        len_rms += (len - 1.0) * (len - 1.0);
+
+        // true field in body frame, R^T b / |b|
+        const double qw = truth[i].w, qx = truth[i].x, qy = truth[i].y, qz = truth[i].z;
+        const double * f = sim->magnetic_field;
+        double t[3] = {
+            ((1.0 - 2.0 * (qy * qy + qz * qz)) * f[0] + 2.0 * (qx * qy + qw * qz) * f[1] + 2.0 * (qx * qz - qw * qy) * f[2]) / b,
+            (2.0 * (qx * qy - qw * qz) * f[0] + (1.0 - 2.0 * (qx * qx + qz * qz)) * f[1] + 2.0 * (qy * qz + qw * qx) * f[2]) / b,
+            (2.0 * (qx * qz + qw * qy) * f[0] + 2.0 * (qy * qz - qw * qx) * f[1] + (1.0 - 2.0 * (qx * qx + qy * qy)) * f[2]) / b,
+        };
+        double cx = m.y * t[2] - m.z * t[1], cy = m.z * t[0] - m.x * t[2], cz = m.x * t[1] - m.y * t[0];
+        double dir = atan2(sqrt(cx * cx + cy * cy + cz * cz), m.x * t[0] + m.y * t[1] + m.z * t[2]);
+        dir_max = fmax(dir_max, dir);
+        count++;
+    }
+    len_rms = sqrt(len_rms / count);
+    dir_max *= 180.0 / PI;
+
+    ok &= offset_err < 1.0 && len_rms < 0.01 && dir_max < 1.5;
+    printf("  %-22s offset err %5.2f uT  field %6.1f uT  length err %6.4f  direction err %5.2f deg  add %5.1f ns  fit %6.0f ns  %s\n",
+        name, offset_err, cal.field * sim->scale_factor_magnetometer, len_rms, dir_max, add_ns, fit_ns, ok ? "" : "FAILED");
+
+    free(mag);
+    free(truth);
+    free(samples);
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+// full orientation error, heading included, with and without the magnetometer.
+// calibration is fitted online, or starts from a known one if cal is not NULL.
+static int check_heading(const imu_sim_t * sim, int8_t engine, const char * name, double skip, const imu_magcal_t * cal)
+{
+    size_t n = imu_sim_count(sim);
+    imu_sample_t * samples = malloc(n * sizeof(imu_sample_t));
+    imu_quaternion_t * truth = malloc(n * sizeof(imu_quaternion_t));
+    imu_quaternion_t * out = malloc(n * sizeof(imu_quaternion_t));
+    imu_vec3_t * mag = malloc(n * sizeof(imu_vec3_t));
+    imu_sim_generate(sim, samples, truth);
+    imu_sim_magnetometer(sim, truth, n, mag);
+
+    double rms[2];
+    for(int use = 0; use < 2; use++)
+    {
+        imu_t imu = imu_init(IMU_CALIBMODE_NEVER, (imu_real_t)sim->scale_factor_accelerometer, (imu_real_t)sim->scale_factor_gyro);
+        imu_set_state(&imu, IMU_STATE_READY);
+        imu_set_estimation_mode(&imu, IMU_ESTIMODE_GYRO | IMU_ESTIMODE_ACCELEROMETER | engine | (use ? IMU_ESTIMODE_MAGNETOMETER : 0));
+        if(cal)
+        {
+            imu_set_magnetometer_calibration(&imu, &cal->offset, cal->soft_iron);
+        }
+
+        for(size_t i = 0; i < n; i++)
+        {
+            imu_set_accelerometer_raw(&imu, samples[i].ax, samples[i].ay, samples[i].az);
+            imu_set_gyro_raw(&imu, samples[i].gx, samples[i].gy, samples[i].gz);
+            if(i % MAG_DIVIDER == 0)
+            {
+                imu_set_magnetometer_raw(&imu, mag[i].x, mag[i].y, mag[i].z);
+            }
+            imu_main_loop_ts(&imu, samples[i].ts);
+            out[i] = imu.orientation_quat;
+        }
+
+        rms[use] = imu_sim_error(out, truth, n, (size_t)(skip * sim->rate)).rms * 180.0 / PI;
+    }
+
+    int ok = rms[1] < 1.0;
+    printf("  %-22s rms %7.3f deg without, %6.3f deg with magnetometer  %s\n", name, rms[0], rms[1], ok ? "" : "FAILED");
+
+    free(mag);
+    free(out);
+    free(truth);
+    free(samples);
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    int ok = 1;
+
+    imu_sim_t tumble = sensor(IMU_SIM_TUMBLE, 100.0, 0.3, 60.0);
+    imu_sim_t tilts = sensor(IMU_SIM_TILT, 60.0, 0.2, 60.0);
+    imu_sim_t spin = sensor(IMU_SIM_SPIN, 90.0, 0.0, 60.0);
+    imu_magcal_t cal;
+
+    printf("online hard/soft-iron calibration, magnetometer at %.0f Hz\n", RATE / MAG_DIVIDER);
+    ok &= check_calibration("tumble", &tumble, 1, &cal);
+    ok &= check_calibration("sinusoidal tilts", &tilts, 1, NULL);
+    // a single plane of rotation can't separate hard iron from field along its axis
+    ok &= check_calibration("flat spin (no fit)", &spin, 0, NULL);
+
+    // tilting through many directions, calibration is fitted on the way
+    imu_sim_t moving = sensor(IMU_SIM_TILT, 60.0, 0.2, 120.0);
+    moving.gyro_bias[2] = 0.3;
+    printf("heading, 120 s sinusoidal tilts with 0.3 deg/s gyro bias, calibrated online, first 30 s left out\n");
+    ok &= check_heading(&moving, 0, "complementary", 30.0, NULL);
+    ok &= check_heading(&moving, IMU_ESTIMODE_MADGWICK, "madgwick", 30.0, NULL);
+    ok &= check_heading(&moving, IMU_ESTIMODE_MAHONY, "mahony", 30.0, NULL);
+
+    // yaw only, where nothing but the magnetometer sees the bias (18 deg per minute).
+    // calibration is the one fitted from the tumble above.
+    imu_sim_t flat = sensor(IMU_SIM_SPIN, 30.0, 0.0, 120.0);
+    flat.tilt = 0.0;
+    flat.gyro_bias[2] = 0.3;
+    printf("heading, 120 s flat spin with 0.3 deg/s gyro bias, calibration from the tumble, first 1 s left out\n");
+    ok &= check_heading(&flat, 0, "complementary", 1.0, &cal);
+    ok &= check_heading(&flat, IMU_ESTIMODE_MADGWICK, "madgwick", 1.0, &cal);
+    ok &= check_heading(&flat, IMU_ESTIMODE_MAHONY, "mahony", 1.0, &cal);
+
+    printf("  %s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_merge.h"
+#include "libimu/imu_sim.h"
+
+#define RATE            3200.0
+// accelerometer runs at RATE / ACCL_DIVIDER, its samples sit between gyro samples
+#define ACCL_DIVIDER    4
+#define ACCL_PHASE      2
+#define OUT_MAX         256
+
+
+////////////////////////////////////////////
+
+
+static imu_sim_t sensor(int8_t motion, double amplitude, double frequency, double duration)
+{
+    imu_sim_t sim = imu_sim_init(RATE, duration);
+    sim.motion = motion;
+    sim.amplitude = amplitude;
+    sim.frequency = frequency;
+    sim.tilt = 10.0;
+    sim.gyro_noise = 0.1;
+    sim.accelerometer_noise = 0.004;
+    return sim;
+}
+
+
+////////////////////////////////////////////
+
+
+static imu_t filter(const imu_sim_t * sim, int8_t engine)
+{
+    imu_t imu = imu_init(IMU_CALIBMODE_NEVER, (imu_real_t)sim->scale_factor_accelerometer, (imu_real_t)sim->scale_factor_gyro);
+    imu_set_state(&imu, IMU_STATE_READY);
+    imu_set_estimation_mode(&imu, IMU_ESTIMODE_GYRO | IMU_ESTIMODE_ACCELEROMETER | engine);
+    return imu;
+}
+
+
+////////////////////////////////////////////
+
+
+static int is_accelerometer(size_t i)
+{
+    return i % ACCL_DIVIDER == ACCL_PHASE;
+}
+
+
+// accelerometer timestamps are a little off the gyro ones, as with two clocks
+static double accelerometer_ts(const imu_sample_t * s)
+{
+    return s->ts - 0.1 / RATE;
+}
+
+
+////////////////////////////////////////////
+
+
+// what the merge has to come down to: the accelerometer set whenever it has a sample,
+// one filter step per gyro sample
+static void reference(imu_t * imu, const imu_sample_t * samples, size_t n, imu_quaternion_t * out)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        if(is_accelerometer(i))
+        {
+            imu_set_accelerometer_raw(imu, samples[i].ax, samples[i].ay, samples[i].az);
+        }
+        imu_set_gyro_raw(imu, samples[i].gx, samples[i].gy, samples[i].gz);
+        imu_main_loop_ts(imu, samples[i].ts);
+        out[i] = imu->orientation_quat;
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+// reads both fifos the way a driver would: every sample up to some time, in bursts of
+// random length and in random sensor order, processing after each read with a random
+// cap on the steps. pattern 0 uses fixed 10 ms reads, gyro first.
+static size_t merged(imu_t * imu, const imu_sample_t * samples, size_t n, imu_quaternion_t * out, int pattern, size_t * dropped)
+{
+    imu_merge_t m = imu_merge_init();
+    size_t gi = 0, ai = ACCL_PHASE, steps = 0;
+    srand(pattern);
+
+    double until = samples[0].ts;
+    while(gi < n || ai < n)
+    {
+        until += pattern ? (1 + rand() % 40) * 0.25e-3 : 10e-3;
+        int accelerometer_first = pattern && rand() % 2;
+        for(int k = 0; k < 2; k++)
+        {
+            if((k == 0) == accelerometer_first)
+            {
+                for(; ai < n && accelerometer_ts(&samples[ai]) < until; ai += ACCL_DIVIDER)
+                {
+                    imu_merge_push_accelerometer(&m, accelerometer_ts(&samples[ai]), samples[ai].ax, samples[ai].ay, samples[ai].az);
+                }
+            }
+            else
+            {
+                for(; gi < n && samples[gi].ts < until; gi++)
+                {
+                    imu_merge_push_gyro(&m, samples[gi].ts, samples[gi].gx, samples[gi].gy, samples[gi].gz);
+                }
+            }
+        }
+
+        size_t max = pattern ? 1 + rand() % OUT_MAX : OUT_MAX, done;
+        while((done = imu_merge_process(&m, imu, out + steps, max)) > 0)
+        {
+            steps += done;
+        }
+    }
+    steps += imu_merge_flush(&m, imu, out + steps, n - steps);
+
+    *dropped = m.dropped;
+    return steps;
+}
+
+
+////////////////////////////////////////////
+
+
+// merged streams against a plain loop over the same samples, bit for bit, for any read pattern
+static int check_order(const imu_sim_t * sim, int8_t engine, const char * name)
+{
+    size_t n = imu_sim_count(sim);
+    imu_sample_t * samples = malloc(n * sizeof(imu_sample_t));
+    imu_quaternion_t * truth = malloc(n * sizeof(imu_quaternion_t));
+    imu_quaternion_t * expected = malloc(n * sizeof(imu_quaternion_t));
+    imu_quaternion_t * out = malloc(n * sizeof(imu_quaternion_t));
+    imu_sim_generate(sim, samples, truth);
+
+    imu_t imu = filter(sim, engine);
+    reference(&imu, samples, n, expected);
+
+    int ok = 1;
+    for(int pattern = 0; pattern < 4; pattern++)
+    {
+        size_t dropped;
+        imu = filter(sim, engine);
+        size_t steps = merged(&imu, samples, n, out, pattern, &dropped);
+        ok &= steps == n && dropped == 0 && memcmp(out, expected, n * sizeof(imu_quaternion_t)) == 0;
+    }
+    printf("  %-22s %zu gyro steps, 4 read patterns  %s\n", name, n, ok ? "" : "DIFFERENT FROM REFERENCE");
+
+    free(out);
+    free(expected);
+    free(truth);
+    free(samples);
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+// accelerometer at a quarter of the gyro rate against both at the gyro rate. holding the last
+// accelerometer sample and correcting on every step is shown for comparison.
+static int check_accuracy(const imu_sim_t * sim, int8_t engine, const char * name)
+{
+    size_t n = imu_sim_count(sim);
+    imu_sample_t * samples = malloc(n * sizeof(imu_sample_t));
+    imu_sample_t * held = malloc(n * sizeof(imu_sample_t));
+    imu_quaternion_t * truth = malloc(n * sizeof(imu_quaternion_t));
+    imu_quaternion_t * out = malloc(n * sizeof(imu_quaternion_t));
+    imu_sim_generate(sim, samples, truth);
+    size_t skip = (size_t)(5.0 * RATE);
+
+    imu_t imu = filter(sim, engine);
+    imu_process_batch(&imu, samples, n, out);
+    double lockstep = imu_sim_error(out, truth, n, skip).rms * 180.0 / PI;
+
+    for(size_t i = 0; i < n; i++)
+    {
+        held[i] = samples[i];
+        size_t a = i < ACCL_PHASE ? ACCL_PHASE : i - (i - ACCL_PHASE) % ACCL_DIVIDER;
+        held[i].ax = samples[a].ax;
+        held[i].ay = samples[a].ay;
+        held[i].az = samples[a].az;
+    }
+    imu = filter(sim, engine);
+    imu_process_batch(&imu, held, n, out);
+    double hold = imu_sim_error(out, truth, n, skip).rms * 180.0 / PI;
+
+    size_t dropped;
+    imu = filter(sim, engine);
+    merged(&imu, samples, n, out, 1, &dropped);
+    double merge = imu_sim_error(out, truth, n, skip).rms * 180.0 / PI;
+
+    // a quarter of the samples at four times the gain, the noise part of the error can double
+    int ok = merge < 2.0 * lockstep + 0.02;
+    printf("  %-22s rms %6.3f deg lockstep, %6.3f deg held, %6.3f deg merged  %s\n", name, lockstep, hold, merge, ok ? "" : "FAILED");
+
+    free(out);
+    free(truth);
+    free(held);
+    free(samples);
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+// push plus process per gyro step, against the same filter stepping with imu_process_batch()
+static int check_cost(const imu_sim_t * sim)
+{
+    size_t n = imu_sim_count(sim);
+    imu_sample_t * samples = malloc(n * sizeof(imu_sample_t));
+    imu_quaternion_t * truth = malloc(n * sizeof(imu_quaternion_t));
+    imu_quaternion_t * out = malloc(n * sizeof(imu_quaternion_t));
+    imu_sim_generate(sim, samples, truth);
+
+    double lockstep = 0.0, merge = 0.0;
+    for(int r = 0; r < 5; r++)
+    {
+        imu_t imu = filter(sim, 0);
+        double t0 = get_time_sec();
+        imu_process_batch(&imu, samples, n, out);
+        double ns = 1e9 * (get_time_sec() - t0) / n;
+        lockstep = r == 0 || ns < lockstep ? ns : lockstep;
+
+        size_t dropped;
+        imu = filter(sim, 0);
+        t0 = get_time_sec();
+        merged(&imu, samples, n, out, 0, &dropped);
+        ns = 1e9 * (get_time_sec() - t0) / n;
+        merge = r == 0 || ns < merge ? ns : merge;
+    }
+    printf("  complementary          %6.1f ns/step lockstep, %6.1f ns/step merged\n", lockstep, merge);
+
+    free(out);
+    free(truth);
+    free(samples);
+    return 1;
+}
+
+
+////////////////////////////////////////////
+
+
+// samples out of order, full rings, a stalled sensor and a late sample
+static int check_drops()
+{
+    imu_sim_t sim = sensor(IMU_SIM_STATIC, 0.0, 0.0, 1.0);
+    imu_t imu = filter(&sim, 0);
+    imu_merge_t m = imu_merge_init();
+    imu_quaternion_t out[OUT_MAX];
+    int ok = 1;
+
+    // accelerometer pushes once, then stalls. the gyro is held back until its ring is half full.
+    ok &= imu_merge_push_accelerometer(&m, 0.0, 0, 0, 1) == 0;
+    for(int i = 1; i <= 40; i++)
+    {
+        ok &= imu_merge_push_gyro(&m, i / RATE, 0, 0, 0) == 0;
+    }
+    size_t steps = imu_merge_process(&m, &imu, out, OUT_MAX);
+    ok &= steps == 40 - IMU_MERGE_CAPACITY / 2 + 1;
+
+    // older than the last gyro sample, and older than what the filter has seen
+    ok &= imu_merge_push_gyro(&m, 20.5 / RATE, 0, 0, 0) == -1;
+    ok &= imu_merge_push_accelerometer(&m, 1.0 / RATE, 0, 0, 1) == -1;
+    ok &= m.dropped == 2;
+
+    // fills the gyro ring up
+    int refused = 0;
+    for(int i = 41; i <= 41 + IMU_MERGE_CAPACITY; i++)
+    {
+        refused += imu_merge_push_gyro(&m, i / RATE, 0, 0, 0) == -1;
+    }
+    ok &= refused == IMU_MERGE_CAPACITY / 2 && m.dropped == 2 + (size_t)refused;
+
+    steps += imu_merge_process(&m, &imu, out, OUT_MAX);
+    steps += imu_merge_flush(&m, &imu, out, OUT_MAX);
+    ok &= steps == 40 + IMU_MERGE_CAPACITY - (size_t)refused + 1;
+
+    printf("  %zu gyro steps, %zu samples dropped  %s\n", steps, m.dropped, ok ? "" : "FAILED");
+    return ok;
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    int ok = 1;
+
+    imu_sim_t tilts = sensor(IMU_SIM_TILT, 60.0, 0.2, 30.0);
+    imu_sim_t spin = sensor(IMU_SIM_SPIN, 90.0, 0.0, 30.0);
+    imu_sim_t tumble = sensor(IMU_SIM_TUMBLE, 100.0, 0.3, 30.0);
+
+    printf("gyro at %.0f Hz, accelerometer at %.0f Hz, merged from separate fifos\n", RATE, RATE / ACCL_DIVIDER);
+    ok &= check_order(&tumble, 0, "complementary");
+    ok &= check_order(&tumble, IMU_ESTIMODE_MADGWICK, "madgwick");
+    ok &= check_order(&tumble, IMU_ESTIMODE_MAHONY, "mahony");
+    ok &= check_order(&tumble, IMU_ESTIMODE_EKF, "ekf");
+
+    printf("accuracy, sinusoidal tilts, first 5 s left out\n");
+    ok &= check_accuracy(&tilts, 0, "complementary");
+    ok &= check_accuracy(&tilts, IMU_ESTIMODE_MADGWICK, "madgwick");
+    ok &= check_accuracy(&tilts, IMU_ESTIMODE_MAHONY, "mahony");
+    ok &= check_accuracy(&tilts, IMU_ESTIMODE_EKF, "ekf");
+    printf("accuracy, constant spin, first 5 s left out\n");
+    ok &= check_accuracy(&spin, 0, "complementary");
+    ok &= check_accuracy(&spin, IMU_ESTIMODE_MADGWICK, "madgwick");
+    ok &= check_accuracy(&spin, IMU_ESTIMODE_MAHONY, "mahony");
+    ok &= check_accuracy(&spin, IMU_ESTIMODE_EKF, "ekf");
+
+    printf("cost\n");
+    ok &= check_cost(&tilts);
+
+    printf("drops\n");
+    ok &= check_drops();
+
+    printf("  %s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
@@ -0,0 +1,376 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_dispatch.h"
+#include "libimu/imu_math.h"
+#include "bench_harness.h"
+
+// inputs per round, large enough that results can't be hoisted out of the loop
+#define COUNT           1024
+
+
+////////////////////////////////////////////
+
+
+static imu_vec3_t v1[COUNT], v2[COUNT], vout[COUNT];
+static imu_quaternion_t q1[COUNT], q2[COUNT], qout[COUNT];
+static imu_euler_t eout[COUNT];
+static imu_mat3_t mout[COUNT];
+static imu_mat4_t m4out[COUNT];
+static imu_real_t r1[COUNT], rout[COUNT];
+static imu_t filter_imu, filter_imu_fast, filter_imu_madgwick, filter_imu_mahony, filter_imu_ekf, filter_imu_decimated;
+static imu_t filter_imu_quaternion, filter_imu_all_outputs;
+
+
+////////////////////////////////////////////
+
+
+// the outputs are never read otherwise. the empty asm makes them escape, so an inlined body
+// is neither dropped nor computed once for all rounds.
+#define OP_BARRIER() \
+    __asm__ volatile("" : : "r"(vout), "r"(qout), "r"(eout), "r"(mout), "r"(m4out), "r"(rout) : "memory")
+
+#define OP_LOOP(body) \
+    for(size_t r = 0; r < rounds; r++) \
+    { \
+        for(size_t i = 0; i < COUNT; i++) \
+        { \
+            body; \
+        } \
+        OP_BARRIER(); \
+    }
+
+static void op_vec3_create(size_t rounds) { OP_LOOP(vout[i] = imu_vec3_create(r1[i], r1[i], r1[i])) }
+static void op_vec3_sum(size_t rounds) { OP_LOOP(vout[i] = imu_vec3_sum(&v1[i], &v2[i])) }
+static void op_vec3_dif(size_t rounds) { OP_LOOP(vout[i] = imu_vec3_dif(&v1[i], &v2[i])) }
+static void op_vec3_divide(size_t rounds) { OP_LOOP(vout[i] = imu_vec3_divide(&v1[i], &v2[i])) }
+static void op_vec3_normalize(size_t rounds) { OP_LOOP(vout[i] = imu_vec3_normalize(&v1[i])) }
+static void op_vec3_scale(size_t rounds) { OP_LOOP(vout[i] = imu_vec3_scale(&v1[i], r1[i])) }
+static void op_vec3_length(size_t rounds) { OP_LOOP(rout[i] = imu_vec3_length(&v1[i])) }
+static void op_vec3_dot(size_t rounds) { OP_LOOP(rout[i] = imu_vec3_dot(&v1[i], &v2[i])) }
+static void op_vec3_cross(size_t rounds) { OP_LOOP(vout[i] = imu_vec3_cross(&v1[i], &v2[i])) }
+static void op_quaternion_create(size_t rounds) { OP_LOOP(qout[i] = imu_quaternion_create(r1[i], r1[i], r1[i], r1[i])) }
+static void op_quaternion_sum(size_t rounds) { OP_LOOP(qout[i] = imu_quaternion_sum(&q1[i], &q2[i])) }
+static void op_quaternion_product(size_t rounds) { OP_LOOP(qout[i] = imu_quaternion_product(&q1[i], &q2[i])) }
+static void op_quaternion_conjugate(size_t rounds) { OP_LOOP(qout[i] = imu_quaternion_conjugate(&q1[i])) }
+static void op_quaternion_inverse(size_t rounds) { OP_LOOP(qout[i] = imu_quaternion_inverse(&q1[i])) }
+static void op_quaternion_normalize(size_t rounds) { OP_LOOP(qout[i] = imu_quaternion_normalize(&q1[i])) }
+static void op_quaternion_scale(size_t rounds) { OP_LOOP(qout[i] = imu_quaternion_scale(&q1[i], r1[i])) }
+static void op_quaternion_length(size_t rounds) { OP_LOOP(rout[i] = imu_quaternion_length(&q1[i])) }
+static void op_quaternion_rotate_vector(size_t rounds) { OP_LOOP(vout[i] = imu_quaternion_rotate_vector(&q1[i], &v1[i])) }
+static void op_quaternion_rotate_vector_quaternion(size_t rounds) { OP_LOOP(qout[i] = imu_quaternion_rotate_vector_quaternion(&q1[i], &q2[i])) }
+static void op_quaternion_rotate_vector_unit(size_t rounds) { OP_LOOP(vout[i] = imu_quaternion_rotate_vector_unit(&q1[i], &v1[i])) }
+static void op_quaternion_to_euler(size_t rounds) { OP_LOOP(eout[i] = imu_quaternion_to_euler(&q1[i])) }
+static void op_quaternion_to_matrix3(size_t rounds) { OP_LOOP(mout[i] = imu_quaternion_to_matrix3(&q1[i])) }
+static void op_quaternion_to_matrix4(size_t rounds) { OP_LOOP(m4out[i] = imu_quaternion_to_matrix4(&q1[i])) }
+static void op_math_fast_inv_sqrt(size_t rounds) { OP_LOOP(rout[i] = imu_math_fast_inv_sqrt(r1[i])) }
+static void op_math_fast_sin(size_t rounds) { OP_LOOP(rout[i] = imu_math_fast_sin(r1[i])) }
+static void op_math_fast_cos(size_t rounds) { OP_LOOP(rout[i] = imu_math_fast_cos(r1[i])) }
+static void op_math_fast_acos(size_t rounds) { OP_LOOP(rout[i] = imu_math_fast_acos(r1[i])) }
+static void op_math_sin(size_t rounds) { OP_LOOP(rout[i] = imu_sin(r1[i])) }
+static void op_math_cos(size_t rounds) { OP_LOOP(rout[i] = imu_cos(r1[i])) }
+static void op_math_acos(size_t rounds) { OP_LOOP(rout[i] = imu_acos(r1[i])) }
+static void op_math_map_value(size_t rounds) { OP_LOOP(rout[i] = imu_math_map_value(r1[i], IMU_R(-1), IMU_R(1), IMU_R(0), IMU_R(100))) }
+
+
+////////////////////////////////////////////
+
+
+static void op_quaternion_rotate_vectors_unit(size_t rounds)
+{
+    for(size_t r = 0; r < rounds; r++)
+    {
+        imu_quaternion_rotate_vectors_unit(&q1[r % COUNT], v1, vout, COUNT);
+    }
+}
+
+
+static void op_quaternion_to_matrices4(size_t rounds)
+{
+    for(size_t r = 0; r < rounds; r++)
+    {
+        imu_quaternion_to_matrices4(q1, m4out, COUNT);
+    }
+}
+
+
+static void op_quaternion_rotate_vectors_unit_each(size_t rounds)
+{
+    for(size_t r = 0; r < rounds; r++)
+    {
+        imu_quaternion_rotate_vectors_unit_each(q1, v1, vout, COUNT);
+    }
+}
+
+
+// one calibrated filter step per op, fixed output data rate so the clock isn't read
+static void op_main_loop(size_t rounds)
+{
+    OP_LOOP(
+        imu_set_accelerometer_raw(&filter_imu, v1[i].x, v1[i].y, v1[i].z);
+        imu_set_gyro_raw(&filter_imu, v2[i].x, v2[i].y, v2[i].z);
+        imu_main_loop(&filter_imu))
+}
+
+
+static void op_main_loop_fast_math(size_t rounds)
+{
+    OP_LOOP(
+        imu_set_accelerometer_raw(&filter_imu_fast, v1[i].x, v1[i].y, v1[i].z);
+        imu_set_gyro_raw(&filter_imu_fast, v2[i].x, v2[i].y, v2[i].z);
+        imu_main_loop(&filter_imu_fast))
+}
+
+
+// quaternion only, no euler angles
+static void op_main_loop_quaternion(size_t rounds)
+{
+    OP_LOOP(
+        imu_set_accelerometer_raw(&filter_imu_quaternion, v1[i].x, v1[i].y, v1[i].z);
+        imu_set_gyro_raw(&filter_imu_quaternion, v2[i].x, v2[i].y, v2[i].z);
+        imu_main_loop(&filter_imu_quaternion))
+}
+
+
+static void op_main_loop_all_outputs(size_t rounds)
+{
+    OP_LOOP(
+        imu_set_accelerometer_raw(&filter_imu_all_outputs, v1[i].x, v1[i].y, v1[i].z);
+        imu_set_gyro_raw(&filter_imu_all_outputs, v2[i].x, v2[i].y, v2[i].z);
+        imu_main_loop(&filter_imu_all_outputs))
+}
+
+
+static void op_main_loop_decimated(size_t rounds)
+{
+    OP_LOOP(
+        imu_set_accelerometer_raw(&filter_imu_decimated, v1[i].x, v1[i].y, v1[i].z);
+        imu_set_gyro_raw(&filter_imu_decimated, v2[i].x, v2[i].y, v2[i].z);
+        imu_main_loop(&filter_imu_decimated))
+}
+
+
+static void op_main_loop_madgwick(size_t rounds)
+{
+    OP_LOOP(
+        imu_set_accelerometer_raw(&filter_imu_madgwick, v1[i].x, v1[i].y, v1[i].z);
+        imu_set_gyro_raw(&filter_imu_madgwick, v2[i].x, v2[i].y, v2[i].z);
+        imu_main_loop(&filter_imu_madgwick))
+}
+
+
+static void op_main_loop_mahony(size_t rounds)
+{
+    OP_LOOP(
+        imu_set_accelerometer_raw(&filter_imu_mahony, v1[i].x, v1[i].y, v1[i].z);
+        imu_set_gyro_raw(&filter_imu_mahony, v2[i].x, v2[i].y, v2[i].z);
+        imu_main_loop(&filter_imu_mahony))
+}
+
+
+static void op_main_loop_ekf(size_t rounds)
+{
+    OP_LOOP(
+        imu_set_accelerometer_raw(&filter_imu_ekf, v1[i].x, v1[i].y, v1[i].z);
+        imu_set_gyro_raw(&filter_imu_ekf, v2[i].x, v2[i].y, v2[i].z);
+        imu_main_loop(&filter_imu_ekf))
+}
+
+
+////////////////////////////////////////////
+
+
+#define OP(name) {#name, op_##name, COUNT}
+
+static const bench_op_t ops[] = {
+    OP(vec3_create), OP(vec3_sum), OP(vec3_dif), OP(vec3_divide), OP(vec3_normalize), OP(vec3_scale),
+    OP(vec3_length), OP(vec3_dot), OP(vec3_cross),
+    OP(quaternion_create), OP(quaternion_sum), OP(quaternion_product), OP(quaternion_conjugate),
+    OP(quaternion_inverse), OP(quaternion_normalize), OP(quaternion_scale), OP(quaternion_length),
+    OP(quaternion_rotate_vector), OP(quaternion_rotate_vector_quaternion), OP(quaternion_rotate_vector_unit),
+    OP(quaternion_rotate_vectors_unit), OP(quaternion_rotate_vectors_unit_each), OP(quaternion_to_euler),
+    OP(quaternion_to_matrix3), OP(quaternion_to_matrix4), OP(quaternion_to_matrices4),
+    OP(math_fast_inv_sqrt), OP(math_fast_sin), OP(math_fast_cos), OP(math_fast_acos),
+    OP(math_sin), OP(math_cos), OP(math_acos), OP(math_map_value),
+    OP(main_loop), OP(main_loop_quaternion), OP(main_loop_all_outputs), OP(main_loop_fast_math), OP(main_loop_decimated), OP(main_loop_madgwick), OP(main_loop_mahony), OP(main_loop_ekf),
+};
+
+
+////////////////////////////////////////////
+
+
+static float frand(float lo, float hi)
+{
+    return lo + (hi - lo) * (float)rand() / (float)RAND_MAX;
+}
+
+
+static void setup()
+{
+    srand(15);
+    for(int i = 0; i < COUNT; i++)
+    {
+        v1[i] = imu_vec3_create(frand(-1.f, 1.f), frand(-1.f, 1.f), frand(0.5f, 1.f));
+        v2[i] = imu_vec3_create(frand(0.5f, 1.f), frand(0.5f, 1.f), frand(0.5f, 1.f));
+        imu_quaternion_t a = imu_quaternion_create(frand(-1.f, 1.f), frand(-1.f, 1.f), frand(-1.f, 1.f), frand(-1.f, 1.f));
+        imu_quaternion_t b = imu_quaternion_create(frand(-1.f, 1.f), frand(-1.f, 1.f), frand(-1.f, 1.f), frand(-1.f, 1.f));
+        q1[i] = imu_quaternion_normalize(&a);
+        q2[i] = imu_quaternion_normalize(&b);
+        r1[i] = frand(0.1f, 1.f);
+    }
+
+    // past calibration, so every op is a full filter step. raw values are noise around gravity.
+    filter_imu = imu_init(IMU_CALIBMODE_NEVER, 2.f / 16384.f, 2.f / 131.f);
+    imu_set_state(&filter_imu, IMU_STATE_READY);
+    imu_set_output_data_rate(&filter_imu, 1000);
+    for(int i = 0; i < COUNT; i++)
+    {
+        v1[i] = imu_vec3_scale(&v1[i], IMU_R(200));
+        v1[i].z += IMU_R(8192);
+        v2[i] = imu_vec3_scale(&v2[i], IMU_R(100));
+    }
+    filter_imu_fast = filter_imu;
+    imu_set_fast_math(&filter_imu_fast, 1);
+    filter_imu_quaternion = filter_imu_all_outputs = filter_imu;
+    imu_set_outputs(&filter_imu_quaternion, IMU_OUTPUT_QUATERNION);
+    imu_set_outputs(&filter_imu_all_outputs, IMU_OUTPUT_EULER | IMU_OUTPUT_MATRIX | IMU_OUTPUT_GRAVITY | IMU_OUTPUT_LINEAR);
+    filter_imu_decimated = filter_imu;
+    imu_set_correction_divider(&filter_imu_decimated, 8);
+    filter_imu_madgwick = filter_imu_mahony = filter_imu_ekf = filter_imu;
+    imu_set_estimation_mode(&filter_imu_madgwick, IMU_ESTIMODE_GYRO | IMU_ESTIMODE_ACCELEROMETER | IMU_ESTIMODE_MADGWICK);
+    imu_set_estimation_mode(&filter_imu_mahony, IMU_ESTIMODE_GYRO | IMU_ESTIMODE_ACCELEROMETER | IMU_ESTIMODE_MAHONY);
+    imu_set_estimation_mode(&filter_imu_ekf, IMU_ESTIMODE_GYRO | IMU_ESTIMODE_ACCELEROMETER | IMU_ESTIMODE_EKF);
+}
+
+
+////////////////////////////////////////////
+
+
+static int write_json(const char * path, const bench_result_t * res, size_t n, int cpu, int repetitions)
+{
+    FILE * f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if(!f)
+    {
+        printf("cannot write %s\n", path);
+        return 0;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"suite\": \"libimu micro\",\n");
+    fprintf(f, "  \"timestamp\": %lld,\n", (long long)time(NULL));
+    fprintf(f, "  \"compiler\": \"%s\",\n", __VERSION__);
+    fprintf(f, "  \"precision\": \"%s\",\n", sizeof(imu_real_t) == sizeof(double) ? "double" : "float");
+    fprintf(f, "  \"isa\": \"%s\",\n", imu_dispatch_isa_name(imu_dispatch_get_isa()));
+    fprintf(f, "  \"cpu\": %d,\n", cpu);
+    fprintf(f, "  \"repetitions\": %d,\n", repetitions);
+    fprintf(f, "  \"results\": [\n");
+    for(size_t i = 0; i < n; i++)
+    {
+        fprintf(f, "    {\"name\": \"%s\", \"ns_per_op\": {\"min\": %.4f, \"median\": %.4f, \"mean\": %.4f, \"stddev\": %.4f}, \"ops_per_sec\": %.0f",
+            res[i].name, res[i].min, res[i].median, res[i].mean, res[i].stddev, 1e9 / res[i].median);
+        if(res[i].cycles >= 0)
+        {
+            fprintf(f, ", \"cycles_per_op\": %.3f, \"instructions_per_op\": %.3f", res[i].cycles, res[i].instructions);
+        }
+        fprintf(f, "}%s\n", i + 1 < n ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    if(f != stdout)
+    {
+        fclose(f);
+    }
+    return 1;
+}
+
+
+////////////////////////////////////////////
+
+
+static void usage(const char * name)
+{
+    printf("usage: %s [-j file] [-c cpu] [-r repetitions] [-p] [filter]\n", name);
+    printf("  -j file   write results as json, - for stdout\n");
+    printf("  -c cpu    pin to this cpu, default is the one it starts on\n");
+    printf("  -r n      timed repetitions per op (default %d)\n", BENCH_REPETITIONS);
+    printf("  -p        cycles and instructions from perf_event\n");
+    printf("  filter    only ops whose name contains this\n");
+}
+
+
+////////////////////////////////////////////
+
+
+int main(int argc, char *argv[])
+{
+    const char * json = NULL;
+    int cpu = sched_getcpu(), repetitions = BENCH_REPETITIONS, perf = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, "j:c:r:ph")) != -1)
+    {
+        switch(opt)
+        {
+        case 'j': json = optarg; break;
+        case 'c': cpu = atoi(optarg); break;
+        case 'r': repetitions = atoi(optarg); break;
+        case 'p': perf = 1; break;
+        default: usage(argv[0]); return opt != 'h';
+        }
+    }
+    const char * filter = optind < argc ? argv[optind] : "";
+    repetitions = repetitions < 1 ? 1 : repetitions > BENCH_REPETITIONS * 4 ? BENCH_REPETITIONS * 4 : repetitions;
+    cpu = bench_pin(cpu);
+
+    if(perf)
+    {
+        int i, c = bench_perf_init(&i);
+        if(c < 0)
+        {
+            printf("perf_event not available (see /proc/sys/kernel/perf_event_paranoid), timing only\n");
+            perf = 0;
+        }
+        else
+        {
+            close(i);
+            close(c);
+        }
+    }
+
+    setup();
+
+    size_t count = sizeof(ops) / sizeof(ops[0]), n = 0;
+    bench_result_t res[sizeof(ops) / sizeof(ops[0])];
+    int ok = 1;
+
+    printf("micro benchmarks, %s %s, cpu %d, median of %d\n", sizeof(imu_real_t) == sizeof(double) ? "double" : "float",
+        imu_dispatch_isa_name(imu_dispatch_get_isa()), cpu, repetitions);
+    for(size_t i = 0; i < count; i++)
+    {
+        if(!strstr(ops[i].name, filter))
+        {
+            continue;
+        }
+
+        bench_result_t r = bench_measure(&ops[i], repetitions, perf);
+        ok &= isfinite(r.median) && r.median > 0.0;
+        res[n++] = r;
+
+        bench_print(&r);
+        printf("\n");
+    }
+
+    if(json)
+    {
+        ok &= write_json(json, res, n, cpu, repetitions);
+    }
+
+    printf("  %s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
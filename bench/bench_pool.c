@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_pool.h"
+
+#define IMUS            64
+#define TICKS           4000
+#define RATE            1000.0
+
+#define SCALE_ACCL      (2.f / 16384.f)
+#define SCALE_GYRO      (2.f / 131.f)
+
+
+////////////////////////////////////////////
+
+
+static float frand()
+{
+    return (float)rand() / RAND_MAX * 2.f - 1.f;
+}
+
+
+////////////////////////////////////////////
+
+
+// samples[tick * IMUS + i]. every imu has its own gyro bias and tilt, calibration is included.
+static void generate(imu_sample_t * samples)
+{
+    srand(7);
+    for(size_t i = 0; i < IMUS; i++)
+    {
+        float bias = 20.f * frand();
+        float tilt = 0.3f * frand();
+        for(size_t t = 0; t < TICKS; t++)
+        {
+            imu_sample_t * s = &samples[t * IMUS + i];
+            s->ax = roundf(16384.f * sinf(tilt) + 40.f * frand());
+            s->ay = roundf(40.f * frand());
+            s->az = roundf(16384.f * cosf(tilt) + 40.f * frand());
+            s->gx = roundf(bias + 3.f * frand());
+            s->gy = roundf(-bias + 3.f * frand() + (t > TICKS / 2 ? 500.f : 0.f));
+            s->gz = roundf(3.f * frand());
+            s->ts = t / RATE;
+        }
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+static void reset(imu_t * imus)
+{
+    for(size_t i = 0; i < IMUS; i++)
+    {
+        imus[i] = imu_init(IMU_CALIBMODE_ONCE, SCALE_ACCL, SCALE_GYRO);
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+static int same(const imu_t * a, const imu_t * b)
+{
+    for(size_t i = 0; i < IMUS; i++)
+    {
+        if(memcmp(&a[i].orientation_quat, &b[i].orientation_quat, sizeof(imu_quaternion_t)) != 0 ||
+            memcmp(&a[i].gyro_offset, &b[i].gyro_offset, sizeof(imu_vec3_t)) != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    imu_sample_t * samples = malloc(TICKS * IMUS * sizeof(imu_sample_t));
+    imu_sample_t * column = malloc(TICKS * sizeof(imu_sample_t));
+    imu_t ref[IMUS], imus[IMUS];
+    int failed = 0;
+
+    generate(samples);
+
+    // reference: one imu after the other, so no two instances ever calibrate at the same time
+    reset(ref);
+    for(size_t i = 0; i < IMUS; i++)
+    {
+        for(size_t t = 0; t < TICKS; t++)
+        {
+            column[t] = samples[t * IMUS + i];
+        }
+        imu_process_batch(&ref[i], column, TICKS, NULL);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t counts[] = {1, 2, 4, 8, (size_t)cpus};
+
+    printf("imu_pool: %d imus, %d ticks, %ld cpus online\n", IMUS, TICKS, cpus);
+
+    for(size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        reset(imus);
+        imu_pool_t pool = imu_pool_init(imus, IMUS, counts[c]);
+        if(pool.threads == 0)
+        {
+            failed = 1;
+            continue;
+        }
+
+        double t0 = get_time_sec();
+        for(size_t t = 0; t < TICKS; t++)
+        {
+            failed |= imu_pool_step(&pool, &samples[t * IMUS]) != 0;
+        }
+        double dt = get_time_sec() - t0;
+        imu_pool_free(&pool);
+
+        int ok = same(ref, imus);
+        failed |= !ok;
+        printf("  %2zu threads  %9.0f ticks/s  %7.2f us/tick  %s\n",
+            counts[c], TICKS / dt, 1e6 * dt / TICKS, ok ? "matches sequential" : "DIFFERS FROM SEQUENTIAL");
+    }
+
+    // a freed pool has no workers left, stepping it reports an error instead of touching them
+    imu_pool_t pool = imu_pool_init(imus, IMUS, 2);
+    imu_pool_free(&pool);
+    int stepped = imu_pool_step(&pool, samples) == 0;
+    failed |= stepped;
+    printf("  freed pool  %s\n", stepped ? "STEPPED" : "refused to step");
+
+    free(column);
+    free(samples);
+    return failed;
+}
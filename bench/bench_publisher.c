@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_publisher.h"
+
+#define WRITER_RATE     8000
+#define DURATION        0.5
+
+
+////////////////////////////////////////////
+
+
+typedef struct bench
+{
+    // 0: seqlock publisher, 1: mutex around a plain copy like src/demo.c
+    int mutex;
+
+    imu_publisher_t pub;
+    pthread_mutex_t mtx;
+    imu_snapshot_t locked;
+
+    volatile int stop;
+
+    // writer results
+    size_t published;
+    double max_publish;
+    double max_late;
+} bench_t;
+
+
+typedef struct reader
+{
+    bench_t * b;
+    pthread_t thread;
+    size_t reads;
+    size_t torn;
+} reader_t;
+
+
+////////////////////////////////////////////
+
+
+// writer fills every field from one counter, so a torn snapshot shows up as a mismatch
+static void fill(imu_t * imu, uint32_t k)
+{
+    imu_real_t v = (imu_real_t)k;
+    imu->orientation_quat = imu_quaternion_create(v, v, v, v);
+    imu->orientation.roll = imu->orientation.pitch = imu->orientation.yaw = v;
+    imu->_gyro_ts = k;
+    imu->state = IMU_STATE_READY;
+}
+
+
+static int consistent(const imu_snapshot_t * s)
+{
+    imu_real_t v = (imu_real_t)s->ts;
+    return s->orientation_quat.w == v && s->orientation_quat.x == v && s->orientation_quat.y == v && s->orientation_quat.z == v &&
+        s->orientation.roll == v && s->orientation.pitch == v && s->orientation.yaw == v;
+}
+
+
+////////////////////////////////////////////
+
+
+static void * reader_main(void * arg)
+{
+    reader_t * r = arg;
+    bench_t * b = r->b;
+
+    while(!b->stop)
+    {
+        imu_snapshot_t s;
+        if(b->mutex)
+        {
+            pthread_mutex_lock(&b->mtx);
+            s = b->locked;
+            pthread_mutex_unlock(&b->mtx);
+        }
+        else
+        {
+            s = imu_publisher_read(&b->pub);
+        }
+
+        r->torn += !consistent(&s);
+        r->reads++;
+    }
+
+    return NULL;
+}
+
+
+////////////////////////////////////////////
+
+
+static void writer(bench_t * b)
+{
+    imu_t imu = imu_init(IMU_CALIBMODE_ONCE, 1.f, 1.f);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    double start = get_time_sec();
+    size_t ticks = (size_t)(WRITER_RATE * DURATION);
+
+    for(size_t k = 1; k <= ticks; k++)
+    {
+        next.tv_nsec += 1000000000L / WRITER_RATE;
+        if(next.tv_nsec >= 1000000000L)
+        {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        double t0 = get_time_sec();
+        b->max_late = fmax(b->max_late, t0 - (start + (double)k / WRITER_RATE));
+
+        fill(&imu, (uint32_t)k);
+        if(b->mutex)
+        {
+            pthread_mutex_lock(&b->mtx);
+            b->locked.orientation_quat = imu.orientation_quat;
+            b->locked.orientation = imu.orientation;
+            b->locked.ts = imu._gyro_ts;
+            b->locked.state = imu.state;
+            pthread_mutex_unlock(&b->mtx);
+        }
+        else
+        {
+            imu_publish(&b->pub, &imu);
+        }
+
+        b->max_publish = fmax(b->max_publish, get_time_sec() - t0);
+        b->published++;
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+static int run(int mutex, size_t readers)
+{
+    bench_t * b = aligned_alloc(64, (sizeof(bench_t) + 63) / 64 * 64);
+    memset(b, 0, sizeof(*b));
+    b->mutex = mutex;
+    b->pub = imu_publisher_init();
+    pthread_mutex_init(&b->mtx, NULL);
+
+    // starts consistent for the mutex readers as well
+    imu_t imu;
+    fill(&imu, 0);
+    imu_publish(&b->pub, &imu);
+    b->locked = imu_publisher_read(&b->pub);
+
+    reader_t * r = calloc(readers, sizeof(reader_t));
+    for(size_t i = 0; i < readers; i++)
+    {
+        r[i].b = b;
+        pthread_create(&r[i].thread, NULL, reader_main, &r[i]);
+    }
+
+    writer(b);
+    b->stop = 1;
+
+    size_t reads = 0, torn = 0;
+    for(size_t i = 0; i < readers; i++)
+    {
+        pthread_join(r[i].thread, NULL);
+        reads += r[i].reads;
+        torn += r[i].torn;
+    }
+
+    printf("  %-8s %2zu readers  %10.0f reads/s per reader  writer %5zu updates, slowest %7.2f us, latest wakeup %8.2f us  torn %zu\n",
+        mutex ? "mutex" : "seqlock", readers, reads / DURATION / readers, b->published, 1e6 * b->max_publish, 1e6 * b->max_late, torn);
+
+    free(r);
+    pthread_mutex_destroy(&b->mtx);
+    free(b);
+    return torn == 0;
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    const size_t readers[] = {1, 4, 8};
+    int ok = 1;
+
+    printf("snapshot contention, writer at %d Hz for %.1f s\n", WRITER_RATE, DURATION);
+    for(size_t i = 0; i < sizeof(readers) / sizeof(readers[0]); i++)
+    {
+        ok &= run(0, readers[i]);
+        ok &= run(1, readers[i]);
+    }
+
+    printf("  %s\n", ok ? "ok" : "TORN SNAPSHOTS");
+    return !ok;
+}
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "libimu/imu.h"
+
+#define RATE            500.0
+#define DURATION        120.0
+#define SAMPLES         ((size_t)(RATE * DURATION))
+
+#define SCALE_ACCL      (2.f / 16384.f)
+#define SCALE_GYRO      (2.f / 131.f)
+
+// periodic calibration must at least halve the heading error of a single calibration
+#define DRIFT_RATIO     0.5
+
+
+////////////////////////////////////////////
+
+
+static float frand()
+{
+    return (float)rand() / RAND_MAX * 2.f - 1.f;
+}
+
+
+////////////////////////////////////////////
+
+
+// yaw rate (deg/s) of the body: still, except for 10 s turns starting every 30 s
+static double yaw_rate(double t)
+{
+    return fmod(t, 30.0) >= 20.0 ? 30.0 : 0.0;
+}
+
+
+////////////////////////////////////////////
+
+
+// gyro bias (counts) drifting over the run, like a sensor warming up
+static void bias(double t, double * bx, double * by, double * bz)
+{
+    double k = t / DURATION;
+    *bx = 20.0 + 30.0 * k;
+    *by = -15.0 + 20.0 * k;
+    *bz = 5.0 - 25.0 * k;
+}
+
+
+////////////////////////////////////////////
+
+
+typedef struct result
+{
+    // samples after the first calibration that didn't run the filter
+    size_t stalled;
+
+    // offset commits that happened while the body was turning
+    size_t moving_commits;
+
+    size_t commits;
+
+    // yaw error against ground truth at the end (deg)
+    double yaw_error;
+
+} result_t;
+
+
+////////////////////////////////////////////
+
+
+static result_t run(int8_t mode)
+{
+    imu_t imu = imu_init(mode, SCALE_ACCL, SCALE_GYRO);
+    result_t r = {0, 0, 0, 0.0};
+    double yaw = 0.0;
+    double last_turn = -1.0;
+
+    srand(3);
+    for(size_t i = 0; i < SAMPLES; i++)
+    {
+        double t = i / RATE;
+        double w = yaw_rate(t), bx, by, bz;
+        bias(t, &bx, &by, &bz);
+        if(i > 0)
+        {
+            yaw += w / RATE;
+        }
+        if(w != 0.0)
+        {
+            last_turn = t;
+        }
+
+        imu_set_accelerometer_raw(&imu, roundf(40.f * frand()), roundf(40.f * frand()), roundf(8192.f + 40.f * frand()));
+        imu_set_gyro_raw(&imu, roundf(bx + 3.f * frand()), roundf(by + 3.f * frand()), roundf(w / SCALE_GYRO + bz + 3.f * frand()));
+
+        imu_vec3_t offset = imu.gyro_offset;
+        imu_main_loop_ts(&imu, t);
+
+        if(t > 1.0 && imu.state != IMU_STATE_READY)
+        {
+            r.stalled++;
+        }
+
+        if(t > 1.0 && (offset.x != imu.gyro_offset.x || offset.y != imu.gyro_offset.y || offset.z != imu.gyro_offset.z))
+        {
+            r.commits++;
+            // the window that was just committed covers this and the 199 samples before
+            if(last_turn >= 0.0 && (t - last_turn) * RATE < 199.5)
+            {
+                r.moving_commits++;
+            }
+        }
+    }
+
+    imu_euler_t e = imu_quaternion_to_euler(&imu.orientation_quat);
+    double err = fmod(fabs(r2d(e.yaw) - yaw), 360.0);
+    r.yaw_error = err > 180.0 ? 360.0 - err : err;
+    return r;
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    result_t once = run(IMU_CALIBMODE_ONCE);
+    result_t periodic = run(IMU_CALIBMODE_PERIODIC);
+
+    printf("online calibration, %zu samples at %.0f Hz with drifting gyro bias\n", SAMPLES, RATE);
+    printf("  once      yaw error %6.2f deg  commits %2zu  stalled samples %zu\n",
+        once.yaw_error, once.commits, once.stalled);
+    printf("  periodic  yaw error %6.2f deg  commits %2zu  stalled samples %zu  commits while moving %zu\n",
+        periodic.yaw_error, periodic.commits, periodic.stalled, periodic.moving_commits);
+
+    int ok = periodic.stalled == 0 && periodic.moving_commits == 0 && periodic.commits > 0 &&
+        periodic.yaw_error <= DRIFT_RATIO * once.yaw_error;
+    printf("  %s\n", ok ? "ok" : "FAILED");
+
+    return !ok;
+}
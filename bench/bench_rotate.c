@@ -0,0 +1,154 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_dispatch.h"
+#include "bench_harness.h"
+
+#define COUNT       1024
+
+
+////////////////////////////////////////////
+
+
+static imu_quaternion_t q[COUNT];
+static imu_vec3_t v[COUNT], out[COUNT], ref[COUNT];
+
+
+////////////////////////////////////////////
+
+
+static float frand(float lo, float hi)
+{
+    return lo + (hi - lo) * (float)rand() / (float)RAND_MAX;
+}
+
+
+////////////////////////////////////////////
+
+
+static float max_diff(const imu_vec3_t * a, const imu_vec3_t * b)
+{
+    float d = 0.f;
+    for(int i = 0; i < COUNT; i++)
+    {
+        d = fmaxf(d, fmaxf(fabsf(a[i].x - b[i].x), fmaxf(fabsf(a[i].y - b[i].y), fabsf(a[i].z - b[i].z))));
+    }
+    return d;
+}
+
+
+////////////////////////////////////////////
+
+
+// makes the outputs escape, as in bench_micro.c
+#define OP_BARRIER() __asm__ volatile("" : : "r"(out), "r"(ref) : "memory")
+
+static void op_rotate_vector_quaternion(size_t rounds)
+{
+    for(size_t r = 0; r < rounds; r++)
+    {
+        for(int i = 0; i < COUNT; i++)
+        {
+            imu_quaternion_t qv = imu_quaternion_create(0.f, v[i].x, v[i].y, v[i].z);
+            imu_quaternion_t qr = imu_quaternion_rotate_vector_quaternion(&q[i], &qv);
+            ref[i] = imu_vec3_create(qr.x, qr.y, qr.z);
+        }
+        OP_BARRIER();
+    }
+}
+
+
+static void op_rotate_vector(size_t rounds)
+{
+    for(size_t r = 0; r < rounds; r++)
+    {
+        for(int i = 0; i < COUNT; i++)
+        {
+            out[i] = imu_quaternion_rotate_vector(&q[i], &v[i]);
+        }
+        OP_BARRIER();
+    }
+}
+
+
+static void op_rotate_vector_unit(size_t rounds)
+{
+    for(size_t r = 0; r < rounds; r++)
+    {
+        for(int i = 0; i < COUNT; i++)
+        {
+            out[i] = imu_quaternion_rotate_vector_unit(&q[i], &v[i]);
+        }
+        OP_BARRIER();
+    }
+}
+
+
+static void op_rotate_vectors_unit_each(size_t rounds)
+{
+    for(size_t r = 0; r < rounds; r++)
+    {
+        imu_quaternion_rotate_vectors_unit_each(q, v, out, COUNT);
+        OP_BARRIER();
+    }
+}
+
+
+static void op_rotate_vectors_unit(size_t rounds)
+{
+    for(size_t r = 0; r < rounds; r++)
+    {
+        imu_quaternion_rotate_vectors_unit(&q[r % COUNT], v, out, COUNT);
+        OP_BARRIER();
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+int main()
+{
+    srand(1);
+    for(int i = 0; i < COUNT; i++)
+    {
+        q[i] = imu_quaternion_create(frand(-1.f, 1.f), frand(-1.f, 1.f), frand(-1.f, 1.f), frand(-1.f, 1.f));
+        float len = imu_quaternion_length(&q[i]);
+        q[i] = imu_quaternion_scale(&q[i], 1.f / len);
+        v[i] = imu_vec3_create(frand(-2.f, 2.f), frand(-2.f, 2.f), frand(-2.f, 2.f));
+    }
+
+    const bench_op_t ops[] = {
+        {"imu_quaternion_rotate_vector_quaternion", op_rotate_vector_quaternion, COUNT},
+        {"imu_quaternion_rotate_vector", op_rotate_vector, COUNT},
+        {"imu_quaternion_rotate_vector_unit", op_rotate_vector_unit, COUNT},
+        {"imu_quaternion_rotate_vectors_unit_each", op_rotate_vectors_unit_each, COUNT},
+        {"imu_quaternion_rotate_vectors_unit, 1 q", op_rotate_vectors_unit, COUNT},
+    };
+
+    int cpu = bench_pin(sched_getcpu());
+    printf("rotating %d vectors, %s kernels, cpu %d, median of %d\n", COUNT, imu_dispatch_isa_name(imu_dispatch_get_isa()), cpu, BENCH_REPETITIONS);
+
+    double baseline = 0.0;
+    for(size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); k++)
+    {
+        bench_result_t r = bench_measure(&ops[k], BENCH_REPETITIONS, 0);
+        baseline = k == 0 ? r.median : baseline;
+        bench_print(&r);
+        printf("  %5.2fx\n", baseline / r.median);
+    }
+
+    // ref holds the results of the first op
+    op_rotate_vector_unit(1);
+    float derr = max_diff(out, ref);
+    op_rotate_vectors_unit_each(1);
+    derr = fmaxf(derr, max_diff(out, ref));
+
+    int ok = derr <= 1e-5f;
+    printf("  max diff vs imu_quaternion_rotate_vector_quaternion %.2e\n", derr);
+    printf("  %s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
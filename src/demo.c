@@ -38,15 +38,22 @@
 #include <GLFW/glfw3.h>
 
 #include "libimu/imu.h"
+#include "libimu/imu_publisher.h"
+#include "libimu/imu_ingest.h"
+#include "libimu/imu_log.h"
 
-#define BUFLEN 128
+#define SAMPLES_PER_POLL 64
 
 ////////////////////////////////////////////
 /// GLOBAL DECLARATIONS (var)
 
 imu_t imu;
+// latest imu output, written by the serial thread and read by the render loop without locks
+imu_publisher_t pub_imu;
+// imu world frame (z up) in opengl coordinates (y up): x -> x, y -> -z, z -> y. column major
+const GLfloat imu_to_gl[16] = {1, 0, 0, 0, 0, 0, -1, 0, 0, 1, 0, 0, 0, 0, 0, 1};
+const GLfloat gl_to_imu[16] = {1, 0, 0, 0, 0, 0, 1, 0, 0, -1, 0, 0, 0, 0, 0, 1};
 pthread_t thr_serial;
-pthread_mutex_t mtx_imu;
 
 int terminate = 0;
 // file descriptor for serial device
@@ -55,6 +62,10 @@ int fd_serial;
 const char *fname_serial = "/dev/ttyUSB0";
 // serial baud rate
 const int32_t serial_baud = B115200;
+// IMU_INGEST_FORMAT_TEXT for `ax,ay,az,gx,gy,gz[,ts]` lines, IMU_INGEST_FORMAT_BINARY for imu_frame_t frames
+const int8_t serial_format = IMU_INGEST_FORMAT_TEXT;
+// raw samples are recorded here when a path is given on the command line (see tools/imu_replay.c)
+const char *fname_record = NULL;
 // configurations to set and revert when we are done with serial port
 struct termios tiosold, tiosnew;
 
@@ -80,6 +91,9 @@ int main(int argc, char *argv[])
 
 	glutInit(&argc, argv);
 
+	if (argc > 1)
+		fname_record = argv[1];
+
 	imu = imu_init(IMU_CALIBMODE_ONCE, 2.f / 131.f, 2.f / 16384.f);
 	// following can be done using above one liner.
 	// imu_set_calibration_mode(&imu, IMU_CALIBMODE_ONCE);
@@ -87,9 +101,9 @@ int main(int argc, char *argv[])
 	// imu_set_gyro_scale_factor(&imu, 2.f / 131.f);
 	// imu_set_accelerometer_scale_factor(&imu, 2.f / 16384.f);
 
+	pub_imu = imu_publisher_init();
 	pthread_create(&thr_serial, NULL, &runner_serial, NULL);
 	pthread_detach(thr_serial);
-	pthread_mutex_init(&mtx_imu, NULL);
 
 	GLFWwindow *window = glfwCreateWindow(640, 640, "libimu", NULL, NULL);
 	glfwMakeContextCurrent(window);
@@ -147,15 +161,16 @@ int main(int argc, char *argv[])
 		draw_axes(5.0, 5.0, 5.0);
 
 		glPushMatrix();
-		pthread_mutex_lock(&mtx_imu);
-		imu_euler_t eul = imu.orientation;
-		imu_quaternion_t orn = imu.orientation_quat;
-		pthread_mutex_unlock(&mtx_imu);
+		imu_snapshot_t snap = imu_publisher_read(&pub_imu);
+		imu_euler_t eul = snap.orientation;
+		imu_quaternion_t orn = snap.orientation_quat;
 
-		// Tate-Bryant rotation sequence
-		glRotatef(r2d(eul.yaw), 0, 1, 0);
-		glRotatef(-r2d(eul.pitch), 0, 0, 1);
-		glRotatef(r2d(eul.roll), 1, 0, 0);
+		// rotation matrix of the quaternion, no euler angles and no trigonometry on the way.
+		// sandwiched between the axis swaps it turns the body in opengl coordinates.
+		imu_mat4_t model = imu_quaternion_to_matrix4(&orn);
+		glMultMatrixf(imu_to_gl);
+		glMultMatrixf(model.m);
+		glMultMatrixf(gl_to_imu);
 
 		draw_axes(1.0, 1.0, 1.0);
 		glScalef(0.2, 0.04, 0.2);
@@ -223,7 +238,7 @@ int main(int argc, char *argv[])
 		GLfloat stateindicatorl = framel + framep,
 				stateindicatort = fonth * 13 + fonth;
 		char statestr[32] = {0};
-		switch (imu.state)
+		switch (snap.state)
 		{
 		case IMU_STATE_UNCALIBRATED:
 			glColor3f(1.f, 0.f, 0.f);
@@ -381,44 +396,40 @@ void runner_serial(void *arg)
 
 	serial_port_init();
 
+	imu_ingest_t ingest = imu_ingest_init(fd_serial);
+	imu_ingest_set_format(&ingest, serial_format);
+	imu_sample_t samples[SAMPLES_PER_POLL];
+
+	imu_log_writer_t record = {.fd = -1};
+	if (fname_record)
+		record = imu_log_writer_open(fname_record, &imu);
+
 	while (!terminate)
 	{
-		char buffer[BUFLEN] = {0x00};
-		char eol = 0x0A;
-		int index = 0;
-
-		unsigned char c = 0x00;
-		for (int received = 0; !terminate && (index < BUFLEN); received = read(fd_serial, &c, 1))
+		// waits for the port instead of sleeping, so samples are processed as soon as they arrive
+		int n = imu_ingest_poll(&ingest, samples, SAMPLES_PER_POLL, 100);
+		if (n < 0)
 		{
-			if (received == 1)
-			{
-				buffer[index++] = c;
-				if (c == eol)
-					break;
-			}
-			else if (received == -1)
-			{
-				prerr("error while reading from serial port");
-				terminate = 1;
-			}
-			c = received = 0x00;
+			prerr("error while reading from serial port");
+			terminate = 1;
 		}
 
-		int ax, ay, az, gx, gy, gz;
-		double ts = 0.0;
-		if (buffer[0] != 0x0A)
+		for (int i = 0; i < n; i++)
 		{
-			sscanf(buffer, "%d,%d,%d,%d,%d,%d,%lf", &ax, &ay, &az, &gx, &gy, &gz, &ts);
-			pthread_mutex_lock(&mtx_imu);
-			imu_set_accelerometer_raw(&imu, ax, ay, az);
-			imu_set_gyro_raw(&imu, gx, gy, gz);
-			imu_main_loop(&imu);
-			pthread_mutex_unlock(&mtx_imu);
+			imu_set_accelerometer_raw(&imu, samples[i].ax, samples[i].ay, samples[i].az);
+			imu_set_gyro_raw(&imu, samples[i].gx, samples[i].gy, samples[i].gz);
+			// device timestamp (seconds) when the sensor sends one, time of arrival otherwise
+			imu_main_loop_ts(&imu, samples[i].ts);
+			imu_publish(&pub_imu, &imu);
+
+			if (record.fd >= 0 && imu_log_append(&record, &samples[i]) < 0)
+				imu_log_writer_close(&record);
 		}
-
-		usleep(1000);
 	}
 
+	if (record.fd >= 0)
+		imu_log_writer_close(&record);
+	imu_ingest_free(&ingest);
 	serial_port_cleanup();
 	prwar("thread finished");
 }
@@ -439,7 +450,8 @@ void serial_port_init()
 	bzero(&tiosnew, sizeof(tiosnew));
 
 	tiosnew.c_cflag |= serial_baud | CRTSCTS | CS8 | CLOCAL | CREAD;
-	tiosnew.c_iflag |= IGNPAR | ICRNL;
+	// binary frames must arrive byte for byte
+	tiosnew.c_iflag |= IGNPAR | (serial_format == IMU_INGEST_FORMAT_TEXT ? ICRNL : 0);
 	tiosnew.c_oflag = 0;
 	tiosnew.c_cc[VTIME] = 0;
 	tiosnew.c_cc[VMIN] = 0;
@@ -1,16 +1,16 @@
 #include "imu.h"
+#include "imu_history.h"
 
 ////////////////////////////////////////////
 
 
-static int16_t calib_counter = 0;
 static int16_t const CALIB_COUNTER_MAX = 200;
 
 
 ////////////////////////////////////////////
 
 
-imu_t imu_init(uint8_t calibration_mode, float scale_factor_accl, float scale_factor_gyro)
+imu_t imu_init(uint8_t calibration_mode, imu_real_t scale_factor_accl, imu_real_t scale_factor_gyro)
 {
     imu_t imu;
 
@@ -22,14 +22,46 @@ imu_t imu_init(uint8_t calibration_mode, float scale_factor_accl, float scale_fa
     imu.accelerometer_offset =
         imu.gyro_offset =
             imu.accelerometer =
-                imu.gyro = imu_vec3_create(0.f, 0.f, 0.f);
-
-    imu.accelerometer_raw = imu_vec3_create(0.f, 0.f, 0.f);
-    imu.gyro_raw = imu_vec3_create(0.f, 0.f, 0.f);
-
-    imu.orientation.roll = imu.orientation.pitch = imu.orientation.yaw = 0.f;
-    imu.orientation_quat = imu_quaternion_create(1.f, 0.f, 0.f, 0.f);
-    imu._gyro_ts = get_time_sec();
+                imu.gyro = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+
+    imu.accelerometer_raw = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+    imu.gyro_raw = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+    imu.magnetometer_raw = imu.magnetometer = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+    imu.magnetometer_calibration = imu_magcal_init();
+
+    imu.orientation_quat = imu_quaternion_create(IMU_R(1), IMU_R(0), IMU_R(0), IMU_R(0));
+    imu.orientation = imu_quaternion_to_euler(&imu.orientation_quat);
+    imu.orientation_matrix = imu_quaternion_to_matrix3(&imu.orientation_quat);
+    imu.orientation_gl = imu_quaternion_to_matrix4(&imu.orientation_quat);
+    imu.gravity = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(1));
+    imu.linear_acceleration = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+    imu_set_outputs(&imu, IMU_OUTPUT_QUATERNION | IMU_OUTPUT_EULER);
+    imu._history = NULL;
+    // first sample only moves the state machine, so its time delta is never used.
+    imu._gyro_ts = 0.0;
+    imu._calibration_time = 0.0;
+    imu_welford_reset(&imu._gyro_stats);
+    imu_welford_reset(&imu._accelerometer_stats);
+    imu._odr_period = 0.0;
+    imu._fast_math = 0;
+    imu._integrator = IMU_INTEGRATOR_EULER;
+    imu._correction_orientation = imu.orientation_quat;
+    imu_set_correction_divider(&imu, 1);
+    imu._accelerometer_fresh = 0;
+    imu._correction_steps = 0;
+    imu._gyro_previous[0] = imu._gyro_previous[1] = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+    imu._gyro_previous_count = 0;
+    imu_set_estimation_mode(&imu, IMU_ESTIMODE_GYRO | IMU_ESTIMODE_ACCELEROMETER);
+    imu_set_madgwick_gain(&imu, IMU_R(IMU_MADGWICK_BETA));
+    imu_set_mahony_gains(&imu, IMU_R(IMU_MAHONY_KP), IMU_R(IMU_MAHONY_KI));
+    imu._mahony_integral = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+    imu._engine_time = IMU_R(0);
+    imu._ekf = imu_ekf_init();
+    imu_set_magnetometer_calibration_mode(&imu, IMU_CALIBMODE_PERIODIC);
+    imu_set_magnetometer_gain(&imu, IMU_R(IMU_MAGNETOMETER_GAIN));
+    imu._magnetometer_ts = 0.0;
+    imu._magnetometer_fresh = 0;
+    imu._heading_aligned = 0;
 
     return imu;
 }
@@ -38,28 +70,85 @@ imu_t imu_init(uint8_t calibration_mode, float scale_factor_accl, float scale_fa
 ////////////////////////////////////////////
 
 
-static void imu_calibrate(imu_t *imu)
+// calibration window is still, if gyro and gravity direction only show noise. with
+// check_drift, gyro mean also has to stay close to the current offsets, so a slow
+// steady rotation isn't taken as bias.
+static int8_t imu_is_stationary(const imu_t * imu, int8_t check_drift)
 {
-    if(calib_counter++ < CALIB_COUNTER_MAX)
+    imu_vec3_t gvar = imu_welford_variance(&imu->_gyro_stats);
+    imu_vec3_t avar = imu_welford_variance(&imu->_accelerometer_stats);
+    const imu_vec3_t * amean = &imu->_accelerometer_stats.mean;
+
+    imu_real_t gstd = IMU_R(IMU_STATIONARY_GYRO_STDDEV) / imu->_scale_factor_gyro;
+    if(gvar.x + gvar.y + gvar.z > gstd * gstd)
     {
-        // these are not necessarily offset values, but for sake of consistency
-        // in naming I call them offset.
-        // if we need gravity vector in sensor frame coordinates we'll use these.
-        imu->accelerometer_offset.x += imu->accelerometer_raw.x;
-        imu->accelerometer_offset.y += imu->accelerometer_raw.y;
-        imu->accelerometer_offset.z += imu->accelerometer_raw.z;
+        return 0;
+    }
 
-        // we will subtract these offset values from every imu->gyro_raw in imu_main_loop()
-        imu->gyro_offset.x += imu->gyro_raw.x;
-        imu->gyro_offset.y += imu->gyro_raw.y;
-        imu->gyro_offset.z += imu->gyro_raw.z;
+    imu_real_t astd = IMU_R(IMU_STATIONARY_ACCL_STDDEV);
+    if(avar.x + avar.y + avar.z > astd * astd * imu_vec3_dot(amean, amean))
+    {
+        return 0;
     }
-    else
+
+    if(check_drift)
+    {
+        imu_vec3_t d = imu_vec3_dif(&imu->_gyro_stats.mean, &imu->gyro_offset);
+        imu_real_t gdrift = IMU_R(IMU_STATIONARY_GYRO_DRIFT) / imu->_scale_factor_gyro;
+        if(imu_vec3_dot(&d, &d) > gdrift * gdrift)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+////////////////////////////////////////////
+
+
+static void imu_calibration_add(imu_t * imu)
+{
+    imu_welford_add(&imu->_gyro_stats, &imu->gyro_raw);
+    imu_welford_add(&imu->_accelerometer_stats, &imu->accelerometer_raw);
+}
+
+
+////////////////////////////////////////////
+
+
+static void imu_calibration_commit(imu_t * imu, double ts)
+{
+    // we will subtract these offset values from every imu->gyro_raw in imu_main_loop()
+    imu->gyro_offset = imu->_gyro_stats.mean;
+
+    // these are not necessarily offset values, but for sake of consistency
+    // in naming I call them offset.
+    // if we need gravity vector in sensor frame coordinates we'll use these.
+    imu->accelerometer_offset = imu->_accelerometer_stats.mean;
+
+    imu->_calibration_time = ts;
+}
+
+
+////////////////////////////////////////////
+
+
+static void imu_calibrate(imu_t *imu, double ts)
+{
+    imu_calibration_add(imu);
+
+    if(imu->_gyro_stats.n >= CALIB_COUNTER_MAX)
     {
-        imu->accelerometer_offset = imu_vec3_scale(&imu->accelerometer_offset, 1.f / CALIB_COUNTER_MAX);
-        imu->gyro_offset = imu_vec3_scale(&imu->gyro_offset, 1.f / CALIB_COUNTER_MAX);
+        if(!imu_is_stationary(imu, 0))
+        {
+            prwar("imu moved during calibration. offsets are used anyway, orientation may drift.");
+        }
 
-        calib_counter = 0;
+        imu_calibration_commit(imu, ts);
+        imu_welford_reset(&imu->_gyro_stats);
+        imu_welford_reset(&imu->_accelerometer_stats);
         imu_set_state(imu, IMU_STATE_READY);
     }
 }
@@ -68,76 +157,637 @@ static void imu_calibrate(imu_t *imu)
 ////////////////////////////////////////////
 
 
-static void imu_complementary_filter(imu_t * imu)
+// periodic calibration next to the filter. windows run back to back once the period is over,
+// a window that moved is dropped, the first stationary one becomes the new offsets.
+static void imu_recalibrate(imu_t *imu, double ts)
 {
-    // subtracting mean noise offsets from new raw values
-    imu->gyro = imu_vec3_dif(&imu->gyro_raw, &imu->gyro_offset);
+    if(ts - imu->_calibration_time <= IMU_CALIBRATION_PERIOD)
+    {
+        return;
+    }
+
+    imu_calibration_add(imu);
+
+    if(imu->_gyro_stats.n >= CALIB_COUNTER_MAX)
+    {
+        if(imu_is_stationary(imu, 1))
+        {
+            imu_calibration_commit(imu, ts);
+        }
 
-    // scaling corrected raw data to 
+        imu_welford_reset(&imu->_gyro_stats);
+        imu_welford_reset(&imu->_accelerometer_stats);
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+// offsets subtracted and scaled, shared by every engine
+static void imu_scale_raw(imu_t * imu)
+{
+    imu->gyro = imu_vec3_dif(&imu->gyro_raw, &imu->gyro_offset);
     imu->accelerometer = imu_vec3_scale(&imu->accelerometer_raw, imu->_scale_factor_accelerometer);
     imu->gyro = imu_vec3_scale(&imu->gyro, imu->_scale_factor_gyro);
-    
-    const float alpha = 0.96f, one_minus_alpha = (1.f - alpha);
+}
+
+
+////////////////////////////////////////////
+
+
+// 1 / sqrt(n), 0 for n = 0
+static inline imu_real_t imu_inv_sqrt(const imu_t * imu, imu_real_t n)
+{
+    if(n <= 0)
+    {
+        return IMU_R(0);
+    }
+
+    return imu->_fast_math ? imu_math_fast_inv_sqrt(n) : 1 / imu_sqrt(n);
+}
+
+
+////////////////////////////////////////////
+
+
+// q * (0, w) / 2, derivative of q at body rate w (rad/s)
+static inline imu_quaternion_t imu_quaternion_rate(const imu_quaternion_t * q, imu_real_t wx, imu_real_t wy, imu_real_t wz)
+{
+    return imu_quaternion_create(
+        (-q->x * wx - q->y * wy - q->z * wz) * IMU_R(0.5),
+        ( q->w * wx + q->y * wz - q->z * wy) * IMU_R(0.5),
+        ( q->w * wy - q->x * wz + q->z * wx) * IMU_R(0.5),
+        ( q->w * wz + q->x * wy - q->y * wx) * IMU_R(0.5));
+}
+
+
+////////////////////////////////////////////
+
+
+// classic runge-kutta of dq/dt = q * (0, w(t)) / 2 from identity, w linear from w0 to w1 (rad/s).
+// 4th order in dtime for that rate, the interpolation itself is what limits it to 3rd.
+static imu_quaternion_t imu_gyro_rotation_rk4(const imu_vec3_t * w0, const imu_vec3_t * w1, imu_real_t dtime)
+{
+    const imu_real_t h = dtime * IMU_R(0.5);
+    const imu_real_t mx = (w0->x + w1->x) * IMU_R(0.5), my = (w0->y + w1->y) * IMU_R(0.5), mz = (w0->z + w1->z) * IMU_R(0.5);
+
+    imu_quaternion_t q = imu_quaternion_create(IMU_R(1), IMU_R(0), IMU_R(0), IMU_R(0));
+    imu_quaternion_t k1 = imu_quaternion_rate(&q, w0->x, w0->y, w0->z);
+    q = imu_quaternion_create(IMU_R(1) + k1.w * h, k1.x * h, k1.y * h, k1.z * h);
+    imu_quaternion_t k2 = imu_quaternion_rate(&q, mx, my, mz);
+    q = imu_quaternion_create(IMU_R(1) + k2.w * h, k2.x * h, k2.y * h, k2.z * h);
+    imu_quaternion_t k3 = imu_quaternion_rate(&q, mx, my, mz);
+    q = imu_quaternion_create(IMU_R(1) + k3.w * dtime, k3.x * dtime, k3.y * dtime, k3.z * dtime);
+    imu_quaternion_t k4 = imu_quaternion_rate(&q, w1->x, w1->y, w1->z);
+
+    const imu_real_t s = dtime / IMU_R(6);
+    imu_real_t dw = (k1.w + IMU_R(2) * (k2.w + k3.w) + k4.w) * s;
+    imu_real_t x = (k1.x + IMU_R(2) * (k2.x + k3.x) + k4.x) * s;
+    imu_real_t y = (k1.y + IMU_R(2) * (k2.y + k3.y) + k4.y) * s;
+    imu_real_t z = (k1.z + IMU_R(2) * (k2.z + k3.z) + k4.z) * s;
+
+    // |q|^2 - 1 is of the order of the method error. kept apart from the 1, where float
+    // would round it away, and renormalized to first order: 1 / sqrt(1 + e) ~ 1 - e / 2.
+    imu_real_t e = IMU_R(2) * dw + dw * dw + x * x + y * y + z * z;
+    imu_real_t r = IMU_R(1) - e * IMU_R(0.5);
+    return imu_quaternion_create((IMU_R(1) + dw) * r, x * r, y * r, z * r);
+}
+
+
+////////////////////////////////////////////
+
+
+// body rotation over the last sample period from the scaled gyro rate, see IMU_INTEGRATOR_*.
+// all but rk4 come down to one rotation vector, turned into a quaternion exactly.
+static imu_quaternion_t imu_gyro_rotation(const imu_t * imu, imu_real_t dtime)
+{
+    const imu_vec3_t * w1 = &imu->gyro;
+    const imu_vec3_t * w0 = imu->_gyro_previous_count > 0 ? &imu->_gyro_previous[0] : w1;
+    int8_t integrator = imu->_integrator;
+    if(integrator == IMU_INTEGRATOR_CONING3 && imu->_gyro_previous_count < 2)
+    {
+        integrator = IMU_INTEGRATOR_CONING;
+    }
+
+    // mean rate over the period, deg/s
+    imu_vec3_t rate;
+    switch(integrator)
+    {
+    case IMU_INTEGRATOR_MIDPOINT:
+        rate = imu_vec3_create((w0->x + w1->x) * IMU_R(0.5), (w0->y + w1->y) * IMU_R(0.5), (w0->z + w1->z) * IMU_R(0.5));
+        break;
+    case IMU_INTEGRATOR_CONING:
+    {
+        // rotation vector of a linearly changing rate: (w0 + w1) dt / 2 + (w0 x w1) dt^2 / 12.
+        // the cross term is what a single rotation misses when the axis itself turns.
+        imu_vec3_t c = imu_vec3_cross(w0, w1);
+        const imu_real_t k = d2r(dtime) / IMU_R(12);
+        rate = imu_vec3_create((w0->x + w1->x) * IMU_R(0.5) + c.x * k, (w0->y + w1->y) * IMU_R(0.5) + c.y * k,
+                               (w0->z + w1->z) * IMU_R(0.5) + c.z * k);
+        break;
+    }
+    case IMU_INTEGRATOR_CONING3:
+    {
+        // rate quadratic through w2, w0, w1 (one period apart), integrated over the last period:
+        // (8 w0 + 5 w1 - w2) dt / 12 + (11 w0 x w1 + w1 x w2 + w2 x w0) dt^2 / 120.
+        // the linear rate of the two-sample form is what limits it when the axis nutates.
+        const imu_vec3_t * w2 = &imu->_gyro_previous[1];
+        imu_vec3_t c01 = imu_vec3_cross(w0, w1), c12 = imu_vec3_cross(w1, w2), c20 = imu_vec3_cross(w2, w0);
+        const imu_real_t k = d2r(dtime) / IMU_R(120);
+        rate = imu_vec3_create(
+            (IMU_R(8) * w0->x + IMU_R(5) * w1->x - w2->x) / IMU_R(12) + (IMU_R(11) * c01.x + c12.x + c20.x) * k,
+            (IMU_R(8) * w0->y + IMU_R(5) * w1->y - w2->y) / IMU_R(12) + (IMU_R(11) * c01.y + c12.y + c20.y) * k,
+            (IMU_R(8) * w0->z + IMU_R(5) * w1->z - w2->z) / IMU_R(12) + (IMU_R(11) * c01.z + c12.z + c20.z) * k);
+        break;
+    }
+    case IMU_INTEGRATOR_RK4:
+    {
+        imu_vec3_t r0 = imu_vec3_create(d2r(w0->x), d2r(w0->y), d2r(w0->z));
+        imu_vec3_t r1 = imu_vec3_create(d2r(w1->x), d2r(w1->y), d2r(w1->z));
+        return imu_gyro_rotation_rk4(&r0, &r1, dtime);
+    }
+    default:
+        rate = *w1;
+        break;
+    }
+
+    imu_real_t rotvlen, crotang_2, srotang_2;
+    if(imu->_fast_math)
+    {
+        rotvlen = imu_sqrt(imu_vec3_dot(&rate, &rate));
+        imu_real_t rotang = d2r(dtime * rotvlen);
+        crotang_2 = imu_math_fast_cos(rotang * IMU_R(0.5));
+        srotang_2 = imu_math_fast_sin(rotang * IMU_R(0.5));
+    }
+    else
+    {
+        rotvlen = imu_vec3_length(&rate);
+        imu_real_t rotang = d2r(dtime * rotvlen);
+        crotang_2 = imu_cos(rotang * IMU_R(0.5));
+        srotang_2 = imu_sin(rotang * IMU_R(0.5));
+    }
+
+    // rotation axis, normalized with the length we already have. imu_vec3_normalize() would
+    // add the error of the fast inverse square root (up to 0.2%) to the integrated angle.
+    imu_vec3_t rotn = imu_vec3_scale(&rate, rotvlen > 0 ? 1 / rotvlen : 0);
+    return imu_quaternion_create(crotang_2, rotn.x * srotang_2, rotn.y * srotang_2, rotn.z * srotang_2);
+}
+
+
+////////////////////////////////////////////
+
+
+// counts the gyro step and takes the accelerometer sample if it is new. returns how many gyro
+// steps its correction stands for, up to IMU_CORRECTION_MAX_STEPS, or 0 if there is no new sample.
+static uint16_t imu_accelerometer_take(imu_t * imu)
+{
+    imu->_correction_steps += imu->_correction_steps < IMU_CORRECTION_MAX_STEPS;
+    if(!imu->_accelerometer_fresh)
+    {
+        return 0;
+    }
+
+    uint16_t steps = imu->_correction_steps;
+    imu->_accelerometer_fresh = 0;
+    imu->_correction_steps = 0;
+    return steps;
+}
+
+
+////////////////////////////////////////////
+
+
+// per gyro sample the complementary correction takes 1 - alpha of the tilt error,
+// n samples leave alpha^n of it. alpha^n by squaring, blocks can stand for many samples.
+static imu_real_t imu_complementary_gain(uint32_t steps)
+{
+    imu_real_t left = IMU_R(1), power = IMU_R(IMU_COMPLEMENTARY_ALPHA);
+    for(; steps > 0; steps >>= 1)
+    {
+        if(steps & 1)
+        {
+            left *= power;
+        }
+        power *= power;
+    }
+    return IMU_R(1) - left;
+}
+
+
+////////////////////////////////////////////
+
+
+static void imu_complementary_filter(imu_t * imu, imu_real_t dtime)
+{
+    // subtracting mean noise offsets from new raw values and scaling
+    imu_scale_raw(imu);
 
     ////////////////////////////////////////////
     // gyro integration
     ////////////////////////////////////////////
 
-    float dtime = get_time_sec() - imu->_gyro_ts;
-    float rotvlen = imu_vec3_length(&imu->gyro);
-    float rotang = d2r(dtime * rotvlen);
-    float crotang_2 = cos(rotang * 0.5);
-    float srotang_2 = sin(rotang * 0.5);
-
-    imu_vec3_t rotn = imu_vec3_normalize(&imu->gyro);
-    // instantaneous rotation quaternion
-    imu_quaternion_t rotation = imu_quaternion_create(crotang_2, rotn.x * srotang_2, rotn.y * srotang_2, rotn.z * srotang_2);
+    imu_quaternion_t rotation = imu_gyro_rotation(imu, dtime);
     // integrated gyro quaternion
     imu_quaternion_t qw = imu_quaternion_product(&imu->orientation_quat, &rotation);
 
-    imu->_gyro_ts = get_time_sec();
-
     ////////////////////////////////////////////
     // complementary filter
     ////////////////////////////////////////////
 
-    // gravity vector quaternion in body coordinates
-    imu_quaternion_t qabody = imu_quaternion_create(0.f ,imu->accelerometer.x, imu->accelerometer.y, imu->accelerometer.z);
-    // current estimation of world space
-    imu_quaternion_t qawrld = imu_quaternion_rotate_vector_quaternion(&qw, &qabody);
-    // normalize qaworld
-    qawrld = imu_quaternion_normalize(&qawrld);
+    // gyro only until the accelerometer has a new sample
+    uint32_t steps = imu_accelerometer_take(imu);
+    if(steps == 0)
+    {
+        imu->orientation_quat = qw;
+        return;
+    }
+
+    // with a correction divider the accelerometer is summed up over a block, and the correction
+    // runs once per block on that sum against the orientation in the middle of the block.
+    // the tilt error it finds is a world frame rotation, so it holds for the end of the block too.
+    const imu_quaternion_t * qa = &qw;
+    imu_vec3_t a = imu->accelerometer;
+    if(imu->_correction_divider > 1)
+    {
+        imu->_correction_block_steps += steps;
+        imu->_accelerometer_sum = imu_vec3_sum(&imu->_accelerometer_sum, &imu->accelerometer);
+        const uint16_t count = ++imu->_correction_count, divider = imu->_correction_divider;
+        if(count == (divider + 1) / 2)
+        {
+            imu->_correction_orientation = qw;
+        }
+        else if(divider % 2 == 0 && count == divider / 2 + 1)
+        {
+            // even block, its middle falls between two samples. exact normalization, the rotation
+            // below needs a unit quaternion and the fast inverse square root leaves a 0.06 deg tilt bias.
+            imu_quaternion_t m = imu_quaternion_sum(&imu->_correction_orientation, &qw);
+            imu->_correction_orientation = imu_quaternion_scale(&m, 1 / imu_quaternion_length(&m));
+        }
+        if(count < divider)
+        {
+            imu->orientation_quat = qw;
+            return;
+        }
+
+        // only the direction is used, the sum is as good as the mean
+        a = imu->_accelerometer_sum;
+        qa = &imu->_correction_orientation;
+        steps = imu->_correction_block_steps;
+        imu->_accelerometer_sum = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+        imu->_correction_count = 0;
+        imu->_correction_block_steps = 0;
+    }
+    imu_real_t gain = imu_complementary_gain(steps);
+
+    // gravity vector in world space, current estimation. qw is a product of unit quaternions,
+    // so the conjugate based rotation is enough.
+    imu_vec3_t v = imu_quaternion_rotate_vector_unit(qa, &a);
+    // exact normalization: acos() below turns the fast inverse square root error near |v| = 1
+    // into tilt jitter of up to 1e-3 rad per sample.
+    v = imu_vec3_scale(&v, 1 / imu_sqrt(imu_vec3_dot(&v, &v)));
     // up vector of world
-    imu_vec3_t wup = imu_vec3_create(0.f, 0.f, 1.f);
-    imu_vec3_t v = imu_vec3_create(qawrld.x, qawrld.y, qawrld.z);
+    imu_vec3_t wup = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(1));
     imu_vec3_t n = imu_vec3_cross(&v, &wup);
     n = imu_vec3_normalize(&n);
-    float tiltang = acos(imu_vec3_dot(&v, &wup)) * one_minus_alpha;
-    float ctiltang_2 = cos(tiltang * 0.5);
-    float stiltang_2 = sin(tiltang * 0.5);
+    imu_real_t tiltang, ctiltang_2, stiltang_2;
+    if(imu->_fast_math)
+    {
+        tiltang = imu_math_fast_acos(imu_vec3_dot(&v, &wup)) * gain;
+        ctiltang_2 = imu_math_fast_cos(tiltang * IMU_R(0.5));
+        stiltang_2 = imu_math_fast_sin(tiltang * IMU_R(0.5));
+    }
+    else
+    {
+        tiltang = imu_acos(imu_vec3_dot(&v, &wup)) * gain;
+        ctiltang_2 = imu_cos(tiltang * IMU_R(0.5));
+        stiltang_2 = imu_sin(tiltang * IMU_R(0.5));
+    }
     // tilt correction quaternion
     imu_quaternion_t qt = imu_quaternion_create(ctiltang_2, n.x * stiltang_2, n.y * stiltang_2, n.z * stiltang_2);
     // resulting quaternion of complementary filter
     imu->orientation_quat = imu_quaternion_product(&qt, &qw);
-    // updating orientation
-    imu->orientation = imu_quaternion_to_euler(&imu->orientation_quat);
 }
 
 
 ////////////////////////////////////////////
 
 
-void imu_main_loop(imu_t *imu)
+// first order quaternion integration q += q * (0, w) * dt / 2 gets renormalized with one newton
+// step of 1 / sqrt(|q|^2) around 1 instead of a square root. per sample |q| is off by ~(|w| dt)^2 / 8,
+// so the error left after the step is far below float precision.
+static void imu_integrate_rate(imu_t * imu, imu_real_t wx, imu_real_t wy, imu_real_t wz, imu_real_t dtime)
+{
+    const imu_quaternion_t * q = &imu->orientation_quat;
+    imu_real_t h = dtime * IMU_R(0.5);
+
+    imu_real_t w = q->w + (-q->x * wx - q->y * wy - q->z * wz) * h;
+    imu_real_t x = q->x + ( q->w * wx + q->y * wz - q->z * wy) * h;
+    imu_real_t y = q->y + ( q->w * wy - q->x * wz + q->z * wx) * h;
+    imu_real_t z = q->z + ( q->w * wz + q->x * wy - q->y * wx) * h;
+
+    imu_real_t k = (IMU_R(3) - (w * w + x * x + y * y + z * z)) * IMU_R(0.5);
+    imu->orientation_quat = imu_quaternion_create(w * k, x * k, y * k, z * k);
+}
+
+
+////////////////////////////////////////////
+
+
+// gyro and feedback rate (rad/s) of the engines into the orientation. with a higher order
+// integrator the gyro part is rotated by imu_gyro_rotation(), only the feedback is left
+// to the first order step.
+static void imu_integrate_gyro(imu_t * imu, imu_real_t wx, imu_real_t wy, imu_real_t wz, imu_real_t dtime)
+{
+    if(imu->_integrator == IMU_INTEGRATOR_EULER)
+    {
+        imu_integrate_rate(imu, wx, wy, wz, dtime);
+        return;
+    }
+
+    imu_quaternion_t rotation = imu_gyro_rotation(imu, dtime);
+    imu->orientation_quat = imu_quaternion_product(&imu->orientation_quat, &rotation);
+    imu_integrate_rate(imu, wx - d2r(imu->gyro.x), wy - d2r(imu->gyro.y), wz - d2r(imu->gyro.z), dtime);
+}
+
+
+////////////////////////////////////////////
+
+
+// estimated gravity in sensor frame at the end of the sample period. the accelerometer sample
+// belongs to the orientation after this period's rotation, comparing it to gravity of q
+// lags one sample (0.25 deg at 250 deg/s and 1 kHz). first order: v' = v x w.
+static inline imu_vec3_t imu_predicted_gravity(const imu_quaternion_t * q, imu_real_t wx, imu_real_t wy, imu_real_t wz, imu_real_t dtime)
+{
+    imu_real_t vx = IMU_R(2) * (q->x * q->z - q->w * q->y);
+    imu_real_t vy = IMU_R(2) * (q->w * q->x + q->y * q->z);
+    imu_real_t vz = IMU_R(1) - IMU_R(2) * (q->x * q->x + q->y * q->y);
+
+    return imu_vec3_create(vx + (vy * wz - vz * wy) * dtime,
+                           vy + (vz * wx - vx * wz) * dtime,
+                           vz + (vx * wy - vy * wx) * dtime);
+}
+
+
+////////////////////////////////////////////
+
+
+// engines start from identity, wherever the sensor points. their gains ramp down from
+// IMU_ENGINE_STARTUP_GAIN times the set value during the first IMU_ENGINE_STARTUP seconds,
+// so the initial tilt is taken over in a fraction of a second. returns the gain multiplier.
+static imu_real_t imu_engine_startup(imu_t * imu, imu_real_t dtime)
+{
+    if(imu->_engine_time >= IMU_R(IMU_ENGINE_STARTUP))
+    {
+        return IMU_R(1);
+    }
+
+    imu->_engine_time += dtime;
+    imu_real_t left = IMU_R(1) - imu->_engine_time / IMU_R(IMU_ENGINE_STARTUP);
+    return left > 0 ? IMU_R(1) + (IMU_R(IMU_ENGINE_STARTUP_GAIN) - IMU_R(1)) * left : IMU_R(1);
+}
+
+
+////////////////////////////////////////////
+
+
+// madgwick's gradient descent filter: one step against the gradient of the gravity
+// error, scaled with beta, is added to the gyro rate.
+static void imu_madgwick_filter(imu_t * imu, imu_real_t dtime)
+{
+    imu_scale_raw(imu);
+
+    const imu_quaternion_t * q = &imu->orientation_quat;
+    imu_real_t q0 = q->w, q1 = q->x, q2 = q->y, q3 = q->z;
+    imu_real_t wx = d2r(imu->gyro.x), wy = d2r(imu->gyro.y), wz = d2r(imu->gyro.z);
+    imu_real_t ax = imu->accelerometer.x, ay = imu->accelerometer.y, az = imu->accelerometer.z;
+
+    // a correction stands for all gyro steps since the last accelerometer sample
+    imu_real_t startup = imu_engine_startup(imu, dtime);
+    uint16_t steps = imu_accelerometer_take(imu);
+    imu_real_t beta = imu->_madgwick_beta * startup * (imu_real_t)steps;
+
+    imu_real_t r = steps > 0 ? imu_inv_sqrt(imu, ax * ax + ay * ay + az * az) : IMU_R(0);
+    if(r > 0 && beta > 0)
+    {
+        ax *= r;
+        ay *= r;
+        az *= r;
+
+        // gravity error f = v - a, s = J^T f / 2. only the direction of s is used.
+        imu_vec3_t v = imu_predicted_gravity(q, wx, wy, wz, dtime);
+        imu_real_t fx = v.x - ax;
+        imu_real_t fy = v.y - ay;
+        imu_real_t fz = v.z - az;
+
+        imu_real_t s0 = -q2 * fx + q1 * fy;
+        imu_real_t s1 =  q3 * fx + q0 * fy - IMU_R(2) * q1 * fz;
+        imu_real_t s2 = -q0 * fx + q3 * fy - IMU_R(2) * q2 * fz;
+        imu_real_t s3 =  q1 * fx + q2 * fy;
+
+        imu_real_t k = beta * imu_inv_sqrt(imu, s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+
+        // q' = q * (0, w) / 2 - beta * s, written as a corrected rate w - 2 beta q* s
+        imu_real_t ex = q0 * s1 - q1 * s0 - q2 * s3 + q3 * s2;
+        imu_real_t ey = q0 * s2 + q1 * s3 - q2 * s0 - q3 * s1;
+        imu_real_t ez = q0 * s3 - q1 * s2 + q2 * s1 - q3 * s0;
+        wx -= IMU_R(2) * k * ex;
+        wy -= IMU_R(2) * k * ey;
+        wz -= IMU_R(2) * k * ez;
+    }
+
+    imu_integrate_gyro(imu, wx, wy, wz, dtime);
+}
+
+
+////////////////////////////////////////////
+
+
+// mahony's nonlinear complementary filter: the cross product of measured and estimated
+// gravity is fed back into the gyro rate, proportionally and integrated as gyro bias.
+static void imu_mahony_filter(imu_t * imu, imu_real_t dtime)
+{
+    imu_scale_raw(imu);
+
+    const imu_quaternion_t * q = &imu->orientation_quat;
+    imu_real_t wx = d2r(imu->gyro.x), wy = d2r(imu->gyro.y), wz = d2r(imu->gyro.z);
+    imu_real_t ax = imu->accelerometer.x, ay = imu->accelerometer.y, az = imu->accelerometer.z;
+
+    // a correction stands for all gyro steps since the last accelerometer sample
+    imu_real_t boost = imu_engine_startup(imu, dtime);
+    uint16_t steps = imu_accelerometer_take(imu);
+    imu_real_t kp = imu->_mahony_kp * boost * (imu_real_t)steps;
+
+    imu_real_t r = steps > 0 ? imu_inv_sqrt(imu, ax * ax + ay * ay + az * az) : IMU_R(0);
+    if(r > 0)
+    {
+        ax *= r;
+        ay *= r;
+        az *= r;
+
+        // error is a x v, sin of the tilt error times its axis
+        imu_vec3_t v = imu_predicted_gravity(q, wx, wy, wz, dtime);
+        imu_real_t ex = ay * v.z - az * v.y;
+        imu_real_t ey = az * v.x - ax * v.z;
+        imu_real_t ez = ax * v.y - ay * v.x;
+
+        // the initial tilt is no gyro bias, integration waits for the startup to end
+        if(imu->_mahony_ki > 0 && boost == IMU_R(1))
+        {
+            imu_real_t ki_dt = imu->_mahony_ki * dtime * (imu_real_t)steps;
+            imu->_mahony_integral.x += ex * ki_dt;
+            imu->_mahony_integral.y += ey * ki_dt;
+            imu->_mahony_integral.z += ez * ki_dt;
+        }
+
+        wx += kp * ex;
+        wy += kp * ey;
+        wz += kp * ez;
+    }
+
+    // the bias estimate holds between accelerometer samples too
+    wx += imu->_mahony_integral.x;
+    wy += imu->_mahony_integral.y;
+    wz += imu->_mahony_integral.z;
+
+    imu_integrate_gyro(imu, wx, wy, wz, dtime);
+}
+
+
+////////////////////////////////////////////
+
+
+// error-state kalman filter, see imu_ekf.h. it weighs gyro against accelerometer from its
+// own covariance, so there is no startup boost: the initial attitude uncertainty does that.
+// covariance grows with every gyro step, so a slower accelerometer needs no extra scaling,
+// steps without a new sample only predict.
+static void imu_ekf_filter(imu_t * imu, imu_real_t dtime)
+{
+    imu_scale_raw(imu);
+
+    imu_vec3_t w = imu_vec3_create(d2r(imu->gyro.x), d2r(imu->gyro.y), d2r(imu->gyro.z));
+    imu_vec3_t none = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+    imu_ekf_step(&imu->_ekf, &imu->orientation_quat, &w, imu_accelerometer_take(imu) ? &imu->accelerometer : &none, dtime);
+}
+
+
+////////////////////////////////////////////
+
+
+// rotates the orientation about world z, so the horizontal part of the calibrated field
+// turns towards world x by fraction k of the heading error (all of it for k = 1).
+// the rotation is the half angle quaternion of the heading, (|h| + hx, 0, 0, -hy) normalized,
+// blended with identity. no trigonometry, one square root and one inverse square root.
+static void imu_heading_correct(imu_t * imu, imu_real_t k)
+{
+    imu_vec3_t h = imu_quaternion_rotate_vector_unit(&imu->orientation_quat, &imu->magnetometer);
+    imu_real_t n2 = h.x * h.x + h.y * h.y;
+    if(n2 <= IMU_R(1e-6))
+    {
+        // field along gravity, no heading to be seen
+        return;
+    }
+
+    imu_real_t hl = imu_sqrt(n2);
+    imu_real_t cw = hl + h.x, cz = -h.y;
+    imu_real_t c2 = cw * cw + cz * cz;
+    if(c2 <= IMU_R(1e-12) * n2)
+    {
+        // pointing south, half a turn
+        cw = IMU_R(0);
+        cz = IMU_R(1);
+    }
+    else
+    {
+        imu_real_t r = imu_inv_sqrt(imu, c2);
+        cw *= r;
+        cz *= r;
+    }
+
+    cw = IMU_R(1) - k + k * cw;
+    cz = k * cz;
+    imu_real_t r = imu_inv_sqrt(imu, cw * cw + cz * cz);
+    imu_quaternion_t qh = imu_quaternion_create(cw * r, IMU_R(0), IMU_R(0), cz * r);
+
+    imu->orientation_quat = imu_quaternion_product(&qh, &imu->orientation_quat);
+}
+
+
+////////////////////////////////////////////
+
+
+// magnetometer stage after the engine: online calibration and heading correction
+static void imu_magnetometer_update(imu_t * imu, double ts)
 {
+    imu_magcal_t * cal = &imu->magnetometer_calibration;
+    imu->_magnetometer_fresh = 0;
+
+    if(imu->_magnetometer_calibration_mode == IMU_CALIBMODE_PERIODIC ||
+       (imu->_magnetometer_calibration_mode == IMU_CALIBMODE_ONCE && !cal->valid))
+    {
+        imu_magcal_add(cal, &imu->magnetometer_raw);
+    }
+
+    if(!cal->valid)
+    {
+        return;
+    }
+
+    imu->magnetometer = imu_magcal_apply(cal, &imu->magnetometer_raw);
+    imu_real_t dtime = (imu_real_t)(ts - imu->_magnetometer_ts);
+    imu->_magnetometer_ts = ts;
+
+    if(imu->state != IMU_STATE_READY)
+    {
+        return;
+    }
+
+    // a field much stronger or weaker than calibrated is disturbed (motors, steel nearby)
+    imu_real_t m2 = imu_vec3_dot(&imu->magnetometer, &imu->magnetometer);
+    const imu_real_t lo = IMU_R(1) - IMU_R(IMU_MAGNETOMETER_REJECT), hi = IMU_R(1) + IMU_R(IMU_MAGNETOMETER_REJECT);
+    if(m2 < lo * lo || m2 > hi * hi)
+    {
+        return;
+    }
+
+    imu_real_t k = IMU_R(1);
+    if(imu->_heading_aligned)
+    {
+        k = imu->_magnetometer_gain * dtime;
+        k = k < IMU_R(0) ? IMU_R(0) : (k > IMU_R(1) ? IMU_R(1) : k);
+    }
+    imu->_heading_aligned = 1;
+
+    imu_heading_correct(imu, k);
+}
+
+
+////////////////////////////////////////////
+
+
+static void imu_step(imu_t *imu, double ts)
+{
+    if(imu->_odr_period > 0.0)
+    {
+        ts = imu->_gyro_ts + imu->_odr_period;
+    }
+
+    // timestamp is tracked in every state, so the first filter step after
+    // calibration integrates over one sample period only.
+    imu_real_t dtime = (imu_real_t)(ts - imu->_gyro_ts);
+    imu->_gyro_ts = ts;
+
     switch (imu->state)
     {
     case IMU_STATE_UNCALIBRATED:
 
         if(imu->_calibration_mode != IMU_CALIBMODE_NEVER)
         {
-            imu->_calibration_time = time(NULL);
+            imu->_calibration_time = ts;
+            imu_welford_reset(&imu->_gyro_stats);
+            imu_welford_reset(&imu->_accelerometer_stats);
             imu_set_state(imu, IMU_STATE_CALIBRATING);
-            imu->gyro_offset = imu->accelerometer_offset = imu_vec3_create(0.f, 0.f, 0.f);
+            imu->gyro_offset = imu->accelerometer_offset = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
         }
         else
         {
@@ -148,19 +798,33 @@ void imu_main_loop(imu_t *imu)
 
     case IMU_STATE_CALIBRATING:
 
-        imu_calibrate(imu);
+        imu_calibrate(imu, ts);
         break;
 
     case IMU_STATE_READY:
 
-        imu_complementary_filter(imu);
+        switch(imu->_estimation_mode & IMU_ESTIMODE_ENGINE)
+        {
+        case IMU_ESTIMODE_MADGWICK:
+            imu_madgwick_filter(imu, dtime);
+            break;
+        case IMU_ESTIMODE_MAHONY:
+            imu_mahony_filter(imu, dtime);
+            break;
+        case IMU_ESTIMODE_EKF:
+            imu_ekf_filter(imu, dtime);
+            break;
+        default:
+            imu_complementary_filter(imu, dtime);
+            break;
+        }
+        imu->_gyro_previous[1] = imu->_gyro_previous[0];
+        imu->_gyro_previous[0] = imu->gyro;
+        imu->_gyro_previous_count += imu->_gyro_previous_count < 2;
 
         if(imu->_calibration_mode == IMU_CALIBMODE_PERIODIC)
         {
-            if(time(NULL) - imu->_calibration_time > IMU_CALIBRATION_PERIOD)
-            {
-                imu_set_state(imu, IMU_STATE_UNCALIBRATED);
-            }
+            imu_recalibrate(imu, ts);
         }
 
         break;
@@ -168,6 +832,68 @@ void imu_main_loop(imu_t *imu)
     default:
         break;
     }
+
+    if((imu->_estimation_mode & IMU_ESTIMODE_MAGNETOMETER) && imu->_magnetometer_fresh)
+    {
+        imu_magnetometer_update(imu, ts);
+    }
+
+    if(imu->state == IMU_STATE_READY)
+    {
+        imu_update_outputs(imu);
+
+        if(imu->_history)
+        {
+            imu_history_push(imu->_history, ts, &imu->orientation_quat);
+        }
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_main_loop(imu_t *imu)
+{
+    // with a fixed output data rate the clock is never read, imu_step() advances time itself.
+    imu_step(imu, imu->_odr_period > 0.0 ? 0.0 : get_time_sec());
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_main_loop_ts(imu_t *imu, double ts)
+{
+    imu_step(imu, ts);
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_process_batch(imu_t * imu, const imu_sample_t * samples, size_t n, imu_quaternion_t * out)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        const imu_sample_t * s = &samples[i];
+
+        imu->accelerometer_raw.x = s->ax;
+        imu->accelerometer_raw.y = s->ay;
+        imu->accelerometer_raw.z = s->az;
+        imu->_accelerometer_fresh = 1;
+
+        imu->gyro_raw.x = s->gx;
+        imu->gyro_raw.y = s->gy;
+        imu->gyro_raw.z = s->gz;
+
+        imu_step(imu, s->ts);
+
+        if(out)
+        {
+            out[i] = imu->orientation_quat;
+        }
+    }
 }
 
 
@@ -177,13 +903,14 @@ void imu_main_loop(imu_t *imu)
 void imu_set_state(imu_t * imu, int state)
 {
     imu->state = state;
+    imu->_gyro_previous_count = 0;
 }
 
 
 ////////////////////////////////////////////
 
 
-void imu_set_gyro_raw(imu_t * imu, float gx, float gy, float gz)
+void imu_set_gyro_raw(imu_t * imu, imu_real_t gx, imu_real_t gy, imu_real_t gz)
 {
     imu->gyro_raw.x = gx;
     imu->gyro_raw.y = gy;
@@ -194,11 +921,12 @@ void imu_set_gyro_raw(imu_t * imu, float gx, float gy, float gz)
 ////////////////////////////////////////////
 
 
-void imu_set_accelerometer_raw(imu_t * imu, float ax, float ay, float az)
+void imu_set_accelerometer_raw(imu_t * imu, imu_real_t ax, imu_real_t ay, imu_real_t az)
 {
     imu->accelerometer_raw.x = ax;
     imu->accelerometer_raw.y = ay;
     imu->accelerometer_raw.z = az;
+    imu->_accelerometer_fresh = 1;
 }
 
 
@@ -214,6 +942,45 @@ void imu_set_estimation_mode(imu_t * imu, int8_t mode)
 ////////////////////////////////////////////
 
 
+void imu_set_magnetometer_raw(imu_t * imu, imu_real_t mx, imu_real_t my, imu_real_t mz)
+{
+    imu->magnetometer_raw.x = mx;
+    imu->magnetometer_raw.y = my;
+    imu->magnetometer_raw.z = mz;
+    imu->_magnetometer_fresh = 1;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_set_magnetometer_calibration_mode(imu_t * imu, int8_t mode)
+{
+    imu->_magnetometer_calibration_mode = mode;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_set_magnetometer_calibration(imu_t * imu, const imu_vec3_t * offset, const imu_real_t soft_iron[3][3])
+{
+    imu_magcal_set(&imu->magnetometer_calibration, offset, soft_iron);
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_set_magnetometer_gain(imu_t * imu, imu_real_t gain)
+{
+    imu->_magnetometer_gain = gain;
+}
+
+
+////////////////////////////////////////////
+
+
 void imu_set_calibration_mode(imu_t * imu, int8_t mode)
 {
     imu->_calibration_mode = mode;
@@ -232,7 +999,7 @@ int8_t imu_get_estimation_mode(imu_t * imu)
 ////////////////////////////////////////////
 
 
-void imu_set_gyro_scale_factor(imu_t * imu, float scalefactor)
+void imu_set_gyro_scale_factor(imu_t * imu, imu_real_t scalefactor)
 {
     imu->_scale_factor_gyro = scalefactor;
 }
@@ -241,10 +1008,236 @@ void imu_set_gyro_scale_factor(imu_t * imu, float scalefactor)
 ////////////////////////////////////////////
 
 
-void imu_set_accelerometer_scale_factor(imu_t * imu, float scalefactor)
+void imu_set_accelerometer_scale_factor(imu_t * imu, imu_real_t scalefactor)
 {
     imu->_scale_factor_accelerometer = scalefactor;
 }
 
 
-////////////////////////////////////////////
\ No newline at end of file
+////////////////////////////////////////////
+
+
+void imu_set_output_data_rate(imu_t * imu, imu_real_t hz)
+{
+    imu->_odr_period = hz > 0 ? 1.0 / (double)hz : 0.0;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_set_fast_math(imu_t * imu, int8_t enabled)
+{
+    imu->_fast_math = enabled;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_set_correction_divider(imu_t * imu, uint16_t divider)
+{
+    if(divider < 1)
+    {
+        prerr("correction divider has to be at least 1.");
+        return;
+    }
+
+    imu->_correction_divider = divider;
+    imu->_correction_count = 0;
+    imu->_correction_block_steps = 0;
+    imu->_accelerometer_sum = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_set_integrator(imu_t * imu, int8_t integrator)
+{
+    if(integrator < IMU_INTEGRATOR_EULER || integrator > IMU_INTEGRATOR_CONING3)
+    {
+        prerr("unknown integrator %d.", integrator);
+        return;
+    }
+
+    imu->_integrator = integrator;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_set_madgwick_gain(imu_t * imu, imu_real_t beta)
+{
+    imu->_madgwick_beta = beta;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_set_mahony_gains(imu_t * imu, imu_real_t kp, imu_real_t ki)
+{
+    imu->_mahony_kp = kp;
+    imu->_mahony_ki = ki;
+
+    if(ki <= 0)
+    {
+        imu->_mahony_integral = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_set_ekf_noise(imu_t * imu, imu_real_t gyro, imu_real_t bias, imu_real_t accelerometer)
+{
+    if(gyro <= 0 || bias < 0 || accelerometer <= 0)
+    {
+        prerr("kalman gyro and accelerometer noise have to be positive, bias noise not negative.");
+        return;
+    }
+
+    imu->_ekf.gyro_noise = gyro;
+    imu->_ekf.bias_noise = bias;
+    imu->_ekf.accelerometer_noise = accelerometer;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_set_history(imu_t * imu, struct imu_history * history)
+{
+    imu->_history = history;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_set_outputs(imu_t * imu, int8_t outputs)
+{
+    imu->_outputs = outputs | IMU_OUTPUT_QUATERNION;
+}
+
+
+////////////////////////////////////////////
+
+
+// imu_quaternion_to_euler(), with the polynomial atan2 and asin under fast math. the two atan2
+// and the asin are most of the libm trigonometry of a default step.
+static imu_euler_t imu_euler(const imu_t * imu, const imu_quaternion_t * q)
+{
+    if(!imu->_fast_math)
+    {
+        return imu_quaternion_to_euler(q);
+    }
+
+    imu_euler_t e;
+    e.roll = imu_math_fast_atan2(2 * (q->w * q->x + q->y * q->z), 1 - 2 * (q->x * q->x + q->y * q->y));
+    e.pitch = imu_math_fast_asin(2 * (q->w * q->y - q->z * q->x));
+    e.yaw = q->z == 0 ? IMU_R(0) : imu_math_fast_atan2(2 * (q->w * q->z + q->x * q->y), 1 - 2 * (q->y * q->y + q->z * q->z));
+    return e;
+}
+
+
+////////////////////////////////////////////
+
+
+// gravity is the world z axis seen from the body, the last row of the rotation matrix.
+// orientation_quat is only about unit length, so it is normalized on the way.
+static imu_vec3_t imu_gravity(const imu_quaternion_t * q)
+{
+    const imu_real_t n = q->w * q->w + q->x * q->x + q->y * q->y + q->z * q->z;
+    const imu_real_t s = n > 0 ? IMU_R(2) / n : IMU_R(0);
+    return imu_vec3_create(
+        s * (q->x * q->z - q->w * q->y),
+        s * (q->y * q->z + q->w * q->x),
+        IMU_R(1) - s * (q->x * q->x + q->y * q->y)
+    );
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_update_outputs(imu_t * imu)
+{
+    const imu_quaternion_t * q = &imu->orientation_quat;
+    const int8_t outputs = imu->_outputs;
+
+    if(outputs & IMU_OUTPUT_EULER)
+    {
+        imu->orientation = imu_euler(imu, q);
+    }
+    if(outputs & IMU_OUTPUT_MATRIX)
+    {
+        imu->orientation_matrix = imu_quaternion_to_matrix3(q);
+    }
+    if(outputs & IMU_OUTPUT_GL_MATRIX)
+    {
+        imu->orientation_gl = imu_quaternion_to_matrix4(q);
+    }
+    if(outputs & (IMU_OUTPUT_GRAVITY | IMU_OUTPUT_LINEAR))
+    {
+        imu->gravity = imu_gravity(q);
+        imu->linear_acceleration = imu_vec3_dif(&imu->accelerometer, &imu->gravity);
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+imu_euler_t imu_get_euler(const imu_t * imu)
+{
+    return imu->_outputs & IMU_OUTPUT_EULER ? imu->orientation : imu_euler(imu, &imu->orientation_quat);
+}
+
+
+////////////////////////////////////////////
+
+
+imu_mat3_t imu_get_matrix(const imu_t * imu)
+{
+    return imu->_outputs & IMU_OUTPUT_MATRIX ? imu->orientation_matrix : imu_quaternion_to_matrix3(&imu->orientation_quat);
+}
+
+
+////////////////////////////////////////////
+
+
+imu_mat4_t imu_get_gl_matrix(const imu_t * imu)
+{
+    return imu->_outputs & IMU_OUTPUT_GL_MATRIX ? imu->orientation_gl : imu_quaternion_to_matrix4(&imu->orientation_quat);
+}
+
+
+////////////////////////////////////////////
+
+
+imu_vec3_t imu_get_gravity(const imu_t * imu)
+{
+    return imu->_outputs & IMU_OUTPUT_GRAVITY ? imu->gravity : imu_gravity(&imu->orientation_quat);
+}
+
+
+////////////////////////////////////////////
+
+
+imu_vec3_t imu_get_linear_acceleration(const imu_t * imu)
+{
+    if(imu->_outputs & IMU_OUTPUT_LINEAR)
+    {
+        return imu->linear_acceleration;
+    }
+
+    imu_vec3_t g = imu_gravity(&imu->orientation_quat);
+    return imu_vec3_dif(&imu->accelerometer, &g);
+}
+
+
+////////////////////////////////////////////
@@ -25,21 +25,36 @@
 #ifndef IMU_H
 #define IMU_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "imu_types.h"
 #include "imu_utils.h"
 #include "imu_algebra.h"
 #include "imu_constants.h"
+#include "imu_welford.h"
+#include "imu_magcal.h"
+#include "imu_ekf.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
+// imu_history.h
+struct imu_history;
+
+
 ////////////////////////////////////////////
 
 
+// thread safety: the library keeps no mutable global state besides the kernel table of
+// imu_dispatch.h, which is set when the library is loaded and by imu_dispatch_set_isa()
+// (don't call that while other threads are processing). every imu_t (and imu_bank_t,
+// imu_fixed_t) carries its whole state, so different instances can be stepped from different
+// threads at the same time without locking. one instance must only be used by one thread at a
+// time; readers on other threads need their own synchronization. imu_pool.h steps many
+// instances in parallel.
 typedef struct IMU 
 {
     // processed gyro data
@@ -64,33 +79,135 @@ typedef struct IMU
     // raw accelerometer data. SET THIS USING imu_set_accelerometer_raw()
     imu_vec3_t accelerometer_raw;
 
+    // raw magnetometer data. SET THIS USING imu_set_magnetometer_raw()
+    imu_vec3_t magnetometer_raw;
+
+    // calibrated magnetometer data, fraction of the local field strength
+    imu_vec3_t magnetometer;
+
+    // hard/soft-iron calibration of the magnetometer, fitted from raw samples while
+    // IMU_ESTIMODE_MAGNETOMETER is set (see imu_set_magnetometer_calibration_mode())
+    imu_magcal_t magnetometer_calibration;
+
     // computed orientation quaternion of the body
     imu_quaternion_t orientation_quat;
 
-    // orientation of the body in roll, pitch and yaw angles
+    // orientation of the body in roll, pitch and yaw angles. IMU_OUTPUT_EULER, see imu_set_outputs()
     imu_euler_t orientation;
+
+    // orientation as a rotation matrix, body to world. IMU_OUTPUT_MATRIX
+    imu_mat3_t orientation_matrix;
+
+    // the same as a column major float 4x4, to be handed to glLoadMatrixf() or glMultMatrixf() as is.
+    // IMU_OUTPUT_GL_MATRIX
+    imu_mat4_t orientation_gl;
+
+    // direction of gravity in the body frame, what a still accelerometer reads, in g. IMU_OUTPUT_GRAVITY
+    imu_vec3_t gravity;
+
+    // accelerometer with gravity taken out, body frame, in g. IMU_OUTPUT_LINEAR
+    imu_vec3_t linear_acceleration;
     
     // current computational state of the library.
     int8_t state;
     
-    // timestamp to compute angular change in gyro
+    // timestamp to compute angular change in gyro. timestamps stay double in every build,
+    // seconds since epoch don't fit a float. only their difference enters the filter.
     double _gyro_ts;
     
     // number to multiply raw gyro data. changes according to full scale
-    double _scale_factor_gyro;
+    imu_real_t _scale_factor_gyro;
 
     // number to multiply raw accelerometer data changes according to full scale
-    double _scale_factor_accelerometer;
+    imu_real_t _scale_factor_accelerometer;
+
+    // timestamp of the last committed calibration. in IMU_CALIBMODE_PERIODIC, once IMU_CALIBRATION_PERIOD
+    // seconds have passed the filter keeps running while raw samples are collected, and offsets are
+    // replaced by the first stationary window.
+    // measured on the same time base as _gyro_ts (clock, sample timestamps or output data rate).
+    double _calibration_time;
+
+    // running mean and variance of raw gyro and accelerometer data of the current calibration window
+    imu_welford_t _gyro_stats;
+    imu_welford_t _accelerometer_stats;
+
+    // sample period in seconds when a fixed output data rate is set, 0 otherwise.
+    // when set, time advances by this much on every sample and neither the clock nor sample timestamps are used.
+    double _odr_period;
+
+    // if set, filter uses single precision polynomial sin, cos and acos, euler output atan2 and asin, instead of libm (see imu_set_fast_math())
+    int8_t _fast_math;
+
+    // IMU_OUTPUT_* flags, output products updated after every filter step (see imu_set_outputs())
+    int8_t _outputs;
+
+    // orientation history appended to after every filter step, NULL if none (see imu_set_history())
+    struct imu_history * _history;
 
-    // timestamp of calibration change if status is calibrating, won't be updated. if status is ready imu will be recalibrated every n seconds.
-    time_t _calibration_time;
+    // complementary filter corrects tilt once per this many accelerometer samples (see imu_set_correction_divider())
+    uint16_t _correction_divider;
+    uint16_t _correction_count;
+
+    // set by imu_set_accelerometer_raw(), cleared once the sample is used. with an accelerometer
+    // slower than the gyro only steps with a new sample correct, for all the gyro steps since the
+    // last correction at once (up to IMU_CORRECTION_MAX_STEPS).
+    int8_t _accelerometer_fresh;
+    uint16_t _correction_steps;
+
+    // accelerometer summed over the current block, the gyro steps it stands for and the orientation
+    // of its middle sample
+    imu_vec3_t _accelerometer_sum;
+    uint32_t _correction_block_steps;
+    imu_quaternion_t _correction_orientation;
+
+    // IMU_INTEGRATOR_*, how the gyro rate is turned into a rotation per sample (see imu_set_integrator())
+    int8_t _integrator;
+
+    // scaled gyro rates of the last two filter steps, latest first, deg/s. the higher order integrators
+    // interpolate through them and the current one. count restarts from 0 on every state change.
+    imu_vec3_t _gyro_previous[2];
+    int8_t _gyro_previous_count;
 
     // IMU_CALIBMODE_NEVER, IMU_CALIBMODE_ONCE or IMU_CALIBMODE_PERIODIC
     int8_t _calibration_mode;
     
-    // flags: IMU_ESTIMODE_GYRO, IMU_ESTIMODE_ACCELEROMETER or IMU_ESTIMODE_MAGNETOMETER (functionality disabled for now)
+    // flags: IMU_ESTIMODE_GYRO, IMU_ESTIMODE_ACCELEROMETER or IMU_ESTIMODE_MAGNETOMETER, plus the engine,
+    // IMU_ESTIMODE_MADGWICK, IMU_ESTIMODE_MAHONY or IMU_ESTIMODE_EKF. complementary filter if no engine is set.
     int8_t _estimation_mode;
 
+    // IMU_CALIBMODE_NEVER (fixed calibration), IMU_CALIBMODE_ONCE (fit until the first valid one)
+    // or IMU_CALIBMODE_PERIODIC (keep fitting) for magnetometer_calibration
+    int8_t _magnetometer_calibration_mode;
+
+    // heading correction rate towards magnetic north, 1/s
+    imu_real_t _magnetometer_gain;
+
+    // time of the last magnetometer sample used, same time base as _gyro_ts
+    double _magnetometer_ts;
+
+    // set by imu_set_magnetometer_raw(), cleared once the sample is used. magnetometers
+    // usually run slower than gyros, the heading is corrected only when a new sample is there.
+    int8_t _magnetometer_fresh;
+
+    // heading is snapped to north with the first calibrated sample, corrected gradually afterwards
+    int8_t _heading_aligned;
+
+    // gradient descent step of the madgwick engine, rad/s
+    imu_real_t _madgwick_beta;
+
+    // proportional and integral gain of the mahony engine
+    imu_real_t _mahony_kp;
+    imu_real_t _mahony_ki;
+
+    // gyro bias the mahony engine has integrated so far, rad/s
+    imu_vec3_t _mahony_integral;
+
+    // seconds the madgwick or mahony engine has run, counted up to IMU_ENGINE_STARTUP
+    imu_real_t _engine_time;
+
+    // state of the kalman engine besides the orientation: gyro bias and covariance
+    imu_ekf_t _ekf;
+
 } imu_t;
 
 
@@ -103,7 +220,23 @@ void imu_main_loop(imu_t * imu);
 ////////////////////////////////////////////
 
 
-imu_t imu_init(uint8_t calibration_mode, float scale_factor_accl, float scale_factor_gyro);
+// same as imu_main_loop() but time is taken from the sample timestamp (seconds) instead of the system clock.
+void imu_main_loop_ts(imu_t * imu, double ts);
+
+
+////////////////////////////////////////////
+
+
+// runs the whole state machine (calibration + filter) over n raw samples in one go.
+// time deltas are taken from samples[i].ts instead of the system clock.
+// if out is not NULL, orientation_quat after every sample is written to out[i].
+void imu_process_batch(imu_t * imu, const imu_sample_t * samples, size_t n, imu_quaternion_t * out);
+
+
+////////////////////////////////////////////
+
+
+imu_t imu_init(uint8_t calibration_mode, imu_real_t scale_factor_accl, imu_real_t scale_factor_gyro);
 
 
 ////////////////////////////////////////////
@@ -115,24 +248,59 @@ void imu_set_state(imu_t * imu, int state);
 ////////////////////////////////////////////
 
 
-void imu_set_gyro_raw(imu_t * imu, float gx, float gy, float gz);
+void imu_set_gyro_raw(imu_t * imu, imu_real_t gx, imu_real_t gy, imu_real_t gz);
 
 
 ////////////////////////////////////////////
 
 
-void imu_set_accelerometer_raw(imu_t * imu, float ax, float ay, float az);
+// marks the sample as new, the filter corrects against it with the next gyro step. when the
+// accelerometer runs at a lower rate than the gyro, call this only when it has a new sample
+// (see imu_merge.h for streams with their own timestamps).
+void imu_set_accelerometer_raw(imu_t * imu, imu_real_t ax, imu_real_t ay, imu_real_t az);
 
 
 ////////////////////////////////////////////
 
 
+// sensor flags and engine, see IMU_ESTIMODE_*. madgwick and mahony engines need no trigonometry,
+// only multiplies, adds and one (mahony) or two (madgwick) inverse square roots per sample.
 void imu_set_estimation_mode(imu_t * imu, int8_t mode);
 
 
 ////////////////////////////////////////////
 
 
+// new magnetometer sample, used by the next imu_main_loop(). with IMU_ESTIMODE_MAGNETOMETER, yaw
+// is pulled towards magnetic north (world x) once the magnetometer is calibrated.
+void imu_set_magnetometer_raw(imu_t * imu, imu_real_t mx, imu_real_t my, imu_real_t mz);
+
+
+////////////////////////////////////////////
+
+
+// IMU_CALIBMODE_PERIODIC by default
+void imu_set_magnetometer_calibration_mode(imu_t * imu, int8_t mode);
+
+
+////////////////////////////////////////////
+
+
+// known hard-iron offset (raw counts) and soft-iron matrix, corrected = soft_iron * (raw - offset)
+// should have unit length. online fitting continues unless the calibration mode is IMU_CALIBMODE_NEVER.
+void imu_set_magnetometer_calibration(imu_t * imu, const imu_vec3_t * offset, const imu_real_t soft_iron[3][3]);
+
+
+////////////////////////////////////////////
+
+
+// IMU_MAGNETOMETER_GAIN by default. larger follows north faster, but lets magnetometer noise into yaw.
+void imu_set_magnetometer_gain(imu_t * imu, imu_real_t gain);
+
+
+////////////////////////////////////////////
+
+
 void imu_set_calibration_mode(imu_t * imu, int8_t mode);
 
 
@@ -145,13 +313,112 @@ int8_t imu_get_estimation_mode(imu_t * imu);
 ////////////////////////////////////////////
 
 
-void imu_set_gyro_scale_factor(imu_t * imu, float scalefactor);
+void imu_set_gyro_scale_factor(imu_t * imu, imu_real_t scalefactor);
+
+
+////////////////////////////////////////////
+
+
+void imu_set_accelerometer_scale_factor(imu_t * imu, imu_real_t scalefactor);
+
+
+////////////////////////////////////////////
+
+
+// drive the filter from a fixed output data rate (Hz) instead of timestamps. 0 disables it.
+void imu_set_output_data_rate(imu_t * imu, imu_real_t hz);
+
+
+////////////////////////////////////////////
+
+
+// opt-in single precision polynomial trigonometry in the filter and the euler output (see imu_math.h).
+// per sample gyro rotation has to stay below 180 degrees. orientation error against
+// the exact path is checked by bench/bench_fastmath.c.
+void imu_set_fast_math(imu_t * imu, int8_t enabled);
+
+
+////////////////////////////////////////////
+
+
+// complementary filter only: gyro is integrated every sample, the accelerometer correction runs
+// every divider accelerometer samples on their sum, with the gain raised to give the same
+// response. 1 (default) corrects every sample. meant for gyro rates far above the rate
+// gravity changes at, where the correction is most of the per sample cost.
+void imu_set_correction_divider(imu_t * imu, uint16_t divider);
+
+
+////////////////////////////////////////////
+
+
+// IMU_INTEGRATOR_EULER (default) rotates by the latest rate over the whole sample period.
+// the others use the previous sample as well: same accuracy at a lower sample rate for
+// a few more multiplies per step (bench/bench_accuracy.c compares them).
+// applies to the complementary filter, madgwick and mahony. the kalman engine keeps its own.
+void imu_set_integrator(imu_t * imu, int8_t integrator);
+
+
+////////////////////////////////////////////
+
+
+// larger beta follows the accelerometer faster, but lets more of its noise and linear
+// acceleration into the orientation. IMU_MADGWICK_BETA by default.
+void imu_set_madgwick_gain(imu_t * imu, imu_real_t beta);
+
+
+////////////////////////////////////////////
+
+
+// kp pulls the orientation towards the accelerometer, ki estimates the gyro bias
+// (0 turns that off and clears the estimate). IMU_MAHONY_KP and IMU_MAHONY_KI by default.
+void imu_set_mahony_gains(imu_t * imu, imu_real_t kp, imu_real_t ki);
+
+
+////////////////////////////////////////////
+
+
+// noise model of the kalman engine: gyro noise (rad/s), gyro bias random walk
+// (rad/s per sqrt(s)) and accelerometer noise (fraction of gravity). IMU_EKF_* by default.
+void imu_set_ekf_noise(imu_t * imu, imu_real_t gyro, imu_real_t bias, imu_real_t accelerometer);
+
+
+////////////////////////////////////////////
+
+
+// IMU_OUTPUT_* flags of the products kept up to date after every filter step, each one
+// costs its conversion per step. IMU_OUTPUT_QUATERNION | IMU_OUTPUT_EULER by default.
+// consumers that only read the quaternion can drop the euler angles (two atan2 and an asin).
+void imu_set_outputs(imu_t * imu, int8_t outputs);
+
+
+////////////////////////////////////////////
+
+
+// recomputes the selected outputs from orientation_quat, e.g. after it was set from outside.
+// imu_main_loop() does this on every filter step.
+void imu_update_outputs(imu_t * imu);
+
+
+////////////////////////////////////////////
+
+
+// output products on access: the field when it is selected, computed from the current
+// orientation otherwise. reading one of them less often than the filter steps costs less
+// than keeping it up to date.
+imu_euler_t imu_get_euler(const imu_t * imu);
+imu_mat3_t imu_get_matrix(const imu_t * imu);
+imu_mat4_t imu_get_gl_matrix(const imu_t * imu);
+imu_vec3_t imu_get_gravity(const imu_t * imu);
+imu_vec3_t imu_get_linear_acceleration(const imu_t * imu);
 
 
 ////////////////////////////////////////////
 
 
-void imu_set_accelerometer_scale_factor(imu_t * imu, float scalefactor);
+// appends orientation_quat with the timestamp of its gyro sample to history after every filter
+// step, in imu_main_loop() and imu_process_batch() alike, NULL detaches. the history must outlive
+// the attachment and is written from the thread stepping imu. copies of imu write to it as well.
+void imu_set_history(imu_t * imu, struct imu_history * history);
 
 
 ////////////////////////////////////////////
@@ -1,9 +1,10 @@
 #include "imu_algebra.h"
+#include "imu_dispatch.h"
 
 ////////////////////////////////////////////
 
 
-imu_vec3_t imu_vec3_create(float x, float y, float z)
+imu_vec3_t imu_vec3_create(imu_real_t x, imu_real_t y, imu_real_t z)
 {
     imu_vec3_t v;
     v.x = x;
@@ -43,7 +44,7 @@ imu_vec3_t imu_vec3_divide(const imu_vec3_t * v1, const imu_vec3_t * v2)
 ////////////////////////////////////////////
 
 
-float imu_vec3_dot(const imu_vec3_t * v1, const imu_vec3_t * v2)
+imu_real_t imu_vec3_dot(const imu_vec3_t * v1, const imu_vec3_t * v2)
 {
     return v1->x * v2->x + v1->y * v2->y + v1->z * v2->z;
 }
@@ -67,7 +68,7 @@ imu_vec3_t imu_vec3_cross(const imu_vec3_t * v1, const imu_vec3_t * v2)
 
 imu_vec3_t imu_vec3_normalize(const imu_vec3_t * v)
 {
-    float multiplier = imu_math_fast_inv_sqrt(v->x * v->x + v->y * v->y + v->z * v->z);
+    imu_real_t multiplier = imu_math_fast_inv_sqrt(v->x * v->x + v->y * v->y + v->z * v->z);
     return imu_vec3_create(v->x * multiplier, v->y * multiplier, v->z * multiplier);
 }
 
@@ -75,7 +76,7 @@ imu_vec3_t imu_vec3_normalize(const imu_vec3_t * v)
 ////////////////////////////////////////////
 
 
-imu_vec3_t imu_vec3_scale(const imu_vec3_t * q, float multiplier)
+imu_vec3_t imu_vec3_scale(const imu_vec3_t * q, imu_real_t multiplier)
 {
     return imu_vec3_create(q->x * multiplier, q->y * multiplier, q->z * multiplier);
 }
@@ -84,16 +85,16 @@ imu_vec3_t imu_vec3_scale(const imu_vec3_t * q, float multiplier)
 ////////////////////////////////////////////
 
 
-float imu_vec3_length(const imu_vec3_t * v)
+imu_real_t imu_vec3_length(const imu_vec3_t * v)
 {
-    return sqrt(v->x * v->x + v->y * v->y + v->z * v->z);
+    return imu_sqrt(v->x * v->x + v->y * v->y + v->z * v->z);
 }
 
 
 ////////////////////////////////////////////
 
 
-imu_quaternion_t imu_quaternion_create(float w, float x, float y, float z)
+imu_quaternion_t imu_quaternion_create(imu_real_t w, imu_real_t x, imu_real_t y, imu_real_t z)
 {
     imu_quaternion_t q;
     q.w = w;
@@ -142,8 +143,8 @@ imu_quaternion_t imu_quaternion_conjugate(const imu_quaternion_t * q)
 imu_quaternion_t imu_quaternion_inverse(const imu_quaternion_t * q)
 {
     imu_quaternion_t qcjg = imu_quaternion_conjugate(q);
-    float qcjg_len = imu_quaternion_length(&qcjg);
-    return imu_quaternion_scale(&qcjg, 1.f / (qcjg_len * qcjg_len));
+    imu_real_t qcjg_len = imu_quaternion_length(&qcjg);
+    return imu_quaternion_scale(&qcjg, IMU_R(1) / (qcjg_len * qcjg_len));
 }
 
 
@@ -152,7 +153,7 @@ imu_quaternion_t imu_quaternion_inverse(const imu_quaternion_t * q)
 
 imu_quaternion_t imu_quaternion_normalize(const imu_quaternion_t * q)
 {
-    float multiplier = imu_math_fast_inv_sqrt(q->w * q->w + q->x * q->x + q->y * q->y + q->z * q->z);
+    imu_real_t multiplier = imu_math_fast_inv_sqrt(q->w * q->w + q->x * q->x + q->y * q->y + q->z * q->z);
     return imu_quaternion_create(q->w * multiplier, q->x * multiplier, q->y * multiplier, q->z * multiplier);
 }
 
@@ -160,7 +161,7 @@ imu_quaternion_t imu_quaternion_normalize(const imu_quaternion_t * q)
 ////////////////////////////////////////////
 
 
-imu_quaternion_t imu_quaternion_scale(const imu_quaternion_t * q, float multiplier)
+imu_quaternion_t imu_quaternion_scale(const imu_quaternion_t * q, imu_real_t multiplier)
 {
     return imu_quaternion_create(q->w * multiplier, q->x * multiplier, q->y * multiplier, q->z * multiplier);
 }
@@ -171,7 +172,7 @@ imu_quaternion_t imu_quaternion_scale(const imu_quaternion_t * q, float multipli
 
 imu_vec3_t imu_quaternion_rotate_vector(const imu_quaternion_t * q, imu_vec3_t * v)
 {
-    imu_quaternion_t qv = imu_quaternion_create(0., v->x, v->y, v->z);
+    imu_quaternion_t qv = imu_quaternion_create(IMU_R(0), v->x, v->y, v->z);
     imu_quaternion_t qinv = imu_quaternion_conjugate(&qv);
     imu_quaternion_t tmp = imu_quaternion_product(q, &qv);
     imu_quaternion_t vrot = imu_quaternion_product(&tmp, &qinv);
@@ -185,9 +186,9 @@ imu_vec3_t imu_quaternion_rotate_vector(const imu_quaternion_t * q, imu_vec3_t *
 imu_euler_t imu_quaternion_to_euler(const imu_quaternion_t * q)
 {
     imu_euler_t e;
-    e.roll = atan2(2 * (q->w* q->x + q->y * q->z), 1 - 2 * (q->x * q->x + q->y * q->y));
-    e.pitch = asin(2 * (q->w * q->y - q->z * q->x));
-    e.yaw = q->z == 0 ? 0.0 : atan2(2 * (q->w * q->z + q->x * q->y), 1- 2 * (q->y * q->y + q->z * q->z));
+    e.roll = imu_atan2(2 * (q->w* q->x + q->y * q->z), 1 - 2 * (q->x * q->x + q->y * q->y));
+    e.pitch = imu_asin(2 * (q->w * q->y - q->z * q->x));
+    e.yaw = q->z == 0 ? IMU_R(0) : imu_atan2(2 * (q->w * q->z + q->x * q->y), 1- 2 * (q->y * q->y + q->z * q->z));
     return e;
 }
 
@@ -195,9 +196,129 @@ imu_euler_t imu_quaternion_to_euler(const imu_quaternion_t * q)
 ////////////////////////////////////////////
 
 
-float imu_quaternion_length(const imu_quaternion_t * q)
+imu_real_t imu_quaternion_length(const imu_quaternion_t * q)
 {
-    return sqrt(q->w * q->w + q->x * q->x + q->y * q->y + q->z * q->z);
+    return imu_sqrt(q->w * q->w + q->x * q->x + q->y * q->y + q->z * q->z);
+}
+
+
+////////////////////////////////////////////
+
+
+imu_mat3_t imu_quaternion_to_matrix3(const imu_quaternion_t * q)
+{
+    // 2 / |q|^2 instead of 2 keeps the matrix orthonormal for a quaternion slightly off unit length.
+    // products in the order of the vector kernel of imu_quaternion_to_matrices4().
+    const imu_real_t n = q->w * q->w + q->x * q->x + q->y * q->y + q->z * q->z;
+    const imu_real_t s = n > 0 ? IMU_R(2) / n : IMU_R(0);
+    const imu_real_t sx = s * q->x, sy = s * q->y, sz = s * q->z;
+    const imu_real_t xx = sx * q->x, yy = sy * q->y, zz = sz * q->z;
+    const imu_real_t xy = sx * q->y, xz = sx * q->z, yz = sy * q->z;
+    const imu_real_t wx = sx * q->w, wy = sy * q->w, wz = sz * q->w;
+
+    imu_mat3_t r;
+    r.m[0][0] = IMU_R(1) - yy - zz;
+    r.m[0][1] = xy - wz;
+    r.m[0][2] = xz + wy;
+    r.m[1][0] = xy + wz;
+    r.m[1][1] = IMU_R(1) - xx - zz;
+    r.m[1][2] = yz - wx;
+    r.m[2][0] = xz - wy;
+    r.m[2][1] = yz + wx;
+    r.m[2][2] = IMU_R(1) - xx - yy;
+    return r;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_mat4_t imu_quaternion_to_matrix4(const imu_quaternion_t * q)
+{
+    imu_mat3_t r = imu_quaternion_to_matrix3(q);
+
+    imu_mat4_t t;
+    for(int c = 0; c < 3; c++)
+    {
+        t.m[4 * c + 0] = (float)r.m[0][c];
+        t.m[4 * c + 1] = (float)r.m[1][c];
+        t.m[4 * c + 2] = (float)r.m[2][c];
+        t.m[4 * c + 3] = 0.f;
+    }
+    t.m[12] = t.m[13] = t.m[14] = 0.f;
+    t.m[15] = 1.f;
+    return t;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_quaternion_to_matrices3(const imu_quaternion_t * q, imu_mat3_t * out, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        out[i] = imu_quaternion_to_matrix3(&q[i]);
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_quaternion_to_matrices4_scalar(const imu_quaternion_t * q, imu_mat4_t * out, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        out[i] = imu_quaternion_to_matrix4(&q[i]);
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_quaternion_to_matrices4(const imu_quaternion_t * q, imu_mat4_t * out, size_t n)
+{
+    imu_kernels.quaternion_to_matrices4(q, out, n);
+}
+
+
+////////////////////////////////////////////
+
+
+imu_quaternion_t imu_quaternion_slerp(const imu_quaternion_t * a, const imu_quaternion_t * b, imu_real_t t)
+{
+    imu_real_t d = a->w * b->w + a->x * b->x + a->y * b->y + a->z * b->z;
+    imu_real_t sign = d < 0 ? IMU_R(-1) : IMU_R(1);
+    d *= sign;
+
+    // close quaternions: sin(theta) vanishes, nlerp is exact to rounding there
+    if(d > IMU_R(0.9995))
+    {
+        return imu_quaternion_nlerp(a, b, t);
+    }
+
+    imu_real_t theta = imu_acos(d);
+    imu_real_t r = IMU_R(1) / imu_sin(theta);
+    imu_real_t ka = imu_sin((1 - t) * theta) * r;
+    imu_real_t kb = imu_sin(t * theta) * r * sign;
+    imu_quaternion_t q = imu_quaternion_create(ka * a->w + kb * b->w, ka * a->x + kb * b->x, ka * a->y + kb * b->y, ka * a->z + kb * b->z);
+    return imu_quaternion_scale(&q, IMU_R(1) / imu_quaternion_length(&q));
+}
+
+
+////////////////////////////////////////////
+
+
+imu_quaternion_t imu_quaternion_nlerp(const imu_quaternion_t * a, const imu_quaternion_t * b, imu_real_t t)
+{
+    imu_real_t d = a->w * b->w + a->x * b->x + a->y * b->y + a->z * b->z;
+    imu_real_t ka = 1 - t;
+    imu_real_t kb = d < 0 ? -t : t;
+    imu_quaternion_t q = imu_quaternion_create(ka * a->w + kb * b->w, ka * a->x + kb * b->x, ka * a->y + kb * b->y, ka * a->z + kb * b->z);
+    // exact square root, the fast inverse square root is off by up to 0.2%
+    return imu_quaternion_scale(&q, IMU_R(1) / imu_quaternion_length(&q));
 }
 
 
@@ -212,4 +333,40 @@ imu_quaternion_t imu_quaternion_rotate_vector_quaternion(const imu_quaternion_t
 }
 
 
+////////////////////////////////////////////
+
+
+void imu_quaternion_rotate_vectors_unit(const imu_quaternion_t * q, const imu_vec3_t * in, imu_vec3_t * out, size_t n)
+{
+    // same rotation for every vector, so it is folded into a matrix once: 9 multiplications per vector
+    const imu_real_t ww = q->w * q->w, xx = q->x * q->x, yy = q->y * q->y, zz = q->z * q->z;
+    const imu_real_t wx = q->w * q->x, wy = q->w * q->y, wz = q->w * q->z;
+    const imu_real_t xy = q->x * q->y, xz = q->x * q->z, yz = q->y * q->z;
+
+    const imu_real_t m00 = ww + xx - yy - zz, m01 = IMU_R(2) * (xy - wz), m02 = IMU_R(2) * (xz + wy);
+    const imu_real_t m10 = IMU_R(2) * (xy + wz), m11 = ww - xx + yy - zz, m12 = IMU_R(2) * (yz - wx);
+    const imu_real_t m20 = IMU_R(2) * (xz - wy), m21 = IMU_R(2) * (yz + wx), m22 = ww - xx - yy + zz;
+
+    for(size_t i = 0; i < n; i++)
+    {
+        const imu_real_t x = in[i].x, y = in[i].y, z = in[i].z;
+        out[i].x = m00 * x + m01 * y + m02 * z;
+        out[i].y = m10 * x + m11 * y + m12 * z;
+        out[i].z = m20 * x + m21 * y + m22 * z;
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_quaternion_rotate_vectors_unit_each(const imu_quaternion_t * q, const imu_vec3_t * in, imu_vec3_t * out, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        out[i] = imu_quaternion_rotate_vector_unit(&q[i], &in[i]);
+    }
+}
+
+
 ////////////////////////////////////////////
\ No newline at end of file
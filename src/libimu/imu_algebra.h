@@ -25,6 +25,8 @@
 #ifndef IMU_ALGEBRA_H
 #define IMU_ALGEBRA_H
 
+#include <stddef.h>
+
 #include "imu_math.h"
 #include "imu_types.h"
 
@@ -35,7 +37,7 @@ extern "C" {
 ////////////////////////////////////////////
 
 
-imu_vec3_t imu_vec3_create(float x, float y, float z);
+imu_vec3_t imu_vec3_create(imu_real_t x, imu_real_t y, imu_real_t z);
 
 
 ////////////////////////////////////////////
@@ -65,19 +67,19 @@ imu_vec3_t imu_vec3_normalize(const imu_vec3_t * v);
 ////////////////////////////////////////////
 
 
-imu_vec3_t imu_vec3_scale(const imu_vec3_t * v, float multiplier);
+imu_vec3_t imu_vec3_scale(const imu_vec3_t * v, imu_real_t multiplier);
 
 
 ////////////////////////////////////////////
 
 
-float imu_vec3_length(const imu_vec3_t * v);
+imu_real_t imu_vec3_length(const imu_vec3_t * v);
 
 
 ////////////////////////////////////////////
 
 
-float imu_vec3_dot(const imu_vec3_t * v1, const imu_vec3_t * v2);
+imu_real_t imu_vec3_dot(const imu_vec3_t * v1, const imu_vec3_t * v2);
 
 
 ////////////////////////////////////////////
@@ -88,7 +90,7 @@ imu_vec3_t imu_vec3_cross(const imu_vec3_t * v1, const imu_vec3_t * v2);
 ////////////////////////////////////////////
 
 
-imu_quaternion_t imu_quaternion_create(float w, float x, float y, float z);
+imu_quaternion_t imu_quaternion_create(imu_real_t w, imu_real_t x, imu_real_t y, imu_real_t z);
 
 
 ////////////////////////////////////////////
@@ -124,7 +126,7 @@ imu_quaternion_t imu_quaternion_normalize(const imu_quaternion_t * q);
 ////////////////////////////////////////////
 
 
-imu_quaternion_t imu_quaternion_scale(const imu_quaternion_t * q, float multiplier);
+imu_quaternion_t imu_quaternion_scale(const imu_quaternion_t * q, imu_real_t multiplier);
 
 
 ////////////////////////////////////////////
@@ -142,7 +144,51 @@ imu_euler_t imu_quaternion_to_euler(const imu_quaternion_t * q);
 ////////////////////////////////////////////
 
 
-float imu_quaternion_length(const imu_quaternion_t * q);
+imu_real_t imu_quaternion_length(const imu_quaternion_t * q);
+
+
+////////////////////////////////////////////
+
+
+// rotation matrix of quaternion q, body to world. q is normalized on the way.
+imu_mat3_t imu_quaternion_to_matrix3(const imu_quaternion_t * q);
+
+
+////////////////////////////////////////////
+
+
+// same rotation as a column major 4x4 transform without translation, ready for opengl
+imu_mat4_t imu_quaternion_to_matrix4(const imu_quaternion_t * q);
+
+
+////////////////////////////////////////////
+
+
+// converts n quaternions, e.g. one per rendered body
+void imu_quaternion_to_matrices3(const imu_quaternion_t * q, imu_mat3_t * out, size_t n);
+
+
+////////////////////////////////////////////
+
+
+// converts n quaternions, four at a time on vector units (see imu_dispatch.h)
+void imu_quaternion_to_matrices4(const imu_quaternion_t * q, imu_mat4_t * out, size_t n);
+
+
+////////////////////////////////////////////
+
+
+// rotation a fraction t of the way from a to b, 0 <= t <= 1, along the shorter arc at constant
+// angular rate. result is normalized.
+imu_quaternion_t imu_quaternion_slerp(const imu_quaternion_t * a, const imu_quaternion_t * b, imu_real_t t);
+
+
+////////////////////////////////////////////
+
+
+// normalized linear interpolation, same path as imu_quaternion_slerp() without trigonometry.
+// the rate along it isn't constant: 0.0002 degrees off at most for 5 degrees between a and b, 0.03 for 30.
+imu_quaternion_t imu_quaternion_nlerp(const imu_quaternion_t * a, const imu_quaternion_t * b, imu_real_t t);
 
 
 ////////////////////////////////////////////
@@ -151,6 +197,42 @@ float imu_quaternion_length(const imu_quaternion_t * q);
 imu_quaternion_t imu_quaternion_rotate_vector_quaternion(const imu_quaternion_t * q, const imu_quaternion_t * qu);
 
 
+////////////////////////////////////////////
+
+
+// rotates v by unit quaternion q: v + 2w(u x v) + 2u x (u x v), u = (q.x, q.y, q.z).
+// 15 multiplications, no inverse. q has to be normalized. inline, a call would cost
+// about as much as the rotation.
+static inline imu_vec3_t imu_quaternion_rotate_vector_unit(const imu_quaternion_t * q, const imu_vec3_t * v)
+{
+    // t = 2 (u x v)
+    imu_real_t tx = IMU_R(2) * (q->y * v->z - q->z * v->y);
+    imu_real_t ty = IMU_R(2) * (q->z * v->x - q->x * v->z);
+    imu_real_t tz = IMU_R(2) * (q->x * v->y - q->y * v->x);
+
+    // v + w t + u x t
+    imu_vec3_t r;
+    r.x = v->x + q->w * tx + (q->y * tz - q->z * ty);
+    r.y = v->y + q->w * ty + (q->z * tx - q->x * tz);
+    r.z = v->z + q->w * tz + (q->x * ty - q->y * tx);
+    return r;
+}
+
+
+////////////////////////////////////////////
+
+
+// rotates n vectors by the same unit quaternion. in and out may be the same array.
+void imu_quaternion_rotate_vectors_unit(const imu_quaternion_t * q, const imu_vec3_t * in, imu_vec3_t * out, size_t n);
+
+
+////////////////////////////////////////////
+
+
+// rotates in[i] by unit quaternion q[i] for n pairs. in and out may be the same array.
+void imu_quaternion_rotate_vectors_unit_each(const imu_quaternion_t * q, const imu_vec3_t * in, imu_vec3_t * out, size_t n);
+
+
 ////////////////////////////////////////////
 
 #ifdef __cplusplus
@@ -0,0 +1,309 @@
+#include "imu_bank.h"
+#include "imu_dispatch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(IMU_DISPATCH_X86)
+#include <immintrin.h>
+#endif
+
+////////////////////////////////////////////
+
+
+// number of float arrays carved out of imu_bank_t::_memory
+#define IMU_BANK_ARRAYS 15
+
+
+////////////////////////////////////////////
+// scalar kernel, always available
+
+
+#define vreal_t             float
+
+#define IMU_BANK_SUFFIX     scalar
+#define IMU_BANK_TARGET
+#define IMU_BANK_LANES      1
+#define VLOAD(p)            (*(p))
+#define VSTORE(p, v)        (*(p) = (v))
+#define VSET(x)             (x)
+#define VADD(a, b)          ((a) + (b))
+#define VSUB(a, b)          ((a) - (b))
+#define VMUL(a, b)          ((a) * (b))
+#define VDIV(a, b)          ((a) / (b))
+#define VSQRT(a)            sqrtf(a)
+#define VMIN(a, b)          fminf(a, b)
+#define VMAX(a, b)          fmaxf(a, b)
+#define VABS(a)             fabsf(a)
+#define VCOPYSIGN(a, b)     copysignf(a, b)
+
+#include "imu_bank_kernel.inc"
+
+#undef vreal_t
+#undef IMU_BANK_SUFFIX
+#undef IMU_BANK_TARGET
+#undef IMU_BANK_LANES
+#undef VLOAD
+#undef VSTORE
+#undef VSET
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VMIN
+#undef VMAX
+#undef VABS
+#undef VCOPYSIGN
+
+
+////////////////////////////////////////////
+// sse4.1 kernel, 4 lanes
+
+
+#if defined(IMU_DISPATCH_X86)
+
+#define vreal_t             __m128
+#define IMU_BANK_SUFFIX     sse41
+#define IMU_BANK_TARGET     __attribute__((target("sse4.1")))
+#define IMU_BANK_LANES      4
+#define VLOAD(p)            _mm_load_ps(p)
+#define VSTORE(p, v)        _mm_store_ps(p, v)
+#define VSET(x)             _mm_set1_ps(x)
+#define VADD(a, b)          _mm_add_ps(a, b)
+#define VSUB(a, b)          _mm_sub_ps(a, b)
+#define VMUL(a, b)          _mm_mul_ps(a, b)
+#define VDIV(a, b)          _mm_div_ps(a, b)
+#define VSQRT(a)            _mm_sqrt_ps(a)
+#define VMIN(a, b)          _mm_min_ps(a, b)
+#define VMAX(a, b)          _mm_max_ps(a, b)
+#define VABS(a)             _mm_andnot_ps(_mm_set1_ps(-0.f), a)
+#define VCOPYSIGN(a, b)     _mm_or_ps(_mm_andnot_ps(_mm_set1_ps(-0.f), a), _mm_and_ps(_mm_set1_ps(-0.f), b))
+
+#include "imu_bank_kernel.inc"
+
+#undef vreal_t
+#undef IMU_BANK_SUFFIX
+#undef IMU_BANK_TARGET
+#undef IMU_BANK_LANES
+#undef VLOAD
+#undef VSTORE
+#undef VSET
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VMIN
+#undef VMAX
+#undef VABS
+#undef VCOPYSIGN
+
+#endif
+
+
+////////////////////////////////////////////
+// avx2 kernel, 8 lanes
+
+
+#if defined(IMU_DISPATCH_X86)
+
+#define vreal_t             __m256
+#define IMU_BANK_SUFFIX     avx2
+#define IMU_BANK_TARGET     __attribute__((target("avx2,fma")))
+#define IMU_BANK_LANES      8
+#define VLOAD(p)            _mm256_load_ps(p)
+#define VSTORE(p, v)        _mm256_store_ps(p, v)
+#define VSET(x)             _mm256_set1_ps(x)
+#define VADD(a, b)          _mm256_add_ps(a, b)
+#define VSUB(a, b)          _mm256_sub_ps(a, b)
+#define VMUL(a, b)          _mm256_mul_ps(a, b)
+#define VDIV(a, b)          _mm256_div_ps(a, b)
+#define VSQRT(a)            _mm256_sqrt_ps(a)
+#define VMIN(a, b)          _mm256_min_ps(a, b)
+#define VMAX(a, b)          _mm256_max_ps(a, b)
+#define VABS(a)             _mm256_andnot_ps(_mm256_set1_ps(-0.f), a)
+#define VCOPYSIGN(a, b)     _mm256_or_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.f), a), _mm256_and_ps(_mm256_set1_ps(-0.f), b))
+
+#include "imu_bank_kernel.inc"
+
+#undef vreal_t
+#undef IMU_BANK_SUFFIX
+#undef IMU_BANK_TARGET
+#undef IMU_BANK_LANES
+#undef VLOAD
+#undef VSTORE
+#undef VSET
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VMIN
+#undef VMAX
+#undef VABS
+#undef VCOPYSIGN
+
+#endif
+
+
+////////////////////////////////////////////
+// avx-512 kernel, 16 lanes
+
+
+#if defined(IMU_DISPATCH_X86)
+
+#define vreal_t             __m512
+#define IMU_BANK_SUFFIX     avx512
+#define IMU_BANK_TARGET     __attribute__((target("avx512f,avx2,fma")))
+#define IMU_BANK_LANES      16
+#define VLOAD(p)            _mm512_load_ps(p)
+#define VSTORE(p, v)        _mm512_store_ps(p, v)
+#define VSET(x)             _mm512_set1_ps(x)
+#define VADD(a, b)          _mm512_add_ps(a, b)
+#define VSUB(a, b)          _mm512_sub_ps(a, b)
+#define VMUL(a, b)          _mm512_mul_ps(a, b)
+#define VDIV(a, b)          _mm512_div_ps(a, b)
+#define VSQRT(a)            _mm512_sqrt_ps(a)
+#define VMIN(a, b)          _mm512_min_ps(a, b)
+#define VMAX(a, b)          _mm512_max_ps(a, b)
+#define VABS(a)             _mm512_abs_ps(a)
+#define VCOPYSIGN(a, b)     _mm512_castsi512_ps(_mm512_or_si512(_mm512_andnot_si512(_mm512_set1_epi32(0x80000000), _mm512_castps_si512(a)), \
+                                                _mm512_and_si512(_mm512_set1_epi32(0x80000000), _mm512_castps_si512(b))))
+
+#include "imu_bank_kernel.inc"
+
+#undef vreal_t
+#undef IMU_BANK_SUFFIX
+#undef IMU_BANK_TARGET
+#undef IMU_BANK_LANES
+#undef VLOAD
+#undef VSTORE
+#undef VSET
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VMIN
+#undef VMAX
+#undef VABS
+#undef VCOPYSIGN
+
+#endif
+
+
+////////////////////////////////////////////
+
+
+imu_bank_t imu_bank_init(size_t count)
+{
+    imu_bank_t bank;
+    memset(&bank, 0, sizeof(bank));
+
+    size_t capacity = (count + IMU_BANK_ALIGN - 1) / IMU_BANK_ALIGN * IMU_BANK_ALIGN;
+    float * mem = aligned_alloc(IMU_BANK_ALIGN * sizeof(float), IMU_BANK_ARRAYS * capacity * sizeof(float));
+    if(!mem)
+    {
+        prerr("cannot allocate imu bank of %zu imus", count);
+        return bank;
+    }
+
+    float ** arrays[IMU_BANK_ARRAYS] = {
+        &bank.gyro_raw_x, &bank.gyro_raw_y, &bank.gyro_raw_z,
+        &bank.accelerometer_raw_x, &bank.accelerometer_raw_y, &bank.accelerometer_raw_z,
+        &bank.gyro_offset_x, &bank.gyro_offset_y, &bank.gyro_offset_z,
+        &bank.scale_factor_gyro, &bank.scale_factor_accelerometer,
+        &bank.orientation_w, &bank.orientation_x, &bank.orientation_y, &bank.orientation_z,
+    };
+
+    for(size_t a = 0; a < IMU_BANK_ARRAYS; a++)
+    {
+        *arrays[a] = mem + a * capacity;
+    }
+
+    memset(mem, 0, IMU_BANK_ARRAYS * capacity * sizeof(float));
+    for(size_t i = 0; i < capacity; i++)
+    {
+        bank.orientation_w[i] = 1.f;
+    }
+
+    bank.count = count;
+    bank.capacity = capacity;
+    bank.alpha = 0.96f;
+    bank._memory = mem;
+
+    return bank;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_bank_free(imu_bank_t * bank)
+{
+    free(bank->_memory);
+    memset(bank, 0, sizeof(*bank));
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_bank_load(imu_bank_t * bank, size_t i, const imu_t * imu)
+{
+    bank->gyro_offset_x[i] = imu->gyro_offset.x;
+    bank->gyro_offset_y[i] = imu->gyro_offset.y;
+    bank->gyro_offset_z[i] = imu->gyro_offset.z;
+    bank->scale_factor_gyro[i] = imu->_scale_factor_gyro;
+    bank->scale_factor_accelerometer[i] = imu->_scale_factor_accelerometer;
+    bank->orientation_w[i] = imu->orientation_quat.w;
+    bank->orientation_x[i] = imu->orientation_quat.x;
+    bank->orientation_y[i] = imu->orientation_quat.y;
+    bank->orientation_z[i] = imu->orientation_quat.z;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_bank_store(const imu_bank_t * bank, size_t i, imu_t * imu)
+{
+    imu->orientation_quat = imu_bank_get_orientation(bank, i);
+    imu_update_outputs(imu);
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_bank_set_raw(imu_bank_t * bank, size_t i, const imu_sample_t * sample)
+{
+    bank->accelerometer_raw_x[i] = sample->ax;
+    bank->accelerometer_raw_y[i] = sample->ay;
+    bank->accelerometer_raw_z[i] = sample->az;
+    bank->gyro_raw_x[i] = sample->gx;
+    bank->gyro_raw_y[i] = sample->gy;
+    bank->gyro_raw_z[i] = sample->gz;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_quaternion_t imu_bank_get_orientation(const imu_bank_t * bank, size_t i)
+{
+    return imu_quaternion_create(bank->orientation_w[i], bank->orientation_x[i], bank->orientation_y[i], bank->orientation_z[i]);
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_bank_step(imu_bank_t * bank, float dtime)
+{
+    imu_kernels.bank_step(bank, dtime);
+}
+
+
+////////////////////////////////////////////
@@ -0,0 +1,140 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_BANK_H
+#define IMU_BANK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// lanes are allocated in multiples of this, which is the widest kernel (avx-512, 16 floats).
+#define IMU_BANK_ALIGN 16
+
+
+////////////////////////////////////////////
+
+
+// a bank of calibrated imus stored as structure of arrays, so the complementary
+// filter can be stepped over all of them with vector kernels.
+//
+// every kernel runs the same math as imu_complementary_filter(). sin, cos and acos
+// are polynomial approximations (see imu_math.h) and normalizations use an exact
+// square root instead of imu_math_fast_inv_sqrt(), so results differ from
+// imu_complementary_filter() by less than 2e-3 per quaternion component and step.
+// scalar and vector kernels agree within 1e-6.
+// per sample gyro rotations are expected to stay below 180 degrees.
+typedef struct imu_bank
+{
+    // number of imus in the bank
+    size_t count;
+
+    // number of allocated lanes, count rounded up to IMU_BANK_ALIGN. padding lanes hold identity state.
+    size_t capacity;
+
+    // raw sensor data. SET THIS USING imu_bank_set_raw()
+    float * gyro_raw_x, * gyro_raw_y, * gyro_raw_z;
+    float * accelerometer_raw_x, * accelerometer_raw_y, * accelerometer_raw_z;
+
+    // gyro calibration offsets and scale factors, copied from a calibrated imu_t by imu_bank_load()
+    float * gyro_offset_x, * gyro_offset_y, * gyro_offset_z;
+    float * scale_factor_gyro, * scale_factor_accelerometer;
+
+    // computed orientation quaternions
+    float * orientation_w, * orientation_x, * orientation_y, * orientation_z;
+
+    // complementary filter weight of the gyro estimation
+    float alpha;
+
+    // single aligned allocation backing all arrays above
+    void * _memory;
+
+} imu_bank_t;
+
+
+////////////////////////////////////////////
+
+
+// allocates a bank of count imus. on failure count of the returned bank is 0.
+imu_bank_t imu_bank_init(size_t count);
+
+
+////////////////////////////////////////////
+
+
+void imu_bank_free(imu_bank_t * bank);
+
+
+////////////////////////////////////////////
+
+
+// copies calibration, scale factors and orientation of imu into lane i.
+void imu_bank_load(imu_bank_t * bank, size_t i, const imu_t * imu);
+
+
+////////////////////////////////////////////
+
+
+// copies orientation of lane i back to imu, with the outputs it has selected (see imu_set_outputs()).
+void imu_bank_store(const imu_bank_t * bank, size_t i, imu_t * imu);
+
+
+////////////////////////////////////////////
+
+
+// sets raw sensor data of lane i. sample timestamp is not used, all lanes share dtime of imu_bank_step().
+void imu_bank_set_raw(imu_bank_t * bank, size_t i, const imu_sample_t * sample);
+
+
+////////////////////////////////////////////
+
+
+imu_quaternion_t imu_bank_get_orientation(const imu_bank_t * bank, size_t i);
+
+
+////////////////////////////////////////////
+
+
+// runs one complementary filter step on every imu in the bank.
+// kernel follows the instruction set selected in imu_dispatch.h.
+void imu_bank_step(imu_bank_t * bank, float dtime);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -44,12 +44,76 @@ extern "C" {
 #define IMU_ESTIMODE_GYRO           0x01
 #define IMU_ESTIMODE_ACCELEROMETER  0x02
 #define IMU_ESTIMODE_MAGNETOMETER   0x04
+// share of the gyro estimate the complementary filter keeps per gyro sample
+#define IMU_COMPLEMENTARY_ALPHA     0.96
+// gyro samples one accelerometer correction may stand for at most, when the accelerometer
+// runs slower than the gyro or drops out
+#define IMU_CORRECTION_MAX_STEPS    64
+
+// estimation engine, or'ed with the sensor flags. complementary filter when none is set.
+#define IMU_ESTIMODE_MADGWICK       0x10
+#define IMU_ESTIMODE_MAHONY         0x20
+#define IMU_ESTIMODE_EKF            0x40
+#define IMU_ESTIMODE_ENGINE         0x70
+
+// default gains of the engines above (see imu_set_madgwick_gain(), imu_set_mahony_gains())
+#define IMU_MADGWICK_BETA           0.1
+#define IMU_MAHONY_KP               1.0
+#define IMU_MAHONY_KI               0.5
+// engines start with their gains this many times higher, ramping down to normal in IMU_ENGINE_STARTUP seconds
+#define IMU_ENGINE_STARTUP_GAIN     10.0
+#define IMU_ENGINE_STARTUP          1.0
+// error-state kalman filter noise model and initial uncertainty (imu_ekf.h, imu_set_ekf_noise())
+#define IMU_EKF_GYRO_NOISE          0.01    // rad/s, covers integration error under fast rotation
+#define IMU_EKF_BIAS_NOISE          0.001   // rad/s per sqrt(s)
+#define IMU_EKF_ACCL_NOISE          0.02    // fraction of gravity
+#define IMU_EKF_INITIAL_ATTITUDE    0.5     // rad
+#define IMU_EKF_INITIAL_BIAS        0.02    // rad/s
+#define IMU_EKF_CONDITION           1000.0  // largest bias variance along the vertical, in tilt bias variances
+#define IMU_EKF_VARIANCE_MIN        1e-14   // floor of the covariance diagonal, rad^2 and (rad/s)^2
+
+// gyro integration over a sample period (see imu_set_integrator())
+#define IMU_INTEGRATOR_EULER        0x00    // one rotation at the latest rate
+#define IMU_INTEGRATOR_MIDPOINT     0x01    // one rotation at the mean of the last two rates
+#define IMU_INTEGRATOR_CONING       0x02    // midpoint plus two-sample coning correction
+#define IMU_INTEGRATOR_RK4          0x03    // runge-kutta on the quaternion, rate linear between the last two samples
+#define IMU_INTEGRATOR_CONING3      0x04    // rate quadratic through the last three samples, coning terms to match
+
+// output products updated after every filter step (see imu_set_outputs()), the others are
+// computed on access by imu_get_*(). the quaternion is the filter state, always there.
+#define IMU_OUTPUT_QUATERNION       0x01    // orientation_quat
+#define IMU_OUTPUT_EULER            0x02    // orientation
+#define IMU_OUTPUT_MATRIX           0x04    // orientation_matrix
+#define IMU_OUTPUT_GRAVITY          0x08    // gravity
+#define IMU_OUTPUT_LINEAR           0x10    // linear_acceleration
+#define IMU_OUTPUT_GL_MATRIX        0x20    // orientation_gl
 
 #define IMU_CALIBRATION_BUFLEN      0x3C
 #define IMU_CALIBRATION_PERIOD      0x14 // seconds
 #define IMU_CALIBRATION_DURATION    0x05
 #define IMU_UNINITIALIZED           0x98967F   
 
+// stationary detection of calibration windows
+#define IMU_STATIONARY_GYRO_STDDEV  0.5     // deg/s
+#define IMU_STATIONARY_GYRO_DRIFT   1.0     // deg/s, largest offset change a periodic calibration may commit
+#define IMU_STATIONARY_ACCL_STDDEV  0.02    // fraction of gravity
+
+// online magnetometer calibration (imu_magcal.h)
+#define IMU_MAGCAL_WINDOW           100     // samples between fits
+#define IMU_MAGCAL_FORGET           0.95    // weight older samples keep at every fit
+#define IMU_MAGCAL_MAX_ANISOTROPY   4.0     // longest over shortest ellipsoid axis
+#define IMU_MAGCAL_MIN_SPREAD       0.02    // smallest variance of calibrated samples along any axis, fraction of the field squared
+#define IMU_MAGNETOMETER_GAIN       0.5     // 1/s, heading correction rate
+#define IMU_MAGNETOMETER_REJECT     0.3     // samples deviating more than this fraction from the field strength are disturbed
+
+#define IMU_ISA_SCALAR              0x00
+#define IMU_ISA_SSE41               0x01
+#define IMU_ISA_AVX2                0x02
+#define IMU_ISA_AVX512              0x03
+
+#define IMU_INGEST_FORMAT_TEXT      0x00
+#define IMU_INGEST_FORMAT_BINARY    0x01
+
 
 ////////////////////////////////////////////
 
@@ -0,0 +1,172 @@
+#include "imu_dispatch.h"
+#include "imu_algebra.h"
+#include "imu_utils.h"
+#include "imu_math.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(IMU_DISPATCH_X86)
+#include <immintrin.h>
+#endif
+
+// 128 bit quaternion kernels need float quaternions, double builds only vectorize the bank
+#if defined(IMU_DISPATCH_X86) && !defined(IMU_REAL_DOUBLE)
+#define IMU_DISPATCH_ALGEBRA(suffix) suffix
+
+#define IMU_KERNEL_SUFFIX   sse41
+#define IMU_KERNEL_TARGET   __attribute__((target("sse4.1")))
+#include "imu_algebra_kernel.inc"
+#undef IMU_KERNEL_SUFFIX
+#undef IMU_KERNEL_TARGET
+
+#define IMU_KERNEL_SUFFIX   avx2
+#define IMU_KERNEL_TARGET   __attribute__((target("avx2,fma")))
+#include "imu_algebra_kernel.inc"
+#undef IMU_KERNEL_SUFFIX
+#undef IMU_KERNEL_TARGET
+
+#define IMU_KERNEL_SUFFIX   avx512
+#define IMU_KERNEL_TARGET   __attribute__((target("avx512f,avx2,fma")))
+#include "imu_algebra_kernel.inc"
+#undef IMU_KERNEL_SUFFIX
+#undef IMU_KERNEL_TARGET
+
+#else
+#define IMU_DISPATCH_ALGEBRA(suffix) scalar
+#endif
+
+////////////////////////////////////////////
+
+
+#define IMU_DISPATCH_CAT_(a, b) a##_##b
+#define IMU_DISPATCH_CAT(a, b) IMU_DISPATCH_CAT_(a, b)
+
+#define IMU_DISPATCH_KERNELS(isa, suffix) { \
+    isa, \
+    IMU_DISPATCH_CAT(imu_quaternion_to_matrices4, IMU_DISPATCH_ALGEBRA(suffix)), \
+    imu_bank_step_##suffix \
+}
+
+
+// indexed by IMU_ISA_*
+static const imu_kernels_t imu_dispatch_table[] = {
+    IMU_DISPATCH_KERNELS(IMU_ISA_SCALAR, scalar),
+#if defined(IMU_DISPATCH_X86)
+    IMU_DISPATCH_KERNELS(IMU_ISA_SSE41, sse41),
+    IMU_DISPATCH_KERNELS(IMU_ISA_AVX2, avx2),
+    IMU_DISPATCH_KERNELS(IMU_ISA_AVX512, avx512),
+#endif
+};
+
+
+static const char * imu_dispatch_isa_names[] = {"scalar", "sse4.1", "avx2", "avx512"};
+
+
+// scalar until imu_dispatch_init() runs at library load
+imu_kernels_t imu_kernels = IMU_DISPATCH_KERNELS(IMU_ISA_SCALAR, scalar);
+
+
+////////////////////////////////////////////
+
+
+int8_t imu_dispatch_cpu_isa(void)
+{
+#if defined(IMU_DISPATCH_X86)
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return IMU_ISA_AVX512;
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return IMU_ISA_AVX2;
+    }
+    if(__builtin_cpu_supports("sse4.1"))
+    {
+        return IMU_ISA_SSE41;
+    }
+#endif
+    return IMU_ISA_SCALAR;
+}
+
+
+////////////////////////////////////////////
+
+
+int8_t imu_dispatch_get_isa(void)
+{
+    return imu_kernels.isa;
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_dispatch_set_isa(int8_t isa)
+{
+    if(isa < IMU_ISA_SCALAR || isa > imu_dispatch_cpu_isa())
+    {
+        return -1;
+    }
+
+    imu_kernels = imu_dispatch_table[isa];
+    return 0;
+}
+
+
+////////////////////////////////////////////
+
+
+const char * imu_dispatch_isa_name(int8_t isa)
+{
+    if(isa < IMU_ISA_SCALAR || isa > IMU_ISA_AVX512)
+    {
+        return "unknown";
+    }
+
+    return imu_dispatch_isa_names[isa];
+}
+
+
+////////////////////////////////////////////
+
+
+// picks the best instruction set once, when the library is loaded.
+// IMU_ISA environment variable forces a lower one for a/b benchmarking.
+__attribute__((constructor)) static void imu_dispatch_init(void)
+{
+    int8_t isa = imu_dispatch_cpu_isa();
+    const char * forced = getenv(IMU_DISPATCH_ENV);
+
+    if(forced)
+    {
+        int8_t f = IMU_ISA_SCALAR;
+        for(; f <= IMU_ISA_AVX512; f++)
+        {
+            if(strcmp(forced, imu_dispatch_isa_names[f]) == 0)
+            {
+                break;
+            }
+        }
+
+        if(f > IMU_ISA_AVX512)
+        {
+            prwar("%s=%s is not one of scalar, sse4.1, avx2, avx512. using %s.", IMU_DISPATCH_ENV, forced, imu_dispatch_isa_names[isa]);
+        }
+        else if(f > isa)
+        {
+            prwar("%s=%s is not supported by this cpu. using %s.", IMU_DISPATCH_ENV, forced, imu_dispatch_isa_names[isa]);
+        }
+        else
+        {
+            isa = f;
+        }
+    }
+
+    imu_dispatch_set_isa(isa);
+}
+
+
+////////////////////////////////////////////
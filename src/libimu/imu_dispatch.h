@@ -0,0 +1,127 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_DISPATCH_H
+#define IMU_DISPATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imu_types.h"
+#include "imu_constants.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// vector kernels are built for every instruction set on x86 with gcc or clang,
+// everywhere else only scalar kernels exist.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMU_DISPATCH_X86 1
+#endif
+
+// environment variable to force an instruction set: scalar, sse4.1, avx2 or avx512
+#define IMU_DISPATCH_ENV "IMU_ISA"
+
+
+////////////////////////////////////////////
+
+
+struct imu_bank;
+
+
+// hot kernels of the library, one implementation per instruction set.
+// selected once when the library is loaded, see imu_dispatch_set_isa().
+// only kernels over many quaternions or imus: single quaternion primitives are
+// too little work to pay for the indirect call and are plain scalar functions.
+typedef struct imu_kernels
+{
+    // IMU_ISA_SCALAR, IMU_ISA_SSE41, IMU_ISA_AVX2 or IMU_ISA_AVX512
+    int8_t isa;
+
+    void (*quaternion_to_matrices4)(const imu_quaternion_t * q, imu_mat4_t * out, size_t n);
+    void (*bank_step)(struct imu_bank * bank, float dtime);
+
+} imu_kernels_t;
+
+
+extern imu_kernels_t imu_kernels;
+
+
+////////////////////////////////////////////
+
+
+// best instruction set supported by the cpu (and os) we are running on.
+int8_t imu_dispatch_cpu_isa(void);
+
+
+////////////////////////////////////////////
+
+
+int8_t imu_dispatch_get_isa(void);
+
+
+////////////////////////////////////////////
+
+
+// switches every kernel to isa. returns -1 if the cpu doesn't support it, 0 otherwise.
+// not thread safe, call it before imus are processed on other threads.
+int imu_dispatch_set_isa(int8_t isa);
+
+
+////////////////////////////////////////////
+
+
+const char * imu_dispatch_isa_name(int8_t isa);
+
+
+////////////////////////////////////////////
+// per instruction set implementations behind imu_kernels
+
+
+#define IMU_DISPATCH_DECLARE(suffix) \
+    void imu_quaternion_to_matrices4_##suffix(const imu_quaternion_t * q, imu_mat4_t * out, size_t n); \
+    void imu_bank_step_##suffix(struct imu_bank * bank, float dtime);
+
+IMU_DISPATCH_DECLARE(scalar)
+
+#if defined(IMU_DISPATCH_X86)
+IMU_DISPATCH_DECLARE(sse41)
+IMU_DISPATCH_DECLARE(avx2)
+IMU_DISPATCH_DECLARE(avx512)
+#endif
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
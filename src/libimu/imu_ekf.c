@@ -0,0 +1,337 @@
+#include "imu_ekf.h"
+#include "imu_algebra.h"
+#include "imu_constants.h"
+#include "imu_math.h"
+
+#include <string.h>
+
+////////////////////////////////////////////
+
+
+// 3x3 kernels on row major blocks, written out element by element
+
+// row i of a times column j of b
+#define IMU_EKF_RC(a, i, b, j) ((a)[3 * (i)] * (b)[(j)] + (a)[3 * (i) + 1] * (b)[3 + (j)] + (a)[3 * (i) + 2] * (b)[6 + (j)])
+// row i of a times row j of b
+#define IMU_EKF_RR(a, i, b, j) ((a)[3 * (i)] * (b)[3 * (j)] + (a)[3 * (i) + 1] * (b)[3 * (j) + 1] + (a)[3 * (i) + 2] * (b)[3 * (j) + 2])
+
+
+// o = a b
+static inline void imu_ekf_mul(const imu_real_t * a, const imu_real_t * b, imu_real_t * o)
+{
+    o[0] = IMU_EKF_RC(a, 0, b, 0); o[1] = IMU_EKF_RC(a, 0, b, 1); o[2] = IMU_EKF_RC(a, 0, b, 2);
+    o[3] = IMU_EKF_RC(a, 1, b, 0); o[4] = IMU_EKF_RC(a, 1, b, 1); o[5] = IMU_EKF_RC(a, 1, b, 2);
+    o[6] = IMU_EKF_RC(a, 2, b, 0); o[7] = IMU_EKF_RC(a, 2, b, 1); o[8] = IMU_EKF_RC(a, 2, b, 2);
+}
+
+
+// o = a b^T
+static inline void imu_ekf_mul_bt(const imu_real_t * a, const imu_real_t * b, imu_real_t * o)
+{
+    o[0] = IMU_EKF_RR(a, 0, b, 0); o[1] = IMU_EKF_RR(a, 0, b, 1); o[2] = IMU_EKF_RR(a, 0, b, 2);
+    o[3] = IMU_EKF_RR(a, 1, b, 0); o[4] = IMU_EKF_RR(a, 1, b, 1); o[5] = IMU_EKF_RR(a, 1, b, 2);
+    o[6] = IMU_EKF_RR(a, 2, b, 0); o[7] = IMU_EKF_RR(a, 2, b, 1); o[8] = IMU_EKF_RR(a, 2, b, 2);
+}
+
+
+// p += s a b^T
+static inline void imu_ekf_add_mul_bt(imu_real_t * p, const imu_real_t * a, const imu_real_t * b, imu_real_t s)
+{
+    p[0] += s * IMU_EKF_RR(a, 0, b, 0); p[1] += s * IMU_EKF_RR(a, 0, b, 1); p[2] += s * IMU_EKF_RR(a, 0, b, 2);
+    p[3] += s * IMU_EKF_RR(a, 1, b, 0); p[4] += s * IMU_EKF_RR(a, 1, b, 1); p[5] += s * IMU_EKF_RR(a, 1, b, 2);
+    p[6] += s * IMU_EKF_RR(a, 2, b, 0); p[7] += s * IMU_EKF_RR(a, 2, b, 1); p[8] += s * IMU_EKF_RR(a, 2, b, 2);
+}
+
+
+// o = a b^T + s c d^T for symmetric results, upper triangle mirrored
+static inline void imu_ekf_mul_bt_sym(const imu_real_t * a, const imu_real_t * b, const imu_real_t * c, const imu_real_t * d, imu_real_t s, imu_real_t * o)
+{
+    o[0] = IMU_EKF_RR(a, 0, b, 0) + s * IMU_EKF_RR(c, 0, d, 0);
+    o[1] = o[3] = IMU_EKF_RR(a, 0, b, 1) + s * IMU_EKF_RR(c, 0, d, 1);
+    o[2] = o[6] = IMU_EKF_RR(a, 0, b, 2) + s * IMU_EKF_RR(c, 0, d, 2);
+    o[4] = IMU_EKF_RR(a, 1, b, 1) + s * IMU_EKF_RR(c, 1, d, 1);
+    o[5] = o[7] = IMU_EKF_RR(a, 1, b, 2) + s * IMU_EKF_RR(c, 1, d, 2);
+    o[8] = IMU_EKF_RR(a, 2, b, 2) + s * IMU_EKF_RR(c, 2, d, 2);
+}
+
+
+// p = (p + p^T) / 2, rounding would otherwise let the blocks drift apart from symmetric
+static inline void imu_ekf_symmetrize(imu_real_t * p)
+{
+    p[1] = p[3] = (p[1] + p[3]) * IMU_R(0.5);
+    p[2] = p[6] = (p[2] + p[6]) * IMU_R(0.5);
+    p[5] = p[7] = (p[5] + p[7]) * IMU_R(0.5);
+}
+
+
+////////////////////////////////////////////
+
+
+imu_ekf_t imu_ekf_init(void)
+{
+    imu_ekf_t ekf;
+    memset(&ekf, 0, sizeof(ekf));
+
+    ekf.bias = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+    ekf.gyro_noise = IMU_R(IMU_EKF_GYRO_NOISE);
+    ekf.bias_noise = IMU_R(IMU_EKF_BIAS_NOISE);
+    ekf.accelerometer_noise = IMU_R(IMU_EKF_ACCL_NOISE);
+
+    const imu_real_t att = IMU_R(IMU_EKF_INITIAL_ATTITUDE) * IMU_R(IMU_EKF_INITIAL_ATTITUDE);
+    const imu_real_t bias = IMU_R(IMU_EKF_INITIAL_BIAS) * IMU_R(IMU_EKF_INITIAL_BIAS);
+    // heading can't be seen by the accelerometer, starting level only the tilt is uncertain.
+    // any heading prior would let the first corrections turn the unobserved axis instead.
+    ekf._ptt[0] = ekf._ptt[4] = att;
+    ekf._pbb[0] = ekf._pbb[4] = ekf._pbb[8] = bias;
+
+    return ekf;
+}
+
+
+////////////////////////////////////////////
+
+
+// nominal state and covariance forward by one gyro sample. attitude error lives in the body
+// frame, q_true = q * dq, so d(err)/dt = -w x err - bias error:
+// F = [[A, -dt I], [0, I]] with A = I - [w]x dt.
+static void imu_ekf_predict(imu_ekf_t * ekf, imu_quaternion_t * q, imu_real_t wx, imu_real_t wy, imu_real_t wz, imu_real_t dtime)
+{
+    // first order quaternion step renormalized with one newton iteration, like the other engines
+    const imu_real_t h = dtime * IMU_R(0.5);
+    imu_real_t w = q->w + (-q->x * wx - q->y * wy - q->z * wz) * h;
+    imu_real_t x = q->x + ( q->w * wx + q->y * wz - q->z * wy) * h;
+    imu_real_t y = q->y + ( q->w * wy - q->x * wz + q->z * wx) * h;
+    imu_real_t z = q->z + ( q->w * wz + q->x * wy - q->y * wx) * h;
+    imu_real_t k = (IMU_R(3) - (w * w + x * x + y * y + z * z)) * IMU_R(0.5);
+    *q = imu_quaternion_create(w * k, x * k, y * k, z * k);
+
+    const imu_real_t a[9] = {
+        IMU_R(1), wz * dtime, -wy * dtime,
+        -wz * dtime, IMU_R(1), wx * dtime,
+        wy * dtime, -wx * dtime, IMU_R(1),
+    };
+
+    imu_real_t t[9], n[9];
+    imu_ekf_mul(a, ekf->_ptt, t);
+    imu_ekf_mul(a, ekf->_ptb, n);
+
+    // Ptt' = A Ptt A^T - dt (N + N^T) + dt^2 Pbb + Q, N = A Ptb
+    imu_real_t * ptt = ekf->_ptt;
+    imu_ekf_mul_bt(t, a, ptt);
+    const imu_real_t dt2 = dtime * dtime;
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            ptt[3 * i + j] += dt2 * ekf->_pbb[3 * i + j] - dtime * (n[3 * i + j] + n[3 * j + i]);
+        }
+    }
+    const imu_real_t qa = ekf->gyro_noise * ekf->gyro_noise * dtime;
+    ptt[0] += qa;
+    ptt[4] += qa;
+    ptt[8] += qa;
+    imu_ekf_symmetrize(ptt);
+
+    // Ptb' = N - dt Pbb, Pbb' = Pbb + Q
+    for(int i = 0; i < 9; i++)
+    {
+        ekf->_ptb[i] = n[i] - dtime * ekf->_pbb[i];
+    }
+    const imu_real_t qb = ekf->bias_noise * ekf->bias_noise * dtime;
+    ekf->_pbb[0] += qb;
+    ekf->_pbb[4] += qb;
+    ekf->_pbb[8] += qb;
+}
+
+
+////////////////////////////////////////////
+
+
+// gravity measurement: h(q) = R^T up, H = [[v]x 0] for v = h(q)
+static void imu_ekf_update(imu_ekf_t * ekf, imu_quaternion_t * q, const imu_vec3_t * accelerometer)
+{
+    imu_real_t n2 = imu_vec3_dot(accelerometer, accelerometer);
+    if(n2 <= 0)
+    {
+        return;
+    }
+
+    imu_real_t r = 1 / imu_sqrt(n2);
+    const imu_real_t ax = accelerometer->x * r, ay = accelerometer->y * r, az = accelerometer->z * r;
+
+    const imu_real_t vx = IMU_R(2) * (q->x * q->z - q->w * q->y);
+    const imu_real_t vy = IMU_R(2) * (q->w * q->x + q->y * q->z);
+    const imu_real_t vz = IMU_R(1) - IMU_R(2) * (q->x * q->x + q->y * q->y);
+    const imu_real_t v[9] = {
+        IMU_R(0), -vz, vy,
+        vz, IMU_R(0), -vx,
+        -vy, vx, IMU_R(0),
+    };
+
+    // P H^T, attitude and bias rows
+    imu_real_t pht[9], phb[9];
+    imu_ekf_mul_bt(ekf->_ptt, v, pht);
+    // Pbt V^T = (V Ptb)^T
+    imu_real_t vptb[9];
+    imu_ekf_mul(v, ekf->_ptb, vptb);
+    phb[0] = vptb[0]; phb[1] = vptb[3]; phb[2] = vptb[6];
+    phb[3] = vptb[1]; phb[4] = vptb[4]; phb[5] = vptb[7];
+    phb[6] = vptb[2]; phb[7] = vptb[5]; phb[8] = vptb[8];
+
+    // S = V Ptt V^T + R
+    imu_real_t s[9];
+    imu_ekf_mul(v, pht, s);
+    const imu_real_t rn = ekf->accelerometer_noise * ekf->accelerometer_noise;
+    s[0] += rn;
+    s[4] += rn;
+    s[8] += rn;
+
+    // S^-1, symmetric, by cofactors
+    const imu_real_t c0 = s[4] * s[8] - s[5] * s[7];
+    const imu_real_t c1 = s[2] * s[7] - s[1] * s[8];
+    const imu_real_t c2 = s[1] * s[5] - s[2] * s[4];
+    const imu_real_t det = s[0] * c0 + s[3] * c1 + s[6] * c2;
+    if(det <= 0)
+    {
+        return;
+    }
+    const imu_real_t id = 1 / det;
+    const imu_real_t si[9] = {
+        c0 * id, c1 * id, c2 * id,
+        c1 * id, (s[0] * s[8] - s[2] * s[6]) * id, (s[2] * s[3] - s[0] * s[5]) * id,
+        c2 * id, (s[2] * s[3] - s[0] * s[5]) * id, (s[0] * s[4] - s[1] * s[3]) * id,
+    };
+
+    imu_real_t kt[9], kb[9];
+    imu_ekf_mul(pht, si, kt);
+    imu_ekf_mul(phb, si, kb);
+
+    // error state from the innovation
+    const imu_real_t ex = ax - vx, ey = ay - vy, ez = az - vz;
+    const imu_real_t dx = kt[0] * ex + kt[1] * ey + kt[2] * ez;
+    const imu_real_t dy = kt[3] * ex + kt[4] * ey + kt[5] * ez;
+    const imu_real_t dz = kt[6] * ex + kt[7] * ey + kt[8] * ez;
+    ekf->bias.x += kb[0] * ex + kb[1] * ey + kb[2] * ez;
+    ekf->bias.y += kb[3] * ex + kb[4] * ey + kb[5] * ez;
+    ekf->bias.z += kb[6] * ex + kb[7] * ey + kb[8] * ez;
+
+    // joseph form, P = (I - K H) P (I - K H)^T + K R K^T. P -= K H P loses positive definiteness
+    // in float once the process noise falls below the resolution of P. with L = I - K H blocks
+    // Lt = I - Kt V and Lb = -Kb V:
+    // Ptt' = Lt Ptt Lt^T + r Kt Kt^T
+    // Ptb' = Lt Ptt Lb^T + Lt Ptb + r Kt Kb^T
+    // Pbb' = Lb Ptt Lb^T + Lb Ptb + (Lb Ptb)^T + Pbb + r Kb Kb^T
+    // worked on in locals, the compiler can't keep the blocks in registers through ekf.
+    // rows of K V are the rows of K crossed with v
+    imu_real_t lt[9], lb[9];
+    for(int i = 0; i < 9; i += 3)
+    {
+        lt[i] = kt[i + 2] * vy - kt[i + 1] * vz;
+        lt[i + 1] = kt[i] * vz - kt[i + 2] * vx;
+        lt[i + 2] = kt[i + 1] * vx - kt[i] * vy;
+        lb[i] = kb[i + 2] * vy - kb[i + 1] * vz;
+        lb[i + 1] = kb[i] * vz - kb[i + 2] * vx;
+        lb[i + 2] = kb[i + 1] * vx - kb[i] * vy;
+    }
+    lt[0] += IMU_R(1);
+    lt[4] += IMU_R(1);
+    lt[8] += IMU_R(1);
+
+    imu_real_t ltpt[9], lbpt[9], ltpb[9], lbpb[9];
+    imu_ekf_mul(lt, ekf->_ptt, ltpt);
+    imu_ekf_mul(lb, ekf->_ptt, lbpt);
+    imu_ekf_mul(lt, ekf->_ptb, ltpb);
+    imu_ekf_mul(lb, ekf->_ptb, lbpb);
+
+    imu_real_t ptt[9], ptb[9], pbb[9];
+    imu_ekf_mul_bt_sym(ltpt, lt, kt, kt, rn, ptt);
+    imu_ekf_mul_bt_sym(lbpt, lb, kb, kb, rn, pbb);
+    imu_ekf_mul_bt(ltpt, lb, ptb);
+    imu_ekf_add_mul_bt(ptb, kt, kb, rn);
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            ptb[3 * i + j] += ltpb[3 * i + j];
+            pbb[3 * i + j] += ekf->_pbb[3 * i + j] + lbpb[3 * i + j] + lbpb[3 * j + i];
+        }
+    }
+
+    // the heading error, along v in the body frame, is never seen by gravity and never turns
+    // into tilt. left in, its variance grows with the bias uncertainty times t^2 and swamps the
+    // tilt block in float, so it is dropped: Ptt = M Ptt M, Ptb = M Ptb with M = I - v v^T.
+    const imu_real_t u[3] = {vx, vy, vz};
+    imu_real_t pu[3], ub[3];
+    for(int i = 0; i < 3; i++)
+    {
+        pu[i] = ptt[3 * i] * vx + ptt[3 * i + 1] * vy + ptt[3 * i + 2] * vz;
+        ub[i] = ptb[i] * vx + ptb[3 + i] * vy + ptb[6 + i] * vz;
+    }
+    const imu_real_t upu = pu[0] * vx + pu[1] * vy + pu[2] * vz;
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            ptt[3 * i + j] += upu * u[i] * u[j] - pu[i] * u[j] - u[i] * pu[j];
+            ptb[3 * i + j] -= u[i] * ub[j];
+        }
+    }
+
+    // the bias along v is unseen until the sensor turns, and would keep its initial variance
+    // while the tilt axes converge. past IMU_EKF_CONDITION times the tilt axes float can no longer
+    // tell them apart, so it is scaled down there: Pbb = T Pbb T, Ptb = Ptb T, T = I + (g - 1) v v^T.
+    imu_real_t pb[3], tb[3];
+    for(int i = 0; i < 3; i++)
+    {
+        pb[i] = pbb[3 * i] * vx + pbb[3 * i + 1] * vy + pbb[3 * i + 2] * vz;
+        tb[i] = ptb[3 * i] * vx + ptb[3 * i + 1] * vy + ptb[3 * i + 2] * vz;
+    }
+    const imu_real_t sb = pb[0] * vx + pb[1] * vy + pb[2] * vz;
+    const imu_real_t cb = (pbb[0] + pbb[4] + pbb[8] - sb) * IMU_R(0.5 * IMU_EKF_CONDITION);
+    if(sb > cb)
+    {
+        const imu_real_t g = imu_sqrt(cb / sb) - 1;
+        for(int i = 0; i < 3; i++)
+        {
+            for(int j = 0; j < 3; j++)
+            {
+                pbb[3 * i + j] += g * (pb[i] * u[j] + u[i] * pb[j]) + g * g * sb * u[i] * u[j];
+                ptb[3 * i + j] += g * tb[i] * u[j];
+            }
+        }
+    }
+
+    imu_ekf_symmetrize(ptt);
+    imu_ekf_symmetrize(pbb);
+    // rounding can still push a variance to or below zero
+    for(int i = 0; i < 9; i += 4)
+    {
+        ptt[i] = ptt[i] < IMU_R(IMU_EKF_VARIANCE_MIN) ? IMU_R(IMU_EKF_VARIANCE_MIN) : ptt[i];
+        pbb[i] = pbb[i] < IMU_R(IMU_EKF_VARIANCE_MIN) ? IMU_R(IMU_EKF_VARIANCE_MIN) : pbb[i];
+    }
+    memcpy(ekf->_ptt, ptt, sizeof(ptt));
+    memcpy(ekf->_ptb, ptb, sizeof(ptb));
+    memcpy(ekf->_pbb, pbb, sizeof(pbb));
+
+    // injecting the attitude error, q = q * (1, d / 2). early corrections can be large, so
+    // this one is normalized exactly.
+    imu_real_t w = q->w - (q->x * dx + q->y * dy + q->z * dz) * IMU_R(0.5);
+    imu_real_t x = q->x + (q->w * dx + q->y * dz - q->z * dy) * IMU_R(0.5);
+    imu_real_t y = q->y + (q->w * dy - q->x * dz + q->z * dx) * IMU_R(0.5);
+    imu_real_t z = q->z + (q->w * dz + q->x * dy - q->y * dx) * IMU_R(0.5);
+    imu_real_t l = 1 / imu_sqrt(w * w + x * x + y * y + z * z);
+    *q = imu_quaternion_create(w * l, x * l, y * l, z * l);
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_ekf_step(imu_ekf_t * ekf, imu_quaternion_t * q, const imu_vec3_t * gyro, const imu_vec3_t * accelerometer, imu_real_t dtime)
+{
+    imu_ekf_predict(ekf, q, gyro->x - ekf->bias.x, gyro->y - ekf->bias.y, gyro->z - ekf->bias.z, dtime);
+    imu_ekf_update(ekf, q, accelerometer);
+}
+
+
+////////////////////////////////////////////
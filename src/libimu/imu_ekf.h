@@ -0,0 +1,85 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_EKF_H
+#define IMU_EKF_H
+
+#include "imu_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// error-state kalman filter over attitude error (3, rad) and gyro bias (3, rad/s) of a
+// nominal quaternion. the 6x6 covariance is kept as 3x3 blocks and every product is written
+// out for exactly this layout: no generic matrix code, no allocation, all on the stack.
+// the accelerometer measurement only touches the attitude block (H = [[g]x 0]).
+// the covariance update is in joseph form and leaves out the heading error, which gravity
+// never sees, so it stays positive definite in float.
+typedef struct imu_ekf
+{
+    // gyro bias estimate in sensor frame, rad/s
+    imu_vec3_t bias;
+
+    // noise model: gyro white noise (rad/s), bias random walk (rad/s per sqrt(s)),
+    // accelerometer white noise (fraction of gravity)
+    imu_real_t gyro_noise;
+    imu_real_t bias_noise;
+    imu_real_t accelerometer_noise;
+
+    // covariance blocks, row major: attitude, attitude x bias, bias
+    imu_real_t _ptt[9];
+    imu_real_t _ptb[9];
+    imu_real_t _pbb[9];
+
+} imu_ekf_t;
+
+
+////////////////////////////////////////////
+
+
+// zero bias, IMU_EKF_* noise. attitude starts uncertain enough to take over any initial tilt.
+imu_ekf_t imu_ekf_init(void);
+
+
+////////////////////////////////////////////
+
+
+// one predict (gyro, rad/s) and update (accelerometer, any unit) step of orientation q.
+// a zero accelerometer vector skips the update.
+void imu_ekf_step(imu_ekf_t * ekf, imu_quaternion_t * q, const imu_vec3_t * gyro, const imu_vec3_t * accelerometer, imu_real_t dtime);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
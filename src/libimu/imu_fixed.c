@@ -0,0 +1,473 @@
+#include "imu_fixed.h"
+#include "imu_utils.h"
+#include "imu_algebra.h"
+
+////////////////////////////////////////////
+
+
+static int16_t const CALIB_COUNTER_MAX = 200;
+
+// pi in Q1.30, needs 64 bits
+#define IMU_FIXED_PI                    3373259426LL
+
+// half angle in radians per deg/s and nanosecond (pi / 360e9), Q68
+#define IMU_FIXED_HALF_D2R_NS_Q68       2575651363LL
+
+// half of (1 - alpha), alpha = 0.96 as in imu_complementary_filter()
+#define IMU_FIXED_HALF_ONE_MINUS_ALPHA  IMU_FIXED_Q30(0.02)
+
+// longest step integrated at once, keeps every product below 2^63
+#define IMU_FIXED_DTIME_MAX_US          1000000u
+
+// rounded Q1.30 result of a 64 bit product or sum of products
+#define IMU_FIXED_ROUND30(v)            ((int32_t)(((v) + ((int64_t)1 << 29)) >> 30))
+
+// arccos polynomial of Abramowitz & Stegun 4.4.46 in Q1.30
+static const int32_t imu_fixed_acos_coeffs[8] = {
+    1686629690, -230423709, 95540460, -53874249, 33169905, -18348235, 7161955, -1355589,
+};
+
+// 1/sqrt(m) in Q1.30 at the middle of [1 + i/8, 1 + (i+1)/8), initial guess of imu_fixed_rsqrt()
+static const imu_q30_t imu_fixed_rsqrt_table[24] = {
+    1041682578, 985333074, 937238702, 895562589, 858993459, 826566842,
+    797555404, 771398898, 747657839, 725981977, 706088274, 687745184,
+    670761200, 654976372, 640255922, 626485368, 613566757, 601415717,
+    589959130, 579133272, 568882316, 559157115, 549914212, 541115017,
+};
+
+
+////////////////////////////////////////////
+
+
+imu_fixed_t imu_fixed_init(uint8_t calibration_mode, imu_q30_t scale_factor_gyro)
+{
+    imu_fixed_t imu;
+
+    imu_fixed_set_state(&imu, IMU_STATE_UNCALIBRATED);
+    imu_fixed_set_calibration_mode(&imu, calibration_mode);
+    imu_fixed_set_gyro_scale_factor(&imu, scale_factor_gyro);
+
+    imu.gyro.x = imu.gyro.y = imu.gyro.z = 0;
+    imu.gyro_offset = imu.accelerometer_offset = imu.gyro_raw = imu.accelerometer_raw = imu.gyro;
+
+    imu.orientation_quat.w = IMU_FIXED_Q30_ONE;
+    imu.orientation_quat.x = imu.orientation_quat.y = imu.orientation_quat.z = 0;
+
+    imu._gyro_ts = 0;
+    imu._calibration_time = 0;
+    imu._odr_period = 0;
+    imu._calibration_counter = 0;
+
+    return imu;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_q30_t imu_fixed_rsqrt(uint64_t x, int8_t * shift)
+{
+    if(x == 0)
+    {
+        *shift = 0;
+        return 0;
+    }
+
+    // x = m * 2^d, d even and m in [2^60, 2^62), so m is M in [1, 4) in Q60
+    int d = (63 - __builtin_clzll(x)) - 60;
+    d -= d & 1;
+    uint64_t m = d >= 0 ? x >> d : x << -d;
+    int64_t m30 = (int64_t)(m >> 30);
+
+    // table is good to 3%, three newton steps r = r * (3 - M * r^2) / 2 take it to rounding
+    int64_t r = imu_fixed_rsqrt_table[(m >> 57) - 8];
+    for(int i = 0; i < 3; i++)
+    {
+        int64_t mr2 = (m30 * ((r * r) >> 30)) >> 30;
+        r = (r * ((3LL << 30) - mr2)) >> 31;
+    }
+
+    // 1/sqrt(x) = 1/sqrt(M) * 2^(-30 - d/2) and r = 2^30 / sqrt(M)
+    *shift = (int8_t)(60 + d / 2);
+    return (imu_q30_t)r;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_fixed_quaternion_t imu_fixed_quaternion_product(const imu_fixed_quaternion_t * q1, const imu_fixed_quaternion_t * q2)
+{
+    imu_fixed_quaternion_t q;
+    q.w = IMU_FIXED_ROUND30((int64_t)q1->w * q2->w - (int64_t)q1->x * q2->x - (int64_t)q1->y * q2->y - (int64_t)q1->z * q2->z);
+    q.x = IMU_FIXED_ROUND30((int64_t)q1->w * q2->x + (int64_t)q1->x * q2->w + (int64_t)q1->y * q2->z - (int64_t)q1->z * q2->y);
+    q.y = IMU_FIXED_ROUND30((int64_t)q1->w * q2->y - (int64_t)q1->x * q2->z + (int64_t)q1->y * q2->w + (int64_t)q1->z * q2->x);
+    q.z = IMU_FIXED_ROUND30((int64_t)q1->w * q2->z + (int64_t)q1->x * q2->y - (int64_t)q1->y * q2->x + (int64_t)q1->z * q2->w);
+    return q;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_fixed_quaternion_t imu_fixed_quaternion_normalize(const imu_fixed_quaternion_t * q)
+{
+    int8_t shift;
+    imu_q30_t r = imu_fixed_rsqrt((uint64_t)((int64_t)q->w * q->w + (int64_t)q->x * q->x + (int64_t)q->y * q->y + (int64_t)q->z * q->z), &shift);
+
+    imu_fixed_quaternion_t n;
+    n.w = (int32_t)(((int64_t)q->w * r) >> (shift - 30));
+    n.x = (int32_t)(((int64_t)q->x * r) >> (shift - 30));
+    n.y = (int32_t)(((int64_t)q->y * r) >> (shift - 30));
+    n.z = (int32_t)(((int64_t)q->z * r) >> (shift - 30));
+    return n;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_fixed_quaternion_t imu_fixed_quaternion_from_half_rotation(const imu_fixed_vec3_t * h)
+{
+    // a^2, a^4, a^6 of the half angle a = |h|, no square root needed
+    int64_t a2 = IMU_FIXED_ROUND30((int64_t)h->x * h->x + (int64_t)h->y * h->y + (int64_t)h->z * h->z);
+    int64_t a4 = IMU_FIXED_ROUND30(a2 * a2);
+    int64_t a6 = IMU_FIXED_ROUND30(a4 * a2);
+
+    // cos(a) and sin(a) / a
+    int64_t c = IMU_FIXED_Q30_ONE - a2 / 2 + a4 / 24 - a6 / 720;
+    int64_t s = IMU_FIXED_Q30_ONE - a2 / 6 + a4 / 120 - a6 / 5040;
+
+    imu_fixed_quaternion_t q;
+    q.w = (imu_q30_t)c;
+    q.x = IMU_FIXED_ROUND30(h->x * s);
+    q.y = IMU_FIXED_ROUND30(h->y * s);
+    q.z = IMU_FIXED_ROUND30(h->z * s);
+    return q;
+}
+
+
+////////////////////////////////////////////
+
+
+// arccos polynomial, acos(x) = sqrt(1 - x) * p(x) for x in [0, 1]. Q1.30.
+static int64_t imu_fixed_acos_poly(int64_t x)
+{
+    int64_t p = imu_fixed_acos_coeffs[7];
+    for(int i = 6; i >= 0; i--)
+    {
+        p = IMU_FIXED_ROUND30(p * x) + imu_fixed_acos_coeffs[i];
+    }
+    return p;
+}
+
+
+////////////////////////////////////////////
+
+
+// q * (3 - |q|^2) / 2, one newton step of 1/|q| from 1. enough for products of unit quaternions.
+static imu_fixed_quaternion_t imu_fixed_quaternion_renormalize(const imu_fixed_quaternion_t * q)
+{
+    int64_t f = (3LL << 30) - IMU_FIXED_ROUND30((int64_t)q->w * q->w + (int64_t)q->x * q->x + (int64_t)q->y * q->y + (int64_t)q->z * q->z);
+
+    imu_fixed_quaternion_t n;
+    n.w = (int32_t)((q->w * f + ((int64_t)1 << 30)) >> 31);
+    n.x = (int32_t)((q->x * f + ((int64_t)1 << 30)) >> 31);
+    n.y = (int32_t)((q->y * f + ((int64_t)1 << 30)) >> 31);
+    n.z = (int32_t)((q->z * f + ((int64_t)1 << 30)) >> 31);
+    return n;
+}
+
+
+////////////////////////////////////////////
+
+
+static void imu_fixed_calibrate(imu_fixed_t * imu)
+{
+    if(imu->_calibration_counter++ < CALIB_COUNTER_MAX)
+    {
+        // raw counts are summed up as integers, 200 samples of 16 bit sensors fit easily
+        imu->accelerometer_offset.x += imu->accelerometer_raw.x;
+        imu->accelerometer_offset.y += imu->accelerometer_raw.y;
+        imu->accelerometer_offset.z += imu->accelerometer_raw.z;
+
+        imu->gyro_offset.x += imu->gyro_raw.x;
+        imu->gyro_offset.y += imu->gyro_raw.y;
+        imu->gyro_offset.z += imu->gyro_raw.z;
+    }
+    else
+    {
+        // averages in Q16.16, so offsets keep a fraction of a count
+        imu->accelerometer_offset.x = (int32_t)(((int64_t)imu->accelerometer_offset.x << 16) / CALIB_COUNTER_MAX);
+        imu->accelerometer_offset.y = (int32_t)(((int64_t)imu->accelerometer_offset.y << 16) / CALIB_COUNTER_MAX);
+        imu->accelerometer_offset.z = (int32_t)(((int64_t)imu->accelerometer_offset.z << 16) / CALIB_COUNTER_MAX);
+
+        imu->gyro_offset.x = (int32_t)(((int64_t)imu->gyro_offset.x << 16) / CALIB_COUNTER_MAX);
+        imu->gyro_offset.y = (int32_t)(((int64_t)imu->gyro_offset.y << 16) / CALIB_COUNTER_MAX);
+        imu->gyro_offset.z = (int32_t)(((int64_t)imu->gyro_offset.z << 16) / CALIB_COUNTER_MAX);
+
+        imu->_calibration_counter = 0;
+        imu_fixed_set_state(imu, IMU_STATE_READY);
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+// same steps as imu_complementary_filter(). dtime in nanoseconds.
+static void imu_fixed_complementary_filter(imu_fixed_t * imu, uint32_t dtime)
+{
+    // gyro rates in deg/s, Q16.16
+    imu->gyro.x = (int32_t)(((((int64_t)imu->gyro_raw.x << 16) - imu->gyro_offset.x) * imu->_scale_factor_gyro) >> 30);
+    imu->gyro.y = (int32_t)(((((int64_t)imu->gyro_raw.y << 16) - imu->gyro_offset.y) * imu->_scale_factor_gyro) >> 30);
+    imu->gyro.z = (int32_t)(((((int64_t)imu->gyro_raw.z << 16) - imu->gyro_offset.z) * imu->_scale_factor_gyro) >> 30);
+
+    ////////////////////////////////////////////
+    // gyro integration
+    ////////////////////////////////////////////
+
+    // half angle in radians per deg/s of rate for this step, Q40
+    int64_t k = ((int64_t)dtime * IMU_FIXED_HALF_D2R_NS_Q68) >> 28;
+
+    // half rotation vector, Q1.30. a long step at a high rate can take the half angle past 2 rad,
+    // out of int32, and the series of imu_fixed_quaternion_from_half_rotation() is only exact
+    // to 0.25 rad, so the step is split into n equal rotations of at most that much.
+    int64_t hx = (imu->gyro.x * k + ((int64_t)1 << 25)) >> 26;
+    int64_t hy = (imu->gyro.y * k + ((int64_t)1 << 25)) >> 26;
+    int64_t hz = (imu->gyro.z * k + ((int64_t)1 << 25)) >> 26;
+    int64_t m = hx < 0 ? -hx : hx;
+    m = hy > m ? hy : -hy > m ? -hy : m;
+    m = hz > m ? hz : -hz > m ? -hz : m;
+    // |h| <= sqrt(3) m < 7 m / 4, so n > 7 m keeps |h| / n below 0.25 (m in Q1.30)
+    int64_t n = 1 + ((7 * m) >> 30);
+
+    if(n > 1)
+    {
+        hx /= n;
+        hy /= n;
+        hz /= n;
+    }
+
+    imu_fixed_vec3_t h;
+    h.x = (int32_t)hx;
+    h.y = (int32_t)hy;
+    h.z = (int32_t)hz;
+
+    // instantaneous rotation quaternion
+    imu_fixed_quaternion_t rotation = imu_fixed_quaternion_from_half_rotation(&h);
+    // integrated gyro quaternion
+    imu_fixed_quaternion_t qw = imu_fixed_quaternion_product(&imu->orientation_quat, &rotation);
+    for(int64_t i = 1; i < n; i++)
+    {
+        qw = imu_fixed_quaternion_product(&qw, &rotation);
+    }
+
+    ////////////////////////////////////////////
+    // complementary filter
+    ////////////////////////////////////////////
+
+    int8_t shift;
+    const imu_fixed_vec3_t * ar = &imu->accelerometer_raw;
+    imu_q30_t r = imu_fixed_rsqrt((uint64_t)((int64_t)ar->x * ar->x + (int64_t)ar->y * ar->y + (int64_t)ar->z * ar->z), &shift);
+    if(r == 0)
+    {
+        // no gravity reading, gyro only
+        imu->orientation_quat = imu_fixed_quaternion_renormalize(&qw);
+        return;
+    }
+
+    // unit accelerometer vector, Q1.30
+    int64_t ax = ((int64_t)ar->x * r) >> (shift - 30);
+    int64_t ay = ((int64_t)ar->y * r) >> (shift - 30);
+    int64_t az = ((int64_t)ar->z * r) >> (shift - 30);
+
+    // gravity vector rotated to world space: a + 2w(u x a) + u x 2(u x a), u = (qw.x, qw.y, qw.z)
+    int64_t tx = (qw.y * az - qw.z * ay + ((int64_t)1 << 28)) >> 29;
+    int64_t ty = (qw.z * ax - qw.x * az + ((int64_t)1 << 28)) >> 29;
+    int64_t tz = (qw.x * ay - qw.y * ax + ((int64_t)1 << 28)) >> 29;
+    int64_t vx = ax + IMU_FIXED_ROUND30(qw.w * tx + qw.y * tz - qw.z * ty);
+    int64_t vy = ay + IMU_FIXED_ROUND30(qw.w * ty + qw.z * tx - qw.x * tz);
+    int64_t vz = az + IMU_FIXED_ROUND30(qw.w * tz + qw.x * ty - qw.y * tx);
+
+    // unit vector rotated by a unit quaternion, one newton step keeps it unit
+    int64_t f = (3LL << 30) - IMU_FIXED_ROUND30(vx * vx + vy * vy + vz * vz);
+    vx = (vx * f + ((int64_t)1 << 30)) >> 31;
+    vy = (vy * f + ((int64_t)1 << 30)) >> 31;
+    vz = (vz * f + ((int64_t)1 << 30)) >> 31;
+    vz = vz > IMU_FIXED_Q30_ONE ? IMU_FIXED_Q30_ONE : vz < -IMU_FIXED_Q30_ONE ? -IMU_FIXED_Q30_ONE : vz;
+
+    // half rotation vector of the tilt correction: unit tilt axis (vy, -vx, 0) / |v x up|
+    // times half tilt angle acos(vz) * (1 - alpha) / 2
+    imu_fixed_vec3_t ht;
+    ht.z = 0;
+    if(vz >= 0)
+    {
+        // acos(vz) = sqrt(1 - vz) p(vz) and |v x up| = sqrt(1 - vz) sqrt(1 + vz), so the ratio needs
+        // neither the square root of the tiny 1 - vz nor a special case for v straight up.
+        r = imu_fixed_rsqrt((uint64_t)(IMU_FIXED_Q30_ONE + vz), &shift);
+        int64_t g = IMU_FIXED_ROUND30(imu_fixed_acos_poly(vz) * (r >> (shift - 45)));
+        g = IMU_FIXED_ROUND30(g * IMU_FIXED_HALF_ONE_MINUS_ALPHA);
+        ht.x = IMU_FIXED_ROUND30(vy * g);
+        ht.y = IMU_FIXED_ROUND30(-vx * g);
+    }
+    else
+    {
+        // tilted past 90 degrees: acos(vz) = pi - sqrt(1 + vz) p(-vz), tilt axis normalized on its own
+        r = imu_fixed_rsqrt((uint64_t)(vx * vx + vy * vy), &shift);
+        if(r == 0)
+        {
+            // upside down, tilt axis is undefined
+            imu->orientation_quat = imu_fixed_quaternion_renormalize(&qw);
+            return;
+        }
+
+        int8_t yshift;
+        uint64_t y = (uint64_t)(IMU_FIXED_Q30_ONE + vz);
+        int64_t sq = (int64_t)((y * (uint64_t)imu_fixed_rsqrt(y, &yshift)) >> (yshift - 15));
+        int64_t tiltang_2 = IMU_FIXED_ROUND30((IMU_FIXED_PI - IMU_FIXED_ROUND30(sq * imu_fixed_acos_poly(-vz))) * IMU_FIXED_HALF_ONE_MINUS_ALPHA);
+        ht.x = IMU_FIXED_ROUND30(((vy * r) >> (shift - 30)) * tiltang_2);
+        ht.y = IMU_FIXED_ROUND30(((-vx * r) >> (shift - 30)) * tiltang_2);
+    }
+
+    // tilt correction quaternion
+    imu_fixed_quaternion_t qt = imu_fixed_quaternion_from_half_rotation(&ht);
+    // resulting quaternion of complementary filter, renormalized so rounding doesn't accumulate
+    imu_fixed_quaternion_t q = imu_fixed_quaternion_product(&qt, &qw);
+    imu->orientation_quat = imu_fixed_quaternion_renormalize(&q);
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_main_loop_ts(imu_fixed_t * imu, uint32_t ts)
+{
+    uint32_t dtime;
+    if(imu->_odr_period > 0)
+    {
+        dtime = imu->_odr_period;
+        ts = imu->_gyro_ts + (imu->_odr_period + 500) / 1000;
+    }
+    else
+    {
+        // unsigned difference survives the wrap around of ts
+        uint32_t dt = ts - imu->_gyro_ts;
+        dtime = dt > IMU_FIXED_DTIME_MAX_US ? IMU_FIXED_DTIME_MAX_US * 1000u : dt * 1000u;
+    }
+    imu->_gyro_ts = ts;
+
+    switch (imu->state)
+    {
+    case IMU_STATE_UNCALIBRATED:
+
+        if(imu->_calibration_mode != IMU_CALIBMODE_NEVER)
+        {
+            imu->_calibration_time = ts;
+            imu->_calibration_counter = 0;
+            imu_fixed_set_state(imu, IMU_STATE_CALIBRATING);
+            imu->gyro_offset.x = imu->gyro_offset.y = imu->gyro_offset.z = 0;
+            imu->accelerometer_offset = imu->gyro_offset;
+        }
+        else
+        {
+            imu_fixed_set_state(imu, IMU_STATE_READY);
+            prwar("calibration mode set to IMU_CALIBMODE_NEVER. this usually gives undesired results.");
+        }
+        break;
+
+    case IMU_STATE_CALIBRATING:
+
+        imu_fixed_calibrate(imu);
+        break;
+
+    case IMU_STATE_READY:
+
+        imu_fixed_complementary_filter(imu, dtime);
+
+        if(imu->_calibration_mode == IMU_CALIBMODE_PERIODIC)
+        {
+            if(ts - imu->_calibration_time > IMU_CALIBRATION_PERIOD * 1000000u)
+            {
+                imu_fixed_set_state(imu, IMU_STATE_UNCALIBRATED);
+            }
+        }
+
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_set_state(imu_fixed_t * imu, int state)
+{
+    imu->state = state;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_set_gyro_raw(imu_fixed_t * imu, int32_t gx, int32_t gy, int32_t gz)
+{
+    imu->gyro_raw.x = gx;
+    imu->gyro_raw.y = gy;
+    imu->gyro_raw.z = gz;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_set_accelerometer_raw(imu_fixed_t * imu, int32_t ax, int32_t ay, int32_t az)
+{
+    imu->accelerometer_raw.x = ax;
+    imu->accelerometer_raw.y = ay;
+    imu->accelerometer_raw.z = az;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_set_calibration_mode(imu_fixed_t * imu, int8_t mode)
+{
+    imu->_calibration_mode = mode;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_set_gyro_scale_factor(imu_fixed_t * imu, imu_q30_t scalefactor)
+{
+    imu->_scale_factor_gyro = scalefactor;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_set_output_data_rate(imu_fixed_t * imu, uint32_t hz)
+{
+    // period in nanoseconds, so rates like 833 Hz stay exact to 1e-6
+    imu->_odr_period = hz > 0 ? (1000000000u + hz / 2) / hz : 0;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_quaternion_t imu_fixed_get_orientation(const imu_fixed_t * imu)
+{
+    const imu_real_t s = IMU_R(1) / IMU_FIXED_Q30_ONE;
+    return imu_quaternion_create(imu->orientation_quat.w * s, imu->orientation_quat.x * s, imu->orientation_quat.y * s, imu->orientation_quat.z * s);
+}
+
+
+////////////////////////////////////////////
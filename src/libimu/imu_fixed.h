@@ -0,0 +1,218 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_FIXED_H
+#define IMU_FIXED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imu_types.h"
+#include "imu_constants.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// fixed point complementary filter for targets without an fpu. the hot loop only
+// uses 32 and 64 bit integer arithmetic.
+//
+//   Q1.30   quaternions, unit vectors and angles below 2 (imu_q30_t)
+//   Q16.16  gyro rates in deg/s and calibration offsets in raw counts (imu_q16_t)
+//
+// same state machine as imu_t: calibration over the first samples, then filtering. periodic
+// calibration stops the filter for a new calibration, as imu_t did before online calibration.
+// sin, cos and acos are polynomial, normalizations use imu_fixed_rsqrt(). orientation
+// is checked against the float engine by bench/bench_fixed.c.
+
+
+////////////////////////////////////////////
+
+
+typedef int32_t imu_q30_t;
+typedef int32_t imu_q16_t;
+
+#define IMU_FIXED_Q30_ONE   ((imu_q30_t)1 << 30)
+#define IMU_FIXED_Q16_ONE   ((imu_q16_t)1 << 16)
+
+// constant conversion, e.g. IMU_FIXED_Q30(1.0 / 131.0). folded at compile time for literals.
+#define IMU_FIXED_Q30(x)    ((imu_q30_t)((x) * 1073741824.0 + ((x) < 0 ? -0.5 : 0.5)))
+
+
+typedef struct imu_fixed_vec3 {
+    int32_t x, y, z;
+} imu_fixed_vec3_t;
+
+
+typedef struct imu_fixed_quaternion {
+    imu_q30_t w, x, y, z;
+} imu_fixed_quaternion_t;
+
+
+////////////////////////////////////////////
+
+
+typedef struct imu_fixed
+{
+    // gyro rates with offsets removed, deg/s in Q16.16
+    imu_fixed_vec3_t gyro;
+
+    // gyro calibration offsets in raw counts, Q16.16
+    imu_fixed_vec3_t gyro_offset;
+
+    // average gravity vector of calibration in raw counts, Q16.16
+    imu_fixed_vec3_t accelerometer_offset;
+
+    // raw gyro data. SET THIS USING imu_fixed_set_gyro_raw()
+    imu_fixed_vec3_t gyro_raw;
+
+    // raw accelerometer data. SET THIS USING imu_fixed_set_accelerometer_raw()
+    imu_fixed_vec3_t accelerometer_raw;
+
+    // computed orientation quaternion of the body, Q1.30
+    imu_fixed_quaternion_t orientation_quat;
+
+    // current computational state of the library.
+    int8_t state;
+
+    // timestamp of the last sample in microseconds. wraps around, only differences are used.
+    uint32_t _gyro_ts;
+
+    // timestamp of calibration start in microseconds, same time base as _gyro_ts.
+    uint32_t _calibration_time;
+
+    // sample period in nanoseconds when a fixed output data rate is set, 0 otherwise.
+    uint32_t _odr_period;
+
+    // deg/s per raw gyro count, Q1.30. accelerometer needs no scale, only its direction is used.
+    imu_q30_t _scale_factor_gyro;
+
+    // samples summed up so far while calibrating
+    int16_t _calibration_counter;
+
+    // IMU_CALIBMODE_NEVER, IMU_CALIBMODE_ONCE or IMU_CALIBMODE_PERIODIC
+    int8_t _calibration_mode;
+
+} imu_fixed_t;
+
+
+////////////////////////////////////////////
+
+
+// scale_factor_gyro: deg/s per raw count in Q1.30, e.g. IMU_FIXED_Q30(1.0 / 131.0)
+imu_fixed_t imu_fixed_init(uint8_t calibration_mode, imu_q30_t scale_factor_gyro);
+
+
+////////////////////////////////////////////
+
+
+// runs calibration or one filter step on the raw values set last. ts is the sample time
+// in microseconds and may wrap around. steps longer than a second are clamped.
+void imu_fixed_main_loop_ts(imu_fixed_t * imu, uint32_t ts);
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_set_state(imu_fixed_t * imu, int state);
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_set_gyro_raw(imu_fixed_t * imu, int32_t gx, int32_t gy, int32_t gz);
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_set_accelerometer_raw(imu_fixed_t * imu, int32_t ax, int32_t ay, int32_t az);
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_set_calibration_mode(imu_fixed_t * imu, int8_t mode);
+
+
+////////////////////////////////////////////
+
+
+void imu_fixed_set_gyro_scale_factor(imu_fixed_t * imu, imu_q30_t scalefactor);
+
+
+////////////////////////////////////////////
+
+
+// drive the filter from a fixed output data rate (Hz) instead of timestamps. 0 disables it.
+void imu_fixed_set_output_data_rate(imu_fixed_t * imu, uint32_t hz);
+
+
+////////////////////////////////////////////
+
+
+// orientation converted to imu_quaternion_t, for display and comparison on hosts with an fpu.
+imu_quaternion_t imu_fixed_get_orientation(const imu_fixed_t * imu);
+
+
+////////////////////////////////////////////
+
+
+// 1/sqrt(x) = r / 2^shift for x > 0. r is in [2^29, 2^30], good to about 1 lsb of Q1.30.
+// x = 0 gives r = 0.
+imu_q30_t imu_fixed_rsqrt(uint64_t x, int8_t * shift);
+
+
+////////////////////////////////////////////
+
+
+imu_fixed_quaternion_t imu_fixed_quaternion_product(const imu_fixed_quaternion_t * q1, const imu_fixed_quaternion_t * q2);
+
+
+////////////////////////////////////////////
+
+
+imu_fixed_quaternion_t imu_fixed_quaternion_normalize(const imu_fixed_quaternion_t * q);
+
+
+////////////////////////////////////////////
+
+
+// rotation quaternion from half of a rotation vector (axis * angle / 2, radians in Q1.30).
+// sin and cos are short series, accurate to 1e-8 for half angles up to 0.25 rad.
+imu_fixed_quaternion_t imu_fixed_quaternion_from_half_rotation(const imu_fixed_vec3_t * h);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_FRAME_H
+#define IMU_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// binary sample frame, little endian:
+//
+//   offset  size
+//   0       1     type, IMU_FRAME_TYPE_SAMPLE
+//   1       2     sequence counter, +1 per frame, wraps
+//   3       4     device timestamp, microseconds, wraps
+//   7       6     accelerometer x, y, z, int16 raw counts
+//   13      6     gyro x, y, z, int16 raw counts
+//   19      2     crc-16/ccitt-false of bytes 0..18
+//
+// on the wire the 21 bytes are cobs encoded and followed by a 0x00 delimiter, 23 bytes per
+// sample against ~40 for the text format. cobs leaves no 0x00 inside a frame, so a receiver
+// is back in sync at the first delimiter after any corruption.
+
+#define IMU_FRAME_TYPE_SAMPLE   0x01
+#define IMU_FRAME_PAYLOAD       21
+// cobs code byte and delimiter
+#define IMU_FRAME_ENCODED       (IMU_FRAME_PAYLOAD + 2)
+
+
+typedef struct imu_frame
+{
+    uint16_t seq;
+    uint32_t ts_us;
+    int16_t accelerometer[3];
+    int16_t gyro[3];
+} imu_frame_t;
+
+
+////////////////////////////////////////////
+
+
+// crc-16/ccitt-false (poly 0x1021, init 0xffff), one table lookup per byte.
+uint16_t imu_frame_crc(const uint8_t * data, size_t len);
+
+
+////////////////////////////////////////////
+
+
+// writes the encoded frame and its delimiter to out, which has room for IMU_FRAME_ENCODED
+// bytes. returns the number of bytes written. meant for sensor firmware and tests.
+size_t imu_frame_encode(const imu_frame_t * frame, uint8_t * out);
+
+
+////////////////////////////////////////////
+
+
+// decodes one received frame [data, data + len) without its delimiter. cobs is undone in
+// place, data is overwritten. returns 0, or -1 if the frame is malformed or fails its crc.
+int imu_frame_decode(uint8_t * data, size_t len, imu_frame_t * frame);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
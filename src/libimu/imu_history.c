@@ -0,0 +1,328 @@
+#include "imu_history.h"
+#include "imu_algebra.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+////////////////////////////////////////////
+
+
+typedef union imu_history_record
+{
+    imu_history_entry_t entry;
+    uint64_t words[IMU_HISTORY_WORDS];
+} imu_history_record_t;
+
+
+////////////////////////////////////////////
+
+
+imu_history_t imu_history_init(size_t capacity, int8_t tiers)
+{
+    imu_history_t h;
+    memset(&h, 0, sizeof(h));
+
+    if(tiers < 0 || tiers > IMU_HISTORY_MAX_TIERS)
+    {
+        prerr("history tiers must be 0 to %d, got %d", IMU_HISTORY_MAX_TIERS, tiers);
+        return h;
+    }
+
+    size_t cap = 2;
+    while(cap < capacity)
+    {
+        cap <<= 1;
+    }
+
+    // whole cache lines, aligned_alloc wants a multiple of the alignment
+    size_t bytes = (tiers + 1) * cap * IMU_HISTORY_WORDS * sizeof(uint64_t);
+    bytes = (bytes + 63) / 64 * 64;
+    uint64_t * mem = aligned_alloc(64, bytes);
+    if(!mem)
+    {
+        prerr("cannot allocate orientation history of %zu entries", cap);
+        return h;
+    }
+    memset(mem, 0, bytes);
+
+    for(int8_t k = 0; k <= tiers; k++)
+    {
+        h._tiers[k]._words = mem + k * cap * IMU_HISTORY_WORDS;
+    }
+
+    h.capacity = cap;
+    h.tiers = tiers + 1;
+    h._memory = mem;
+
+    return h;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_history_free(imu_history_t * h)
+{
+    free(h->_memory);
+    memset(h, 0, sizeof(*h));
+}
+
+
+////////////////////////////////////////////
+
+
+static void imu_history_tier_push(imu_history_tier_t * t, size_t mask, const imu_history_record_t * r)
+{
+    // odd sequence first, release fence keeps the words from moving above it (as in imu_publish())
+    uint64_t seq = __atomic_load_n(&t->_seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    uint64_t * words = t->_words + ((seq >> 1) & mask) * IMU_HISTORY_WORDS;
+    for(size_t i = 0; i < IMU_HISTORY_WORDS; i++)
+    {
+        __atomic_store_n(&words[i], r->words[i], __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&t->_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_history_push(imu_history_t * h, double ts, const imu_quaternion_t * q)
+{
+    if(h->_count && !(ts > h->_latest))
+    {
+        h->dropped++;
+        return -1;
+    }
+
+    imu_history_record_t r;
+    memset(&r, 0, sizeof(r));
+    r.entry.ts = ts;
+    r.entry.orientation_quat = *q;
+
+    const size_t mask = h->capacity - 1;
+    imu_history_tier_push(&h->_tiers[0], mask, &r);
+
+    // sample n goes to tier k if n is a multiple of IMU_HISTORY_TIER_DIVIDER^k
+    uint64_t n = h->_count;
+    for(int8_t k = 1; k < h->tiers && n % IMU_HISTORY_TIER_DIVIDER == 0; k++)
+    {
+        n /= IMU_HISTORY_TIER_DIVIDER;
+        imu_history_tier_push(&h->_tiers[k], mask, &r);
+    }
+
+    h->_count++;
+    h->_latest = ts;
+    return 0;
+}
+
+
+////////////////////////////////////////////
+
+
+// entry i of a tier, or only its timestamp. may be torn, the caller validates the sequence afterwards.
+static imu_history_entry_t imu_history_read(const imu_history_tier_t * t, size_t mask, uint64_t i)
+{
+    const uint64_t * words = t->_words + (i & mask) * IMU_HISTORY_WORDS;
+    imu_history_record_t r;
+    for(size_t w = 0; w < IMU_HISTORY_WORDS; w++)
+    {
+        r.words[w] = __atomic_load_n(&words[w], __ATOMIC_RELAXED);
+    }
+    return r.entry;
+}
+
+
+static double imu_history_read_ts(const imu_history_tier_t * t, size_t mask, uint64_t i)
+{
+    // ts is the first word of an entry
+    union { uint64_t word; double ts; } u;
+    u.word = __atomic_load_n(&t->_words[(i & mask) * IMU_HISTORY_WORDS], __ATOMIC_RELAXED);
+    return u.ts;
+}
+
+
+////////////////////////////////////////////
+
+
+static imu_quaternion_t imu_history_interpolate(const imu_history_entry_t * a, const imu_history_entry_t * b, double ts, int8_t interpolation)
+{
+    imu_real_t t = (imu_real_t)((ts - a->ts) / (b->ts - a->ts));
+    return interpolation == IMU_HISTORY_NLERP ?
+        imu_quaternion_nlerp(&a->orientation_quat, &b->orientation_quat, t) :
+        imu_quaternion_slerp(&a->orientation_quat, &b->orientation_quat, t);
+}
+
+
+////////////////////////////////////////////
+
+
+// looks ts up in one tier. returns 0 with *out set, 1 if ts is older than the tier (its oldest entry
+// in *oldest) or -1 if the tier is empty or ts is after its latest entry. newer is the oldest entry of
+// the finer tier searched before, NULL for the full rate one: a ts between the latest entry of this
+// tier and that one is interpolated between the two.
+static int imu_history_tier_lookup(const imu_history_tier_t * t, size_t capacity, double ts, int8_t interpolation,
+    const imu_history_entry_t * newer, imu_history_entry_t * oldest, imu_quaternion_t * out)
+{
+    const size_t mask = capacity - 1;
+    uint64_t begin, end, lo;
+    imu_quaternion_t q;
+    int result;
+
+    do
+    {
+        begin = __atomic_load_n(&t->_seq, __ATOMIC_ACQUIRE);
+        uint64_t count = begin >> 1;
+        if(count == 0)
+        {
+            return -1;
+        }
+
+        // the oldest slot is left out, a write in progress may be overwriting it
+        lo = count >= capacity ? count - capacity + 1 : 0;
+        uint64_t hi = count - 1;
+
+        if(ts > imu_history_read_ts(t, mask, hi))
+        {
+            result = -1;
+            if(newer)
+            {
+                imu_history_entry_t a = imu_history_read(t, mask, hi);
+                q = imu_history_interpolate(&a, newer, ts, interpolation);
+                result = 0;
+            }
+        }
+        else if(ts < imu_history_read_ts(t, mask, lo))
+        {
+            *oldest = imu_history_read(t, mask, lo);
+            result = 1;
+        }
+        else
+        {
+            // latest entry at or before ts
+            uint64_t a = lo, b = hi;
+            while(a < b)
+            {
+                uint64_t mid = a + (b - a + 1) / 2;
+                if(imu_history_read_ts(t, mask, mid) <= ts)
+                {
+                    a = mid;
+                }
+                else
+                {
+                    b = mid - 1;
+                }
+            }
+
+            imu_history_entry_t e0 = imu_history_read(t, mask, a);
+            if(a == hi || e0.ts == ts)
+            {
+                q = e0.orientation_quat;
+            }
+            else
+            {
+                imu_history_entry_t e1 = imu_history_read(t, mask, a + 1);
+                q = imu_history_interpolate(&e0, &e1, ts, interpolation);
+            }
+            result = 0;
+        }
+
+        // acquire fence keeps the reads above from moving below the second sequence read.
+        // everything read is intact unless the writer got to overwriting entry lo.
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&t->_seq, __ATOMIC_RELAXED);
+    }
+    while(lo + capacity < (end + 1) / 2);
+
+    if(result == 0)
+    {
+        *out = q;
+    }
+    return result;
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_history_lookup(const imu_history_t * h, double ts, int8_t interpolation, imu_quaternion_t * out)
+{
+    imu_history_entry_t newer, oldest;
+
+    for(int8_t k = 0; k < h->tiers; k++)
+    {
+        int result = imu_history_tier_lookup(&h->_tiers[k], h->capacity, ts, interpolation, k ? &newer : NULL, &oldest, out);
+        if(result <= 0)
+        {
+            return result;
+        }
+        newer = oldest;
+    }
+
+    return -1;
+}
+
+
+////////////////////////////////////////////
+
+
+// timestamps of the oldest and the latest entry of a tier. returns 0, or -1 if it is empty.
+static int imu_history_tier_span(const imu_history_tier_t * t, size_t capacity, double * oldest, double * latest)
+{
+    const size_t mask = capacity - 1;
+    uint64_t begin, end, lo;
+
+    do
+    {
+        begin = __atomic_load_n(&t->_seq, __ATOMIC_ACQUIRE);
+        uint64_t count = begin >> 1;
+        if(count == 0)
+        {
+            return -1;
+        }
+
+        // the same bounds imu_history_tier_lookup() searches in
+        lo = count >= capacity ? count - capacity + 1 : 0;
+        *oldest = imu_history_read_ts(t, mask, lo);
+        *latest = imu_history_read_ts(t, mask, count - 1);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&t->_seq, __ATOMIC_RELAXED);
+    }
+    while(lo + capacity < (end + 1) / 2);
+
+    return 0;
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_history_span(const imu_history_t * h, double * oldest, double * latest)
+{
+    double o, l;
+    if(h->tiers == 0 || imu_history_tier_span(&h->_tiers[0], h->capacity, oldest, latest) != 0)
+    {
+        return -1;
+    }
+
+    // the coarsest tier reaches furthest back. a tier can be empty for a moment while the very
+    // first sample is being pushed.
+    for(int8_t k = h->tiers - 1; k > 0; k--)
+    {
+        if(imu_history_tier_span(&h->_tiers[k], h->capacity, &o, &l) == 0)
+        {
+            *oldest = o < *oldest ? o : *oldest;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+////////////////////////////////////////////
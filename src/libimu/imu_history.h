@@ -0,0 +1,150 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_HISTORY_H
+#define IMU_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// downsampled tiers besides the full rate one. tier k keeps every IMU_HISTORY_TIER_DIVIDER^k-th
+// sample in a ring of the same capacity, so it looks that many times further back.
+#define IMU_HISTORY_MAX_TIERS       4
+#define IMU_HISTORY_TIER_DIVIDER    8
+
+// interpolation between the two samples around a lookup timestamp
+#define IMU_HISTORY_SLERP           0x00
+#define IMU_HISTORY_NLERP           0x01
+
+
+// one orientation of the filter at the timestamp of its gyro sample
+typedef struct imu_history_entry
+{
+    double ts;
+    imu_quaternion_t orientation_quat;
+
+} imu_history_entry_t;
+
+
+#define IMU_HISTORY_WORDS (sizeof(imu_history_entry_t) / sizeof(uint64_t))
+
+
+// ring of one resolution
+typedef struct imu_history_tier
+{
+    // twice the number of entries written, odd while one is being written
+    uint64_t _seq;
+
+    // capacity entries, stored word by word with atomic accesses
+    uint64_t * _words;
+
+} imu_history_tier_t;
+
+
+// orientation over the last capacity samples (and further back at lower rates with tiers),
+// looked up by timestamp, e.g. at the exposure time of a camera frame. one thread writes,
+// with imu_history_push() or from imu_t through imu_set_history(), any number of threads look
+// up without locks: a lookup retries when the writer overwrote what it read meanwhile, which
+// only happens when it is almost capacity samples behind. fixed size, allocated at init.
+typedef struct imu_history
+{
+    imu_history_tier_t _tiers[IMU_HISTORY_MAX_TIERS + 1];
+
+    // entries per tier, power of two
+    size_t capacity;
+
+    // full rate tier plus downsampled ones
+    int8_t tiers;
+
+    // samples refused because their timestamp wasn't after the previous one
+    size_t dropped;
+
+    // writer side: samples taken and timestamp of the latest
+    uint64_t _count;
+    double _latest;
+
+    uint64_t * _memory;
+
+} imu_history_t;
+
+
+////////////////////////////////////////////
+
+
+// capacity is rounded up to a power of two, at least 2. tiers (0 to IMU_HISTORY_MAX_TIERS)
+// downsampled rings are kept next to the full rate one: 1000 entries a tier at 1 kHz hold
+// 1 s at full rate and 8 s, 64 s, ... at the lower ones. capacity is 0 if allocation failed.
+imu_history_t imu_history_init(size_t capacity, int8_t tiers);
+
+
+////////////////////////////////////////////
+
+
+void imu_history_free(imu_history_t * h);
+
+
+////////////////////////////////////////////
+
+
+// appends the orientation at ts (seconds, time base of imu_t::_gyro_ts). only one thread may push.
+// returns 0, or -1 if ts isn't after the previous sample and it was dropped.
+int imu_history_push(imu_history_t * h, double ts, const imu_quaternion_t * q);
+
+
+////////////////////////////////////////////
+
+
+// orientation at ts, interpolated (IMU_HISTORY_SLERP or IMU_HISTORY_NLERP) between the samples
+// before and after it, binary search per tier. the full rate tier is searched first, older
+// timestamps fall through to the downsampled ones. callable from any thread.
+// returns 0, or -1 if ts is before the oldest or after the latest sample held (out untouched).
+int imu_history_lookup(const imu_history_t * h, double ts, int8_t interpolation, imu_quaternion_t * out);
+
+
+////////////////////////////////////////////
+
+
+// timestamps of the oldest and the latest sample held, over all tiers. callable from any thread.
+// returns 0, or -1 if the history is empty.
+int imu_history_span(const imu_history_t * h, double * oldest, double * latest);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,407 @@
+#include "imu_ingest.h"
+#include "imu_frame.h"
+#include "imu_utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+////////////////////////////////////////////
+
+
+// more digits would overflow int32_t raw values
+#define IMU_INGEST_MAX_DIGITS 9
+
+
+static const double imu_ingest_pow10_inv[] = {
+    1e0, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8, 1e-9,
+    1e-10, 1e-11, 1e-12, 1e-13, 1e-14, 1e-15, 1e-16, 1e-17, 1e-18,
+};
+
+
+////////////////////////////////////////////
+
+
+imu_ingest_t imu_ingest_init(int fd)
+{
+    imu_ingest_t in;
+    memset(&in, 0, sizeof(in));
+    in.fd = -1;
+    in._epoll = -1;
+
+    int flags = fcntl(fd, F_GETFL);
+    if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        prerr("cannot make fd %d non-blocking. (%s)", fd, strerror(errno));
+        return in;
+    }
+
+    in._epoll = epoll_create1(EPOLL_CLOEXEC);
+    if(in._epoll < 0)
+    {
+        prerr("cannot create epoll instance. (%s)", strerror(errno));
+        return in;
+    }
+
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+    if(epoll_ctl(in._epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        prerr("cannot watch fd %d. (%s)", fd, strerror(errno));
+        close(in._epoll);
+        in._epoll = -1;
+        return in;
+    }
+
+    in.fd = fd;
+    return in;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_ingest_set_format(imu_ingest_t * in, int8_t format)
+{
+    in->format = format;
+    in->_synced = 0;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_ingest_free(imu_ingest_t * in)
+{
+    if(in->_epoll >= 0)
+    {
+        close(in->_epoll);
+    }
+    in->_epoll = -1;
+    in->fd = -1;
+}
+
+
+////////////////////////////////////////////
+
+
+// optionally signed decimal integer. the digit loop has a single exit condition and the
+// sign is applied without branching.
+static inline const char * imu_ingest_int(const char * p, const char * end, int32_t * value)
+{
+    while(p < end && *p == ' ')
+    {
+        p++;
+    }
+
+    int32_t neg = p < end && *p == '-';
+    p += neg | (p < end && *p == '+');
+
+    // unsigned, so a long run of digits from the line wraps instead of overflowing. it is
+    // rejected by its length before being narrowed.
+    const char * digits = p;
+    uint32_t v = 0;
+    uint32_t d;
+    while(p < end && (d = (uint32_t)(*p - '0')) < 10)
+    {
+        v = v * 10 + d;
+        p++;
+    }
+
+    if(p == digits || p - digits > IMU_INGEST_MAX_DIGITS)
+    {
+        return NULL;
+    }
+
+    *value = ((int32_t)v ^ -neg) + neg;
+    return p;
+}
+
+
+////////////////////////////////////////////
+
+
+// unsigned seconds with an optional decimal fraction
+static inline const char * imu_ingest_seconds(const char * p, const char * end, double * value)
+{
+    while(p < end && *p == ' ')
+    {
+        p++;
+    }
+
+    const char * digits = p;
+    uint64_t ip = 0, fp = 0;
+    uint32_t d;
+    while(p < end && (d = (uint32_t)(*p - '0')) < 10)
+    {
+        ip = ip * 10 + d;
+        p++;
+    }
+
+    if(p == digits || p - digits > 18)
+    {
+        return NULL;
+    }
+
+    size_t fdigits = 0;
+    if(p < end && *p == '.')
+    {
+        p++;
+        // digits past 1e-18 s don't change a double seconds value
+        for(; p < end && (d = (uint32_t)(*p - '0')) < 10; p++)
+        {
+            if(fdigits < 18)
+            {
+                fp = fp * 10 + d;
+                fdigits++;
+            }
+        }
+    }
+
+    *value = (double)ip + (double)fp * imu_ingest_pow10_inv[fdigits];
+    return p;
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_ingest_parse_line(const char * begin, const char * end, imu_sample_t * sample)
+{
+    int32_t raw[6];
+    const char * p = begin;
+
+    for(int i = 0; i < 6; i++)
+    {
+        if(i > 0)
+        {
+            if(p == end || *p != ',')
+            {
+                return 0;
+            }
+            p++;
+        }
+
+        p = imu_ingest_int(p, end, raw + i);
+        if(!p)
+        {
+            return 0;
+        }
+    }
+
+    int fields = 6;
+    if(p < end && *p == ',')
+    {
+        double ts;
+        p = imu_ingest_seconds(p + 1, end, &ts);
+        if(!p)
+        {
+            return 0;
+        }
+        sample->ts = ts;
+        fields = 7;
+    }
+
+    while(p < end && (*p == ' ' || *p == '\r'))
+    {
+        p++;
+    }
+    if(p != end)
+    {
+        return 0;
+    }
+
+    sample->ax = (imu_real_t)raw[0];
+    sample->ay = (imu_real_t)raw[1];
+    sample->az = (imu_real_t)raw[2];
+    sample->gx = (imu_real_t)raw[3];
+    sample->gy = (imu_real_t)raw[4];
+    sample->gz = (imu_real_t)raw[5];
+
+    return fields;
+}
+
+
+////////////////////////////////////////////
+
+
+// binary frame to sample, tracks sequence gaps and device time wraps
+static int imu_ingest_frame(imu_ingest_t * in, char * begin, const char * end, imu_sample_t * sample)
+{
+    imu_frame_t frame;
+    if(imu_frame_decode((uint8_t *)begin, (size_t)(end - begin), &frame) < 0)
+    {
+        return 0;
+    }
+
+    if(in->_synced)
+    {
+        in->dropped += (uint16_t)(frame.seq - in->_seq - 1);
+        // signed difference, a corrupted timestamp that got through doesn't count as a wrap
+        in->_device_us += (int32_t)(frame.ts_us - in->_ts_us);
+    }
+    else
+    {
+        in->_device_us = frame.ts_us;
+        in->_synced = 1;
+    }
+    in->_seq = frame.seq;
+    in->_ts_us = frame.ts_us;
+
+    sample->ax = frame.accelerometer[0];
+    sample->ay = frame.accelerometer[1];
+    sample->az = frame.accelerometer[2];
+    sample->gx = frame.gyro[0];
+    sample->gy = frame.gyro[1];
+    sample->gz = frame.gyro[2];
+    sample->ts = (double)in->_device_us * 1e-6;
+
+    return 1;
+}
+
+
+////////////////////////////////////////////
+
+
+// parses complete lines or frames in place, a partial last one stays in the buffer
+static size_t imu_ingest_lines(imu_ingest_t * in, imu_sample_t * samples, size_t max)
+{
+    const int binary = in->format == IMU_INGEST_FORMAT_BINARY;
+    const char delimiter = binary ? 0x00 : '\n';
+    size_t n = 0;
+    char * p = in->_buffer + in->_begin;
+    const char * end = in->_buffer + in->_end;
+
+    while(n < max)
+    {
+        char * eol = memchr(p, delimiter, (size_t)(end - p));
+        if(!eol)
+        {
+            break;
+        }
+
+        if(binary && eol > p)
+        {
+            int ok = imu_ingest_frame(in, p, eol, samples + n);
+            n += ok;
+            in->errors += !ok;
+        }
+        // empty lines come from \r\n turned into \n\n by the tty
+        else if(!binary && eol > p && !(eol == p + 1 && *p == '\r'))
+        {
+            samples[n].ts = in->_read_ts;
+            int ok = imu_ingest_parse_line(p, eol, samples + n) != 0;
+            n += ok;
+            in->errors += !ok;
+        }
+
+        p = eol + 1;
+    }
+
+    in->received += n;
+    in->_begin = (size_t)(p - in->_buffer);
+    return n;
+}
+
+
+////////////////////////////////////////////
+
+
+// reads until the descriptor would block or the buffer is full. returns -1 on errors and eof.
+static int imu_ingest_read(imu_ingest_t * in)
+{
+    // moving the partial line to the front, it's shorter than a line
+    if(in->_begin > 0)
+    {
+        memmove(in->_buffer, in->_buffer + in->_begin, in->_end - in->_begin);
+        in->_end -= in->_begin;
+        in->_begin = 0;
+    }
+
+    // a full buffer without a line feed can't become a line anymore
+    if(in->_end == IMU_INGEST_BUFLEN)
+    {
+        in->errors++;
+        in->_end = 0;
+    }
+
+    while(in->_end < IMU_INGEST_BUFLEN)
+    {
+        ssize_t received = read(in->fd, in->_buffer + in->_end, IMU_INGEST_BUFLEN - in->_end);
+        if(received > 0)
+        {
+            in->_end += (size_t)received;
+            in->_read_ts = get_time_sec();
+            continue;
+        }
+
+        if(received == 0)
+        {
+            in->eof = 1;
+            return -1;
+        }
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            break;
+        }
+        if(errno != EINTR)
+        {
+            // a pty whose other end closed reports EIO
+            if(errno == EIO)
+            {
+                in->eof = 1;
+            }
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_ingest_poll(imu_ingest_t * in, imu_sample_t * samples, size_t max, int timeout_ms)
+{
+    if(in->fd < 0)
+    {
+        return -1;
+    }
+
+    // complete lines from the last read go first, without waiting
+    size_t n = imu_ingest_lines(in, samples, max);
+    if(n > 0 || max == 0)
+    {
+        return (int)n;
+    }
+
+    if(in->eof)
+    {
+        return -1;
+    }
+
+    struct epoll_event ev;
+    int ready = epoll_wait(in->_epoll, &ev, 1, timeout_ms);
+    if(ready < 0)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+    if(ready == 0)
+    {
+        return 0;
+    }
+
+    int status = imu_ingest_read(in);
+    n = imu_ingest_lines(in, samples, max);
+    if(n == 0 && status < 0)
+    {
+        return -1;
+    }
+
+    return (int)n;
+}
+
+
+////////////////////////////////////////////
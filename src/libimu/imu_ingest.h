@@ -0,0 +1,136 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_INGEST_H
+#define IMU_INGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imu_types.h"
+#include "imu_constants.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// bytes buffered between reads, holds several hundred text samples
+#define IMU_INGEST_BUFLEN   4096
+
+
+// reads text samples `ax,ay,az,gx,gy,gz[,ts]\n` or binary imu_frame_t frames from a serial
+// port, pipe or socket. the descriptor is switched to non-blocking mode and drained in blocks
+// whenever epoll reports it readable, lines and frames are parsed where they lie in the buffer
+// without copying.
+typedef struct imu_ingest
+{
+    // source descriptor, not owned
+    int fd;
+
+    // epoll instance watching fd
+    int _epoll;
+
+    // received bytes, [_begin, _end) are not parsed yet
+    char _buffer[IMU_INGEST_BUFLEN];
+    size_t _begin, _end;
+
+    // time of the last read, stamped on lines without a device timestamp
+    double _read_ts;
+
+    // IMU_INGEST_FORMAT_*
+    int8_t format;
+
+    // last binary frame, device time unwrapped to 64 bits
+    uint16_t _seq;
+    uint32_t _ts_us;
+    int64_t _device_us;
+    int8_t _synced;
+
+    // statistics: samples, malformed lines or frames, frames missing from the sequence
+    size_t received;
+    size_t errors;
+    size_t dropped;
+
+    // set when the other end has closed
+    int8_t eof;
+
+} imu_ingest_t;
+
+
+////////////////////////////////////////////
+
+
+// fd is left as it is and the returned ingest has fd = -1 if it can't be watched.
+imu_ingest_t imu_ingest_init(int fd);
+
+
+////////////////////////////////////////////
+
+
+// IMU_INGEST_FORMAT_TEXT (default) or IMU_INGEST_FORMAT_BINARY. serial ports carrying binary
+// frames must not translate bytes, e.g. ICRNL turns 0x0d into 0x0a.
+void imu_ingest_set_format(imu_ingest_t * in, int8_t format);
+
+
+////////////////////////////////////////////
+
+
+// closes the epoll instance, not fd.
+void imu_ingest_free(imu_ingest_t * in);
+
+
+////////////////////////////////////////////
+
+
+// waits up to timeout_ms (-1 forever) for data, reads everything available and parses up to
+// max samples. samples left over are returned by the next call without waiting. binary
+// frames carry their device time in seconds, counted from the first frame's timestamp on.
+// text lines without a device timestamp get the time of the read that received them, so lines
+// arriving in one block share a time. send timestamps or use imu_set_output_data_rate()
+// when the sensor is faster than the reader. returns the number of
+// samples, 0 on timeout and -1 on read errors or when the other end has closed.
+int imu_ingest_poll(imu_ingest_t * in, imu_sample_t * samples, size_t max, int timeout_ms);
+
+
+////////////////////////////////////////////
+
+
+// parses one line [begin, end) without the line feed. integers for the 6 raw values,
+// optional timestamp as seconds with a decimal fraction. returns the number of fields
+// (6 or 7) or 0 if the line is malformed. ts is left as it is for 6 fields.
+int imu_ingest_parse_line(const char * begin, const char * end, imu_sample_t * sample);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
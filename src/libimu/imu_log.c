@@ -0,0 +1,343 @@
+#include "imu_log.h"
+#include "imu_utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+////////////////////////////////////////////
+
+
+_Static_assert(sizeof(imu_log_header_t) == IMU_LOG_HEADER_SIZE, "imu_log_header_t must fill IMU_LOG_HEADER_SIZE");
+_Static_assert(sizeof(imu_log_record_t) == 32, "imu_log_record_t is part of the file format");
+
+
+////////////////////////////////////////////
+
+
+// maps the first size bytes of the file after growing it to size
+static int imu_log_writer_map(imu_log_writer_t * w, size_t size)
+{
+    if(w->_map)
+    {
+        munmap(w->_map, w->_mapped);
+        w->_map = NULL;
+    }
+
+    if(ftruncate(w->fd, (off_t)size) < 0)
+    {
+        return -1;
+    }
+
+    void * map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, w->fd, 0);
+    if(map == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    w->_map = map;
+    w->_mapped = size;
+    return 0;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_log_writer_t imu_log_writer_open(const char * path, const imu_t * imu)
+{
+    imu_log_writer_t w;
+    memset(&w, 0, sizeof(w));
+
+    w.fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(w.fd < 0)
+    {
+        prerr("cannot create %s. (%s)", path, strerror(errno));
+        return w;
+    }
+
+    if(imu_log_writer_map(&w, IMU_LOG_GROW) < 0)
+    {
+        prerr("cannot map %s. (%s)", path, strerror(errno));
+        close(w.fd);
+        w.fd = -1;
+        return w;
+    }
+
+    imu_log_header_t * h = (imu_log_header_t *)w._map;
+    memcpy(h->magic, IMU_LOG_MAGIC, sizeof(h->magic));
+    h->version = IMU_LOG_VERSION;
+    h->record_size = sizeof(imu_log_record_t);
+    h->scale_factor_gyro = imu->_scale_factor_gyro;
+    h->scale_factor_accelerometer = imu->_scale_factor_accelerometer;
+    h->odr_period = imu->_odr_period;
+    h->calibration_mode = imu->_calibration_mode;
+    h->estimation_mode = imu->_estimation_mode;
+
+    return w;
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_log_append(imu_log_writer_t * w, const imu_sample_t * sample)
+{
+    size_t offset = IMU_LOG_HEADER_SIZE + w->count * sizeof(imu_log_record_t);
+    if(offset + sizeof(imu_log_record_t) > w->_mapped)
+    {
+        if(imu_log_writer_map(w, w->_mapped + IMU_LOG_GROW) < 0)
+        {
+            prerr("cannot grow sample log. (%s)", strerror(errno));
+            return -1;
+        }
+    }
+
+    imu_log_record_t * r = (imu_log_record_t *)(w->_map + offset);
+    r->ts = sample->ts;
+    r->accelerometer[0] = (float)sample->ax;
+    r->accelerometer[1] = (float)sample->ay;
+    r->accelerometer[2] = (float)sample->az;
+    r->gyro[0] = (float)sample->gx;
+    r->gyro[1] = (float)sample->gy;
+    r->gyro[2] = (float)sample->gz;
+    w->count++;
+
+    return 0;
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_log_writer_close(imu_log_writer_t * w)
+{
+    if(w->fd < 0)
+    {
+        return -1;
+    }
+
+    int status = 0;
+    if(w->_map)
+    {
+        imu_log_header_t * h = (imu_log_header_t *)w->_map;
+        const imu_log_record_t * records = (const imu_log_record_t *)(w->_map + IMU_LOG_HEADER_SIZE);
+        uint64_t index_count = (w->count + IMU_LOG_INDEX_STRIDE - 1) / IMU_LOG_INDEX_STRIDE;
+        size_t index_offset = IMU_LOG_HEADER_SIZE + w->count * sizeof(imu_log_record_t);
+        size_t size = index_offset + index_count * sizeof(imu_log_index_t);
+
+        if(size > w->_mapped)
+        {
+            status = imu_log_writer_map(w, size);
+            h = (imu_log_header_t *)w->_map;
+            records = (const imu_log_record_t *)(w->_map + IMU_LOG_HEADER_SIZE);
+        }
+
+        if(status == 0)
+        {
+            imu_log_index_t * index = (imu_log_index_t *)(w->_map + index_offset);
+            for(uint64_t i = 0; i < index_count; i++)
+            {
+                index[i].record = i * IMU_LOG_INDEX_STRIDE;
+                index[i].ts = records[index[i].record].ts;
+            }
+
+            h->index_count = index_count;
+            // written last, a log with a record count is complete
+            h->record_count = w->count;
+
+            munmap(w->_map, w->_mapped);
+            status = ftruncate(w->fd, (off_t)size);
+        }
+    }
+
+    if(close(w->fd) < 0)
+    {
+        status = -1;
+    }
+
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    return status;
+}
+
+
+////////////////////////////////////////////
+
+
+static int imu_log_record_empty(const imu_log_record_t * r)
+{
+    static const imu_log_record_t zero;
+    return memcmp(r, &zero, sizeof(zero)) == 0;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_log_t imu_log_open(const char * path)
+{
+    imu_log_t log;
+    memset(&log, 0, sizeof(log));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        prerr("cannot open %s. (%s)", path, strerror(errno));
+        return log;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < IMU_LOG_HEADER_SIZE)
+    {
+        prerr("%s is not a sample log.", path);
+        close(fd);
+        return log;
+    }
+
+    void * map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        prerr("cannot map %s. (%s)", path, strerror(errno));
+        return log;
+    }
+
+    const imu_log_header_t * h = map;
+    if(memcmp(h->magic, IMU_LOG_MAGIC, sizeof(h->magic)) != 0 || h->version != IMU_LOG_VERSION ||
+        h->record_size != sizeof(imu_log_record_t))
+    {
+        prerr("%s is not a version %d sample log.", path, IMU_LOG_VERSION);
+        munmap(map, (size_t)st.st_size);
+        return log;
+    }
+
+    log._map = map;
+    log._size = (size_t)st.st_size;
+    log.header = h;
+    log.records = (const imu_log_record_t *)((const uint8_t *)map + IMU_LOG_HEADER_SIZE);
+
+    uint64_t capacity = (log._size - IMU_LOG_HEADER_SIZE) / sizeof(imu_log_record_t);
+    if(h->record_count > 0 && h->record_count <= capacity &&
+        (log._size - IMU_LOG_HEADER_SIZE - h->record_count * sizeof(imu_log_record_t)) / sizeof(imu_log_index_t) >= h->index_count)
+    {
+        log.count = h->record_count;
+        log.index = (const imu_log_index_t *)(log.records + log.count);
+        log.index_count = h->index_count;
+    }
+    else
+    {
+        // recorder didn't finish, the unused part of its last growth is zero
+        log.count = capacity;
+        while(log.count > 0 && imu_log_record_empty(log.records + log.count - 1))
+        {
+            log.count--;
+        }
+        if(capacity > 0)
+        {
+            prwar("%s was not closed, recovered %llu records.", path, (unsigned long long)log.count);
+        }
+
+        log.index_count = (log.count + IMU_LOG_INDEX_STRIDE - 1) / IMU_LOG_INDEX_STRIDE;
+        log._built_index = malloc((log.index_count + 1) * sizeof(imu_log_index_t));
+        for(uint64_t i = 0; log._built_index && i < log.index_count; i++)
+        {
+            log._built_index[i].record = i * IMU_LOG_INDEX_STRIDE;
+            log._built_index[i].ts = log.records[i * IMU_LOG_INDEX_STRIDE].ts;
+        }
+        log.index = log._built_index;
+        log.index_count = log._built_index ? log.index_count : 0;
+    }
+
+    madvise(map, log._size, MADV_SEQUENTIAL);
+    return log;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_log_close(imu_log_t * log)
+{
+    if(log->_map)
+    {
+        munmap(log->_map, log->_size);
+    }
+    free(log->_built_index);
+    memset(log, 0, sizeof(*log));
+}
+
+
+////////////////////////////////////////////
+
+
+uint64_t imu_log_seek(const imu_log_t * log, double ts)
+{
+    // last index entry at or before ts narrows the search to one stride
+    uint64_t lo = 0, hi = log->count;
+    size_t a = 0, b = log->index_count;
+    while(a < b)
+    {
+        size_t mid = a + (b - a) / 2;
+        if(log->index[mid].ts < ts)
+        {
+            lo = log->index[mid].record;
+            a = mid + 1;
+        }
+        else
+        {
+            hi = log->index[mid].record;
+            b = mid;
+        }
+    }
+
+    while(lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if(log->records[mid].ts < ts)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_sample_t imu_log_sample(const imu_log_t * log, uint64_t i)
+{
+    const imu_log_record_t * r = log->records + i;
+    imu_sample_t s = {
+        r->accelerometer[0], r->accelerometer[1], r->accelerometer[2],
+        r->gyro[0], r->gyro[1], r->gyro[2],
+        r->ts
+    };
+    return s;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_t imu_log_init_imu(const imu_log_t * log)
+{
+    const imu_log_header_t * h = log->header;
+    imu_t imu = imu_init((uint8_t)h->calibration_mode, (imu_real_t)h->scale_factor_accelerometer, (imu_real_t)h->scale_factor_gyro);
+    imu_set_estimation_mode(&imu, h->estimation_mode);
+    imu._odr_period = h->odr_period;
+    return imu;
+}
+
+
+////////////////////////////////////////////
@@ -0,0 +1,193 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_LOG_H
+#define IMU_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// binary sample log, native byte order:
+//   header       IMU_LOG_HEADER_SIZE bytes
+//   records      record_count x imu_log_record_t, ordered by time
+//   index        index_count x imu_log_index_t, one per IMU_LOG_INDEX_STRIDE records
+//
+// counts and index are written when the recorder is closed. a log whose recorder didn't
+// finish still opens, its records are counted and its index is built when it is mapped.
+
+#define IMU_LOG_MAGIC           "imulog\0\0"
+#define IMU_LOG_VERSION         1
+#define IMU_LOG_HEADER_SIZE     64
+#define IMU_LOG_INDEX_STRIDE    1024
+// the recorder grows its file by this many bytes at a time
+#define IMU_LOG_GROW            (64 << 20)
+
+
+typedef struct imu_log_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+
+    // imu_t configuration the log was recorded with
+    double scale_factor_gyro;
+    double scale_factor_accelerometer;
+    double odr_period;
+    int8_t calibration_mode;
+    int8_t estimation_mode;
+    uint8_t _reserved[6];
+
+    uint64_t record_count;
+    uint64_t index_count;
+
+} imu_log_header_t;
+
+
+// raw values as they were passed to the filter, fixed 32 bytes in both precisions
+typedef struct imu_log_record
+{
+    double ts;
+    float accelerometer[3];
+    float gyro[3];
+} imu_log_record_t;
+
+
+typedef struct imu_log_index
+{
+    double ts;
+    uint64_t record;
+} imu_log_index_t;
+
+
+////////////////////////////////////////////
+
+
+// appends records to a file through a shared mapping, no system call per sample
+typedef struct imu_log_writer
+{
+    // -1 if the log couldn't be created
+    int fd;
+
+    uint8_t * _map;
+    size_t _mapped;
+
+    uint64_t count;
+
+} imu_log_writer_t;
+
+
+////////////////////////////////////////////
+
+
+// log opened with imu_log_open(), mapped read only
+typedef struct imu_log
+{
+    // NULL if the log couldn't be opened
+    const imu_log_header_t * header;
+    const imu_log_record_t * records;
+    uint64_t count;
+
+    const imu_log_index_t * index;
+    uint64_t index_count;
+
+    void * _map;
+    size_t _size;
+    // index built at open for logs without one
+    imu_log_index_t * _built_index;
+
+} imu_log_t;
+
+
+////////////////////////////////////////////
+
+
+// creates or truncates path, configuration is taken from imu. fd is -1 on errors.
+imu_log_writer_t imu_log_writer_open(const char * path, const imu_t * imu);
+
+
+////////////////////////////////////////////
+
+
+// returns 0, or -1 if the file can't grow.
+int imu_log_append(imu_log_writer_t * w, const imu_sample_t * sample);
+
+
+////////////////////////////////////////////
+
+
+// writes counts and index and trims the file. returns 0 or -1.
+int imu_log_writer_close(imu_log_writer_t * w);
+
+
+////////////////////////////////////////////
+
+
+imu_log_t imu_log_open(const char * path);
+
+
+////////////////////////////////////////////
+
+
+void imu_log_close(imu_log_t * log);
+
+
+////////////////////////////////////////////
+
+
+// index of the first record at or after ts, log->count if there is none.
+uint64_t imu_log_seek(const imu_log_t * log, double ts);
+
+
+////////////////////////////////////////////
+
+
+// record i as a filter sample
+imu_sample_t imu_log_sample(const imu_log_t * log, uint64_t i);
+
+
+////////////////////////////////////////////
+
+
+// imu_t configured like the imu the log was recorded with
+imu_t imu_log_init_imu(const imu_log_t * log);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
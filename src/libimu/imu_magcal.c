@@ -0,0 +1,405 @@
+#include "imu_magcal.h"
+#include "imu_algebra.h"
+#include "imu_constants.h"
+
+#include <math.h>
+#include <string.h>
+
+////////////////////////////////////////////
+
+
+// unknowns of the fit, see imu_magcal_add()
+#define IMU_MAGCAL_PARAMS 9
+
+// index of d_i d_j (i <= j) in imu_magcal_t::_dtd
+#define IMU_MAGCAL_DTD(i, j) ((i) * IMU_MAGCAL_PARAMS - (i) * ((i) - 1) / 2 + (j) - (i))
+
+
+////////////////////////////////////////////
+
+
+imu_magcal_t imu_magcal_init(void)
+{
+    imu_magcal_t cal;
+    memset(&cal, 0, sizeof(cal));
+
+    cal.soft_iron[0][0] = cal.soft_iron[1][1] = cal.soft_iron[2][2] = IMU_R(1);
+
+    return cal;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_magcal_add(imu_magcal_t * cal, const imu_vec3_t * raw)
+{
+    if(cal->_scale <= 0)
+    {
+        cal->_origin[0] = raw->x;
+        cal->_origin[1] = raw->y;
+        cal->_origin[2] = raw->z;
+        cal->_scale = imu_sqrt(raw->x * raw->x + raw->y * raw->y + raw->z * raw->z);
+        if(cal->_scale <= 0)
+        {
+            cal->_scale = IMU_R(1);
+        }
+    }
+
+    // fit coordinates are about unit size, imu_real_t holds them as well as the raw sample
+    const imu_real_t k = IMU_R(1) / cal->_scale;
+    const double x = (double)((raw->x - cal->_origin[0]) * k);
+    const double y = (double)((raw->y - cal->_origin[1]) * k);
+    const double z = (double)((raw->z - cal->_origin[2]) * k);
+    const double e = x * x + y * y + z * z;
+
+    // x^T A x + 2 b^T x + c = 0 with trace(A) = -3 (petrov's ellipsoid fit). the trace fixes the
+    // scale instead of c, so the fit holds whether or not the origin lies on the ellipsoid.
+    // d u = e, u = (a00 + a11 + a22 parts, a01, a02, a12, b, c).
+    const double d[IMU_MAGCAL_PARAMS] = {x * x + y * y - 2.0 * z * z, x * x + z * z - 2.0 * y * y, 2.0 * x * y, 2.0 * x * z, 2.0 * y * z,
+                                         2.0 * x, 2.0 * y, 2.0 * z, 1.0};
+
+    double * dtd = cal->_dtd;
+    for(int i = 0; i < IMU_MAGCAL_PARAMS; i++)
+    {
+        for(int j = i; j < IMU_MAGCAL_PARAMS; j++)
+        {
+            *dtd++ += d[i] * d[j];
+        }
+        cal->_dte[i] += d[i] * e;
+    }
+    cal->_e += e;
+
+    if(++cal->_n >= IMU_MAGCAL_WINDOW)
+    {
+        imu_magcal_fit(cal);
+
+        for(int i = 0; i < 45; i++)
+        {
+            cal->_dtd[i] *= IMU_MAGCAL_FORGET;
+        }
+        for(int i = 0; i < IMU_MAGCAL_PARAMS; i++)
+        {
+            cal->_dte[i] *= IMU_MAGCAL_FORGET;
+        }
+        cal->_e *= IMU_MAGCAL_FORGET;
+        cal->_n = 0;
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+// eigenvalues l and eigenvectors (columns of v) of a symmetric 3x3 matrix, cyclic jacobi.
+// a is destroyed.
+static void imu_magcal_eigen(double a[3][3], double v[3][3], double l[3])
+{
+    memset(v, 0, 9 * sizeof(double));
+    v[0][0] = v[1][1] = v[2][2] = 1.0;
+
+    for(int sweep = 0; sweep < 16; sweep++)
+    {
+        double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+        double diag = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+        if(off <= 1e-30 * diag)
+        {
+            break;
+        }
+
+        for(int p = 0; p < 2; p++)
+        {
+            for(int q = p + 1; q < 3; q++)
+            {
+                if(a[p][q] == 0.0)
+                {
+                    continue;
+                }
+
+                // rotation zeroing a[p][q]
+                double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0), s = t * c;
+
+                for(int k = 0; k < 3; k++)
+                {
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for(int k = 0; k < 3; k++)
+                {
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for(int k = 0; k < 3; k++)
+                {
+                    double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    l[0] = a[0][0];
+    l[1] = a[1][1];
+    l[2] = a[2][2];
+}
+
+
+////////////////////////////////////////////
+
+
+// solves m p = r for a symmetric positive definite 9x9 m (cholesky). -1 if m is singular
+// within rounding, which is what too few distinct directions look like.
+static int imu_magcal_solve(double m[IMU_MAGCAL_PARAMS][IMU_MAGCAL_PARAMS], const double r[IMU_MAGCAL_PARAMS], double p[IMU_MAGCAL_PARAMS])
+{
+    const int n = IMU_MAGCAL_PARAMS;
+    double dmax = 0.0;
+    for(int i = 0; i < n; i++)
+    {
+        dmax = fmax(dmax, m[i][i]);
+    }
+
+    // lower triangle of m becomes l, m = l l^T
+    for(int j = 0; j < n; j++)
+    {
+        double d = m[j][j];
+        for(int k = 0; k < j; k++)
+        {
+            d -= m[j][k] * m[j][k];
+        }
+        if(d <= 1e-12 * dmax)
+        {
+            return -1;
+        }
+        m[j][j] = sqrt(d);
+
+        for(int i = j + 1; i < n; i++)
+        {
+            double s = m[i][j];
+            for(int k = 0; k < j; k++)
+            {
+                s -= m[i][k] * m[j][k];
+            }
+            m[i][j] = s / m[j][j];
+        }
+    }
+
+    double y[IMU_MAGCAL_PARAMS];
+    for(int i = 0; i < n; i++)
+    {
+        double s = r[i];
+        for(int k = 0; k < i; k++)
+        {
+            s -= m[i][k] * y[k];
+        }
+        y[i] = s / m[i][i];
+    }
+    for(int i = n - 1; i >= 0; i--)
+    {
+        double s = y[i];
+        for(int k = i + 1; k < n; k++)
+        {
+            s -= m[k][i] * p[k];
+        }
+        p[i] = s / m[i][i];
+    }
+
+    return 0;
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_magcal_fit(imu_magcal_t * cal)
+{
+    // sum of d_8 d_8 = 1 is the faded sample count
+    const double n = cal->_dtd[IMU_MAGCAL_DTD(8, 8)];
+    if(n < IMU_MAGCAL_WINDOW)
+    {
+        return -1;
+    }
+
+    double m[IMU_MAGCAL_PARAMS][IMU_MAGCAL_PARAMS], p[IMU_MAGCAL_PARAMS];
+    const double * dtd = cal->_dtd;
+    for(int i = 0; i < IMU_MAGCAL_PARAMS; i++)
+    {
+        for(int j = i; j < IMU_MAGCAL_PARAMS; j++)
+        {
+            m[i][j] = m[j][i] = *dtd++;
+        }
+    }
+
+    if(imu_magcal_solve(m, cal->_dte, p) != 0)
+    {
+        return -1;
+    }
+
+    const double a[3][3] = {
+        {p[0] + p[1] - 1.0, p[2], p[3]},
+        {p[2], p[0] - 2.0 * p[1] - 1.0, p[4]},
+        {p[3], p[4], p[1] - 2.0 * p[0] - 1.0},
+    };
+
+    // center c = -A^-1 b by cramer's rule
+    const double c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+    const double c01 = a[0][2] * a[2][1] - a[0][1] * a[2][2];
+    const double c02 = a[0][1] * a[1][2] - a[0][2] * a[1][1];
+    const double det = a[0][0] * c00 + a[1][0] * c01 + a[2][0] * c02;
+    if(det == 0.0)
+    {
+        return -1;
+    }
+    const double c11 = a[0][0] * a[2][2] - a[0][2] * a[2][0];
+    const double c12 = a[0][2] * a[1][0] - a[0][0] * a[1][2];
+    const double c22 = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+    const double c[3] = {
+        -(c00 * p[5] + c01 * p[6] + c02 * p[7]) / det,
+        -(c01 * p[5] + c11 * p[6] + c12 * p[7]) / det,
+        -(c02 * p[5] + c12 * p[6] + c22 * p[7]) / det,
+    };
+
+    // (u - c)^T A (u - c) = c^T A c - p[8], both sides negative for an ellipsoid
+    double g = -p[8];
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            g += c[i] * a[i][j] * c[j];
+        }
+    }
+    if(g == 0.0)
+    {
+        return -1;
+    }
+
+    double e[3][3], v[3][3], l[3];
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            e[i][j] = a[i][j] / g;
+        }
+    }
+    imu_magcal_eigen(e, v, l);
+
+    double lmin = fmin(fmin(l[0], l[1]), l[2]), lmax = fmax(fmax(l[0], l[1]), l[2]);
+    if(lmin <= 0.0 || lmax > lmin * IMU_MAGCAL_MAX_ANISOTROPY * IMU_MAGCAL_MAX_ANISOTROPY)
+    {
+        return -1;
+    }
+
+    // soft iron is the symmetric square root of A / g, it maps the ellipsoid onto the unit sphere
+    double w[3][3];
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            w[i][j] = 0.0;
+            for(int k = 0; k < 3; k++)
+            {
+                w[i][j] += v[i][k] * sqrt(l[k]) * v[j][k];
+            }
+        }
+    }
+
+    // spread of the calibrated samples around the center. a single plane of rotation
+    // leaves one direction without samples, its fit is not trusted.
+    // first and second moments of the samples are in the d_i * 1 sums and the sum of e
+    const double * sd = cal->_dtd;
+    const double zz = (cal->_e - sd[IMU_MAGCAL_DTD(0, 8)]) / 3.0;
+    const double yy = (cal->_e - sd[IMU_MAGCAL_DTD(1, 8)]) / 3.0;
+    const double xx = cal->_e - yy - zz;
+    const double mean[3] = {sd[IMU_MAGCAL_DTD(5, 8)] * 0.5 / n, sd[IMU_MAGCAL_DTD(6, 8)] * 0.5 / n, sd[IMU_MAGCAL_DTD(7, 8)] * 0.5 / n};
+    const double s[3][3] = {
+        {xx / n, sd[IMU_MAGCAL_DTD(2, 8)] * 0.5 / n, sd[IMU_MAGCAL_DTD(3, 8)] * 0.5 / n},
+        {sd[IMU_MAGCAL_DTD(2, 8)] * 0.5 / n, yy / n, sd[IMU_MAGCAL_DTD(4, 8)] * 0.5 / n},
+        {sd[IMU_MAGCAL_DTD(3, 8)] * 0.5 / n, sd[IMU_MAGCAL_DTD(4, 8)] * 0.5 / n, zz / n},
+    };
+    double cov[3][3], wc[3][3], spread[3][3];
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            cov[i][j] = s[i][j] - mean[i] * c[j] - c[i] * mean[j] + c[i] * c[j];
+        }
+    }
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            wc[i][j] = w[i][0] * cov[0][j] + w[i][1] * cov[1][j] + w[i][2] * cov[2][j];
+        }
+    }
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            spread[i][j] = wc[i][0] * w[0][j] + wc[i][1] * w[1][j] + wc[i][2] * w[2][j];
+        }
+    }
+    double sv[3][3], sl[3];
+    imu_magcal_eigen(spread, sv, sl);
+    if(fmin(fmin(sl[0], sl[1]), sl[2]) < IMU_MAGCAL_MIN_SPREAD)
+    {
+        return -1;
+    }
+
+    // back from fit coordinates (raw - origin) / scale to raw counts
+    const double k = (double)cal->_scale;
+    cal->offset = imu_vec3_create((imu_real_t)((double)cal->_origin[0] + c[0] * k),
+                                  (imu_real_t)((double)cal->_origin[1] + c[1] * k),
+                                  (imu_real_t)((double)cal->_origin[2] + c[2] * k));
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            cal->soft_iron[i][j] = (imu_real_t)(w[i][j] / k);
+        }
+    }
+    cal->field = (imu_real_t)(k / cbrt(sqrt(l[0] * l[1] * l[2])));
+    cal->valid = 1;
+    cal->fits++;
+
+    return 0;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_vec3_t imu_magcal_apply(const imu_magcal_t * cal, const imu_vec3_t * raw)
+{
+    const imu_real_t x = raw->x - cal->offset.x;
+    const imu_real_t y = raw->y - cal->offset.y;
+    const imu_real_t z = raw->z - cal->offset.z;
+    const imu_real_t (*w)[3] = cal->soft_iron;
+
+    return imu_vec3_create(w[0][0] * x + w[0][1] * y + w[0][2] * z,
+                           w[1][0] * x + w[1][1] * y + w[1][2] * z,
+                           w[2][0] * x + w[2][1] * y + w[2][2] * z);
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_magcal_set(imu_magcal_t * cal, const imu_vec3_t * offset, const imu_real_t soft_iron[3][3])
+{
+    cal->offset = *offset;
+    memcpy(cal->soft_iron, soft_iron, sizeof(cal->soft_iron));
+
+    // radius in raw counts, as a fit would report it
+    double det = soft_iron[0][0] * (soft_iron[1][1] * soft_iron[2][2] - soft_iron[1][2] * soft_iron[2][1])
+               - soft_iron[0][1] * (soft_iron[1][0] * soft_iron[2][2] - soft_iron[1][2] * soft_iron[2][0])
+               + soft_iron[0][2] * (soft_iron[1][0] * soft_iron[2][1] - soft_iron[1][1] * soft_iron[2][0]);
+    cal->field = det != 0.0 ? (imu_real_t)(1.0 / cbrt(fabs(det))) : IMU_R(0);
+    cal->valid = 1;
+}
+
+
+////////////////////////////////////////////
@@ -0,0 +1,121 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_MAGCAL_H
+#define IMU_MAGCAL_H
+
+#include <stdint.h>
+
+#include "imu_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// streaming hard/soft-iron calibration of a magnetometer. raw samples of a clean field lie on
+// an ellipsoid, x^T A x + 2 b^T x + c = 0 is fitted by least squares over the normal equations,
+// which are the only thing kept: 55 sums, no sample history, no allocation. every
+// IMU_MAGCAL_WINDOW samples the 9x9 system is solved and the sums are faded by
+// IMU_MAGCAL_FORGET, so the fit follows a changing environment.
+typedef struct imu_magcal
+{
+    // corrected = soft_iron * (raw - offset), unit length in a clean field
+    imu_vec3_t offset;
+    imu_real_t soft_iron[3][3];
+
+    // radius of the fitted field in raw counts
+    imu_real_t field;
+
+    // set once a fit passed the checks, offset and soft_iron are usable from then on
+    int8_t valid;
+
+    // number of accepted fits
+    uint32_t fits;
+
+    // normal equations, sum of d d^T (upper triangle, row by row) and sum of d e,
+    // plus the sum of e = |x|^2 for the sample moments (see imu_magcal_add())
+    double _dtd[45];
+    double _dte[9];
+    double _e;
+
+    // samples since the last fit
+    uint32_t _n;
+
+    // fit coordinates are (raw - _origin) / _scale, both taken from the first sample so the
+    // sums stay well conditioned whatever the hard-iron offset is. the sums themselves are double.
+    imu_real_t _origin[3];
+    imu_real_t _scale;
+
+} imu_magcal_t;
+
+
+////////////////////////////////////////////
+
+
+// empty calibrator, identity soft iron and zero offset until the first fit
+imu_magcal_t imu_magcal_init(void);
+
+
+////////////////////////////////////////////
+
+
+// adds one raw sample, fits every IMU_MAGCAL_WINDOW samples
+void imu_magcal_add(imu_magcal_t * cal, const imu_vec3_t * raw);
+
+
+////////////////////////////////////////////
+
+
+// solves the current normal equations. offset and soft_iron are only replaced if the
+// ellipsoid is real, not too eccentric (IMU_MAGCAL_MAX_ANISOTROPY) and the samples cover
+// enough directions around it (IMU_MAGCAL_MIN_SPREAD). returns 0 if the fit was taken.
+int imu_magcal_fit(imu_magcal_t * cal);
+
+
+////////////////////////////////////////////
+
+
+// calibrated sample, fraction of the local field strength
+imu_vec3_t imu_magcal_apply(const imu_magcal_t * cal, const imu_vec3_t * raw);
+
+
+////////////////////////////////////////////
+
+
+// known calibration, e.g. from a factory or a previous run. marks the calibrator valid.
+void imu_magcal_set(imu_magcal_t * cal, const imu_vec3_t * offset, const imu_real_t soft_iron[3][3]);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,6 +26,9 @@
 #define IMU_MATH_H
 
 #include <math.h>
+#include <stdint.h>
+
+#include "imu_types.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,22 +38,197 @@ extern "C" {
 ////////////////////////////////////////////
 
 #define PI 3.14159265359
+#define IMU_PI IMU_R(3.14159265358979323846)
+
+// in imu_real_t, float builds don't promote to double
+#define d2r(x)((x) * (IMU_PI / IMU_R(180)))
+#define r2d(x)((x) * (IMU_R(180) / IMU_PI))
+
 
-#define d2r(x)(x * PI / 180)
-#define r2d(x)(x * 180 / PI)
+////////////////////////////////////////////
+// libm functions matching imu_real_t
+
+#if defined(IMU_REAL_DOUBLE)
+#define imu_sqrt    sqrt
+#define imu_sin     sin
+#define imu_cos     cos
+#define imu_acos    acos
+#define imu_asin    asin
+#define imu_atan2   atan2
+#define imu_fabs    fabs
+#else
+#define imu_sqrt    sqrtf
+#define imu_sin     sinf
+#define imu_cos     cosf
+#define imu_acos    acosf
+#define imu_asin    asinf
+#define imu_atan2   atan2f
+#define imu_fabs    fabsf
+#endif
 
 
 ////////////////////////////////////////////
+// polynomial coefficients for approximations used by the vector kernels and fast math functions.
+// minimax fits (remez), max error measured in float arithmetic over the whole range by
+// bench/bench_fastmath.c, which fails if a bound is exceeded.
+
+// sin(x) = x + x^3 (C3 + C5 x^2 + C7 x^4 + C9 x^6), |err| < 2e-7 for |x| <= PI / 2
+#define IMU_MATH_SIN_C3     -1.66666596e-1f
+#define IMU_MATH_SIN_C5      8.33306625e-3f
+#define IMU_MATH_SIN_C7     -1.98096029e-4f
+#define IMU_MATH_SIN_C9      2.60578064e-6f
+
+// cos(x) = 1 + x^2 (C2 + C4 x^2 + C6 x^4 + C8 x^6), |err| < 2e-7 for |x| <= PI / 2
+#define IMU_MATH_COS_C2     -4.99999323e-1f
+#define IMU_MATH_COS_C4      4.16639895e-2f
+#define IMU_MATH_COS_C6     -1.38559272e-3f
+#define IMU_MATH_COS_C8      2.31943865e-5f
+
+// acos(x) = sqrt(1 - x) * (A0 + A1 x + ... + A7 x^7), |err| < 6e-7 for 0 <= x <= 1.
+// negative x: acos(x) = PI - acos(-x)
+#define IMU_MATH_ACOS_A0     1.57079631e+0f
+#define IMU_MATH_ACOS_A1    -2.14599892e-1f
+#define IMU_MATH_ACOS_A2     8.89992649e-2f
+#define IMU_MATH_ACOS_A3    -5.03127849e-2f
+#define IMU_MATH_ACOS_A4     3.13354721e-2f
+#define IMU_MATH_ACOS_A5    -1.78089872e-2f
+#define IMU_MATH_ACOS_A6     7.24545054e-3f
+#define IMU_MATH_ACOS_A7    -1.44148068e-3f
+
+// atan(x) = x (T1 + T3 x^2 + ... + T15 x^14), |err| < 4e-7 for |x| <= 1 (abramowitz & stegun 4.4.49).
+// atan2() reduces to it with the smaller of |x|, |y| over the larger.
+#define IMU_MATH_ATAN_T1     9.99999333e-1f
+#define IMU_MATH_ATAN_T3    -3.33298561e-1f
+#define IMU_MATH_ATAN_T5     1.99465360e-1f
+#define IMU_MATH_ATAN_T7    -1.39085335e-1f
+#define IMU_MATH_ATAN_T9     9.64200441e-2f
+#define IMU_MATH_ATAN_T11   -5.59098861e-2f
+#define IMU_MATH_ATAN_T13    2.18612288e-2f
+#define IMU_MATH_ATAN_T15   -4.05405800e-3f
+
+
+////////////////////////////////////////////
+// fast math functions, inline so that the filter step pays no call for them. terms are summed
+// in pairs (estrin) instead of horner, for a shorter dependency chain.
 
 
 /// fast inverse sqrt algorithm from Quake III Arena source (copy-paste).
-float imu_math_fast_inv_sqrt(float n);
+/// double builds use the 64 bit magic constant.
+static inline imu_real_t imu_math_fast_inv_sqrt(imu_real_t n)
+{
+#if defined(IMU_REAL_DOUBLE)
+    // same trick with the 64 bit magic number
+    union { double f; int64_t i; } u;
+    double x2;
+    const double threehalfs = 1.5;
+
+    x2  = n * 0.5;
+    u.f = n;
+    u.i = 0x5fe6eb50c7b537a9 - ( u.i >> 1 );
+    u.f = u.f * ( threehalfs - ( x2 * u.f * u.f ) ); // 1st iteration
+#else
+    // int32_t through a union: a long is 8 bytes on LP64 and picked up garbage next to y.
+    union { float f; int32_t i; } u;
+    float x2;
+    const float threehalfs = 1.5F;
+
+    x2  = n * 0.5F;
+    u.f = n;
+    u.i = 0x5f3759df - ( u.i >> 1 );             // evil floating point bit level hacking
+    u.f = u.f * ( threehalfs - ( x2 * u.f * u.f ) ); // 1st iteration
+#endif
+
+    return u.f;
+}
+
+
+////////////////////////////////////////////
+
+
+/// polynomial sin, |err| < 2e-7 for |x| <= PI / 2. meant for small angles.
+static inline imu_real_t imu_math_fast_sin(imu_real_t x)
+{
+    imu_real_t x2 = x * x;
+    imu_real_t x4 = x2 * x2;
+    imu_real_t p = (IMU_R(IMU_MATH_SIN_C3) + IMU_R(IMU_MATH_SIN_C5) * x2)
+        + (IMU_R(IMU_MATH_SIN_C7) + IMU_R(IMU_MATH_SIN_C9) * x2) * x4;
+    return x + p * x2 * x;
+}
+
+
+////////////////////////////////////////////
+
+
+/// polynomial cos, |err| < 2e-7 for |x| <= PI / 2. meant for small angles.
+static inline imu_real_t imu_math_fast_cos(imu_real_t x)
+{
+    imu_real_t x2 = x * x;
+    imu_real_t x4 = x2 * x2;
+    imu_real_t p = (IMU_R(IMU_MATH_COS_C2) + IMU_R(IMU_MATH_COS_C4) * x2)
+        + (IMU_R(IMU_MATH_COS_C6) + IMU_R(IMU_MATH_COS_C8) * x2) * x4;
+    return IMU_R(1) + p * x2;
+}
+
+
+////////////////////////////////////////////
+
+
+/// polynomial acos, |err| < 6e-7. x is clamped to [-1, 1].
+static inline imu_real_t imu_math_fast_acos(imu_real_t x)
+{
+    // a compare instead of fmin(), which stays a libm call without -ffast-math
+    imu_real_t ax = imu_fabs(x);
+    ax = ax < IMU_R(1) ? ax : IMU_R(1);
+    imu_real_t ax2 = ax * ax;
+    imu_real_t ax4 = ax2 * ax2;
+    imu_real_t p = (IMU_R(IMU_MATH_ACOS_A0) + IMU_R(IMU_MATH_ACOS_A1) * ax)
+        + (IMU_R(IMU_MATH_ACOS_A2) + IMU_R(IMU_MATH_ACOS_A3) * ax) * ax2
+        + ((IMU_R(IMU_MATH_ACOS_A4) + IMU_R(IMU_MATH_ACOS_A5) * ax) + (IMU_R(IMU_MATH_ACOS_A6) + IMU_R(IMU_MATH_ACOS_A7) * ax) * ax2) * ax4;
+    imu_real_t r = imu_sqrt(IMU_R(1) - ax) * p;
+    return x < IMU_R(0) ? IMU_PI - r : r;
+}
+
+
+////////////////////////////////////////////
+
+
+/// polynomial asin, pi / 2 - acos(x), |err| < 6e-7. x is clamped to [-1, 1].
+static inline imu_real_t imu_math_fast_asin(imu_real_t x)
+{
+    return IMU_PI / 2 - imu_math_fast_acos(x);
+}
+
+
+////////////////////////////////////////////
+
+
+/// polynomial atan2, |err| < 4e-7. 0 for x = y = 0.
+static inline imu_real_t imu_math_fast_atan2(imu_real_t y, imu_real_t x)
+{
+    imu_real_t ax = imu_fabs(x), ay = imu_fabs(y);
+    imu_real_t hi = ax > ay ? ax : ay, lo = ax > ay ? ay : ax;
+    if(hi == IMU_R(0))
+    {
+        return IMU_R(0);
+    }
+
+    imu_real_t t = lo / hi;
+    imu_real_t t2 = t * t;
+    imu_real_t t4 = t2 * t2;
+    imu_real_t t8 = t4 * t4;
+    imu_real_t p = ((IMU_R(IMU_MATH_ATAN_T1) + IMU_R(IMU_MATH_ATAN_T3) * t2) + (IMU_R(IMU_MATH_ATAN_T5) + IMU_R(IMU_MATH_ATAN_T7) * t2) * t4)
+        + ((IMU_R(IMU_MATH_ATAN_T9) + IMU_R(IMU_MATH_ATAN_T11) * t2) + (IMU_R(IMU_MATH_ATAN_T13) + IMU_R(IMU_MATH_ATAN_T15) * t2) * t4) * t8;
+    imu_real_t a = t * p;
+    a = ay > ax ? IMU_PI / 2 - a : a;
+    a = x < IMU_R(0) ? IMU_PI - a : a;
+    return y < IMU_R(0) ? -a : a;
+}
 
 
 ////////////////////////////////////////////
 
 
-float imu_math_map_value(float value, float min, float max, float mapped_min, float mapped_max);
+imu_real_t imu_math_map_value(imu_real_t value, imu_real_t min, imu_real_t max, imu_real_t mapped_min, imu_real_t mapped_max);
 
 
 ////////////////////////////////////////////
@@ -0,0 +1,160 @@
+#include "imu_merge.h"
+#include "imu_algebra.h"
+
+#include <string.h>
+
+////////////////////////////////////////////
+
+
+imu_merge_t imu_merge_init(void)
+{
+    imu_merge_t m;
+    memset(&m, 0, sizeof(m));
+
+    return m;
+}
+
+
+////////////////////////////////////////////
+
+
+static int imu_merge_push(imu_merge_t * m, int8_t sensor, double ts, imu_real_t x, imu_real_t y, imu_real_t z)
+{
+    imu_merge_ring_t * r = &m->_rings[sensor];
+
+    if(r->head - r->tail >= IMU_MERGE_CAPACITY || (r->active && ts < r->latest) || ts < m->_released)
+    {
+        m->dropped++;
+        return -1;
+    }
+
+    imu_merge_entry_t * e = &r->entries[r->head & (IMU_MERGE_CAPACITY - 1)];
+    e->ts = ts;
+    e->raw = imu_vec3_create(x, y, z);
+    r->head++;
+    r->latest = ts;
+    r->active = 1;
+    return 0;
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_merge_push_gyro(imu_merge_t * m, double ts, imu_real_t gx, imu_real_t gy, imu_real_t gz)
+{
+    return imu_merge_push(m, IMU_MERGE_GYRO, ts, gx, gy, gz);
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_merge_push_accelerometer(imu_merge_t * m, double ts, imu_real_t ax, imu_real_t ay, imu_real_t az)
+{
+    return imu_merge_push(m, IMU_MERGE_ACCELEROMETER, ts, ax, ay, az);
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_merge_push_magnetometer(imu_merge_t * m, double ts, imu_real_t mx, imu_real_t my, imu_real_t mz)
+{
+    return imu_merge_push(m, IMU_MERGE_MAGNETOMETER, ts, mx, my, mz);
+}
+
+
+////////////////////////////////////////////
+
+
+static size_t imu_merge_run(imu_merge_t * m, imu_t * imu, imu_quaternion_t * out, size_t max, int8_t flush)
+{
+    size_t steps = 0;
+
+    while(steps < max)
+    {
+        // oldest queued sample. rings are in time order, so it is one of the heads.
+        // on equal timestamps the gyro goes last, its step uses the other samples.
+        int8_t next = -1;
+        double ts = 0.0;
+        for(int8_t s = IMU_MERGE_SENSORS - 1; s >= 0; s--)
+        {
+            const imu_merge_ring_t * r = &m->_rings[s];
+            if(r->head != r->tail && (next < 0 || r->entries[r->tail & (IMU_MERGE_CAPACITY - 1)].ts < ts))
+            {
+                next = s;
+                ts = r->entries[r->tail & (IMU_MERGE_CAPACITY - 1)].ts;
+            }
+        }
+        if(next < 0)
+        {
+            break;
+        }
+
+        imu_merge_ring_t * r = &m->_rings[next];
+        if(!flush && r->head - r->tail < IMU_MERGE_CAPACITY / 2)
+        {
+            // an empty sensor may still deliver something older, unless it is past ts already
+            int8_t ready = 1;
+            for(int8_t s = 0; s < IMU_MERGE_SENSORS; s++)
+            {
+                const imu_merge_ring_t * o = &m->_rings[s];
+                if(o->active && o->head == o->tail && o->latest < ts)
+                {
+                    ready = 0;
+                }
+            }
+            if(!ready)
+            {
+                break;
+            }
+        }
+
+        const imu_merge_entry_t * e = &r->entries[r->tail & (IMU_MERGE_CAPACITY - 1)];
+        switch(next)
+        {
+        case IMU_MERGE_GYRO:
+            imu_set_gyro_raw(imu, e->raw.x, e->raw.y, e->raw.z);
+            imu_main_loop_ts(imu, e->ts);
+            if(out)
+            {
+                out[steps] = imu->orientation_quat;
+            }
+            steps++;
+            break;
+        case IMU_MERGE_ACCELEROMETER:
+            imu_set_accelerometer_raw(imu, e->raw.x, e->raw.y, e->raw.z);
+            break;
+        default:
+            imu_set_magnetometer_raw(imu, e->raw.x, e->raw.y, e->raw.z);
+            break;
+        }
+
+        m->_released = ts;
+        r->tail++;
+    }
+
+    return steps;
+}
+
+
+////////////////////////////////////////////
+
+
+size_t imu_merge_process(imu_merge_t * m, imu_t * imu, imu_quaternion_t * out, size_t max)
+{
+    return imu_merge_run(m, imu, out, max, 0);
+}
+
+
+////////////////////////////////////////////
+
+
+size_t imu_merge_flush(imu_merge_t * m, imu_t * imu, imu_quaternion_t * out, size_t max)
+{
+    return imu_merge_run(m, imu, out, max, 1);
+}
+
+
+////////////////////////////////////////////
@@ -0,0 +1,134 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_MERGE_H
+#define IMU_MERGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// samples held per sensor, power of two
+#define IMU_MERGE_CAPACITY      64
+
+#define IMU_MERGE_GYRO          0x00
+#define IMU_MERGE_ACCELEROMETER 0x01
+#define IMU_MERGE_MAGNETOMETER  0x02
+#define IMU_MERGE_SENSORS       0x03
+
+
+// one timestamped raw reading of a single sensor
+typedef struct imu_merge_entry
+{
+    double ts;
+    imu_vec3_t raw;
+
+} imu_merge_entry_t;
+
+
+// per sensor fifo, samples arrive in time order within a sensor
+typedef struct imu_merge_ring
+{
+    imu_merge_entry_t entries[IMU_MERGE_CAPACITY];
+    uint32_t head, tail;
+
+    // timestamp of the latest push, no sample older than this can come from the sensor anymore.
+    // a sensor that never pushed doesn't hold the others back.
+    double latest;
+    int8_t active;
+
+} imu_merge_ring_t;
+
+
+// merges gyro, accelerometer and magnetometer streams running at their own output data rates
+// (separate fifos, different rates, read at different times) into one time ordered stream for
+// imu_t. every gyro sample is one filter step at its own timestamp. accelerometer and
+// magnetometer samples only update the raw values the next gyro step uses, and the filter
+// corrects once per new sample instead of on every step (see imu_set_accelerometer_raw()).
+// fixed size, no allocation, single thread.
+typedef struct imu_merge
+{
+    imu_merge_ring_t _rings[IMU_MERGE_SENSORS];
+
+    // timestamp of the last sample fed to the filter
+    double _released;
+
+    // samples refused because their sensor's ring was full, or older than what was already fed
+    size_t dropped;
+
+} imu_merge_t;
+
+
+////////////////////////////////////////////
+
+
+imu_merge_t imu_merge_init(void);
+
+
+////////////////////////////////////////////
+
+
+// queue one sample of a sensor, ts in seconds on a time base shared by all sensors.
+// returns 0, or -1 if the sample was dropped: its ring is full, or it is older than the
+// previous sample of the same sensor or than a sample already fed to the filter.
+int imu_merge_push_gyro(imu_merge_t * m, double ts, imu_real_t gx, imu_real_t gy, imu_real_t gz);
+int imu_merge_push_accelerometer(imu_merge_t * m, double ts, imu_real_t ax, imu_real_t ay, imu_real_t az);
+int imu_merge_push_magnetometer(imu_merge_t * m, double ts, imu_real_t mx, imu_real_t my, imu_real_t mz);
+
+
+////////////////////////////////////////////
+
+
+// feeds queued samples to imu in time order, as far as every sensor that has pushed so far
+// has caught up: a sample is released once no sensor can deliver an older one. a sensor that
+// stalls holds the others back until their rings are half full. runs at most max gyro steps,
+// the rest stays queued. out receives the orientation after each of them and may be NULL.
+// returns the number of gyro steps.
+size_t imu_merge_process(imu_merge_t * m, imu_t * imu, imu_quaternion_t * out, size_t max);
+
+
+////////////////////////////////////////////
+
+
+// feeds everything queued, e.g. at the end of a recording.
+size_t imu_merge_flush(imu_merge_t * m, imu_t * imu, imu_quaternion_t * out, size_t max);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,229 @@
+#include "imu_pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+////////////////////////////////////////////
+
+
+typedef struct imu_pool_shared imu_pool_shared_t;
+
+
+typedef struct imu_pool_worker
+{
+    imu_pool_shared_t * shared;
+    size_t begin, end;
+    pthread_t thread;
+} imu_pool_worker_t;
+
+
+struct imu_pool_shared
+{
+    imu_t * imus;
+
+    // every step passes it twice: samples published, shards done
+    pthread_barrier_t barrier;
+
+    // workers wait here until all of them are started: 1 go, -1 exit
+    pthread_mutex_t gate_mutex;
+    pthread_cond_t gate;
+    int8_t started;
+
+    // samples of the current step, NULL tells the workers to exit
+    const imu_sample_t * samples;
+
+    imu_pool_worker_t workers[];
+};
+
+
+////////////////////////////////////////////
+
+
+static void imu_pool_run_shard(imu_pool_worker_t * w)
+{
+    const imu_sample_t * samples = w->shared->samples;
+    for(size_t i = w->begin; i < w->end; i++)
+    {
+        imu_process_batch(&w->shared->imus[i], &samples[i], 1, NULL);
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+static void * imu_pool_worker_main(void * arg)
+{
+    imu_pool_worker_t * w = arg;
+    imu_pool_shared_t * shared = w->shared;
+
+    pthread_mutex_lock(&shared->gate_mutex);
+    while(shared->started == 0)
+    {
+        pthread_cond_wait(&shared->gate, &shared->gate_mutex);
+    }
+    int8_t started = shared->started;
+    pthread_mutex_unlock(&shared->gate_mutex);
+
+    if(started < 0)
+    {
+        return NULL;
+    }
+
+    for(;;)
+    {
+        pthread_barrier_wait(&w->shared->barrier);
+        if(!w->shared->samples)
+        {
+            break;
+        }
+
+        imu_pool_run_shard(w);
+        pthread_barrier_wait(&w->shared->barrier);
+    }
+
+    return NULL;
+}
+
+
+////////////////////////////////////////////
+
+
+imu_pool_t imu_pool_init(imu_t * imus, size_t count, size_t threads)
+{
+    imu_pool_t pool;
+    memset(&pool, 0, sizeof(pool));
+
+    if(threads == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if(threads > count)
+    {
+        threads = count > 0 ? count : 1;
+    }
+
+    imu_pool_shared_t * shared = malloc(sizeof(imu_pool_shared_t) + threads * sizeof(imu_pool_worker_t));
+    if(!shared || pthread_barrier_init(&shared->barrier, NULL, threads) != 0)
+    {
+        prerr("cannot create imu pool of %zu threads", threads);
+        free(shared);
+        return pool;
+    }
+
+    shared->imus = imus;
+    shared->samples = NULL;
+    shared->started = 0;
+    pthread_mutex_init(&shared->gate_mutex, NULL);
+    pthread_cond_init(&shared->gate, NULL);
+
+    // shard sizes differ by at most one imu
+    for(size_t t = 0; t < threads; t++)
+    {
+        shared->workers[t].shared = shared;
+        shared->workers[t].begin = count * t / threads;
+        shared->workers[t].end = count * (t + 1) / threads;
+    }
+
+    // worker 0 is the calling thread
+    size_t t = 1;
+    for(; t < threads; t++)
+    {
+        if(pthread_create(&shared->workers[t].thread, NULL, imu_pool_worker_main, &shared->workers[t]) != 0)
+        {
+            prerr("cannot start imu pool worker %zu", t);
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&shared->gate_mutex);
+    shared->started = t == threads ? 1 : -1;
+    pthread_cond_broadcast(&shared->gate);
+    pthread_mutex_unlock(&shared->gate_mutex);
+
+    if(t != threads)
+    {
+        // the barrier can't be passed without all threads, started workers exit at the gate
+        for(size_t j = 1; j < t; j++)
+        {
+            pthread_join(shared->workers[j].thread, NULL);
+        }
+        pthread_cond_destroy(&shared->gate);
+        pthread_mutex_destroy(&shared->gate_mutex);
+        pthread_barrier_destroy(&shared->barrier);
+        free(shared);
+        return pool;
+    }
+
+    pool.imus = imus;
+    pool.count = count;
+    pool.threads = threads;
+    pool._shared = shared;
+
+    return pool;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_pool_free(imu_pool_t * pool)
+{
+    imu_pool_shared_t * shared = pool->_shared;
+    if(!shared)
+    {
+        return;
+    }
+
+    shared->samples = NULL;
+    if(pool->threads > 1)
+    {
+        pthread_barrier_wait(&shared->barrier);
+    }
+
+    for(size_t t = 1; t < pool->threads; t++)
+    {
+        pthread_join(shared->workers[t].thread, NULL);
+    }
+
+    pthread_cond_destroy(&shared->gate);
+    pthread_mutex_destroy(&shared->gate_mutex);
+    pthread_barrier_destroy(&shared->barrier);
+    free(shared);
+    memset(pool, 0, sizeof(*pool));
+}
+
+
+////////////////////////////////////////////
+
+
+int imu_pool_step(imu_pool_t * pool, const imu_sample_t * samples)
+{
+    imu_pool_shared_t * shared = pool->_shared;
+    if(!shared)
+    {
+        prerr("imu pool isn't running, imu_pool_init() failed or the pool was freed");
+        return -1;
+    }
+
+    // barriers order the samples pointer and the imu states between threads
+    shared->samples = samples;
+    if(pool->threads > 1)
+    {
+        pthread_barrier_wait(&shared->barrier);
+    }
+
+    imu_pool_run_shard(&shared->workers[0]);
+
+    if(pool->threads > 1)
+    {
+        pthread_barrier_wait(&shared->barrier);
+    }
+    return 0;
+}
+
+
+////////////////////////////////////////////
@@ -0,0 +1,94 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_POOL_H
+#define IMU_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// steps a set of imu_t in parallel. imus are split into contiguous shards, one per thread,
+// and every shard is always processed by the same thread. the calling thread works on the
+// first shard, so a pool of n threads starts n - 1 workers.
+//
+// imu_pool_step() returns when every imu has processed its sample. between steps the
+// caller owns all imus again and can read or modify them without locking.
+typedef struct imu_pool
+{
+    // imus stepped by the pool, not owned
+    imu_t * imus;
+
+    // number of imus
+    size_t count;
+
+    // number of threads including the caller
+    size_t threads;
+
+    // workers, barrier and the samples of the current step
+    void * _shared;
+
+} imu_pool_t;
+
+
+////////////////////////////////////////////
+
+
+// starts a pool over imus[0 .. count). threads = 0 uses one thread per online cpu, at most
+// one per imu. on failure threads of the returned pool is 0.
+imu_pool_t imu_pool_init(imu_t * imus, size_t count, size_t threads);
+
+
+////////////////////////////////////////////
+
+
+// stops and joins the workers. imus are left as they are.
+void imu_pool_free(imu_pool_t * pool);
+
+
+////////////////////////////////////////////
+
+
+// runs imu_process_batch() with samples[i] on imus[i] for every imu, in parallel.
+// returns 0, or -1 and does nothing on a pool that failed to start or was freed.
+int imu_pool_step(imu_pool_t * pool, const imu_sample_t * samples);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,86 @@
+#include "imu_publisher.h"
+
+#include <string.h>
+
+////////////////////////////////////////////
+
+
+typedef union imu_publisher_record
+{
+    imu_snapshot_t snapshot;
+    uint32_t words[IMU_PUBLISHER_WORDS];
+} imu_publisher_record_t;
+
+
+////////////////////////////////////////////
+
+
+imu_publisher_t imu_publisher_init(void)
+{
+    imu_publisher_t pub;
+    memset(&pub, 0, sizeof(pub));
+
+    imu_publisher_record_t r;
+    memset(&r, 0, sizeof(r));
+    r.snapshot.orientation_quat = imu_quaternion_create(IMU_R(1), IMU_R(0), IMU_R(0), IMU_R(0));
+    r.snapshot.state = IMU_STATE_UNCALIBRATED;
+    memcpy(pub._words, r.words, sizeof(r.words));
+
+    return pub;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_publish(imu_publisher_t * pub, const imu_t * imu)
+{
+    imu_publisher_record_t r;
+    memset(&r, 0, sizeof(r));
+    r.snapshot.orientation_quat = imu->orientation_quat;
+    r.snapshot.orientation = imu_get_euler(imu);
+    r.snapshot.ts = imu->_gyro_ts;
+    r.snapshot.state = imu->state;
+
+    // odd sequence first, release fence keeps the words from moving above it
+    uint32_t seq = __atomic_load_n(&pub->_seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&pub->_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for(size_t i = 0; i < IMU_PUBLISHER_WORDS; i++)
+    {
+        __atomic_store_n(&pub->_words[i], r.words[i], __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&pub->_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+////////////////////////////////////////////
+
+
+imu_snapshot_t imu_publisher_read(const imu_publisher_t * pub)
+{
+    imu_publisher_record_t r;
+    uint32_t begin, end;
+
+    do
+    {
+        begin = __atomic_load_n(&pub->_seq, __ATOMIC_ACQUIRE);
+
+        for(size_t i = 0; i < IMU_PUBLISHER_WORDS; i++)
+        {
+            r.words[i] = __atomic_load_n(&pub->_words[i], __ATOMIC_RELAXED);
+        }
+
+        // acquire fence keeps the words from moving below the second sequence read
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&pub->_seq, __ATOMIC_RELAXED);
+    }
+    while((begin & 1) || begin != end);
+
+    return r.snapshot;
+}
+
+
+////////////////////////////////////////////
@@ -0,0 +1,102 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_PUBLISHER_H
+#define IMU_PUBLISHER_H
+
+#include <stdint.h>
+
+#include "imu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// consistent copy of the output of one imu_t update
+typedef struct imu_snapshot
+{
+    imu_quaternion_t orientation_quat;
+    imu_euler_t orientation;
+
+    // imu_t::_gyro_ts of the update, same time base as the filter
+    double ts;
+
+    int8_t state;
+
+} imu_snapshot_t;
+
+
+////////////////////////////////////////////
+
+
+#define IMU_PUBLISHER_WORDS ((sizeof(imu_snapshot_t) + sizeof(uint32_t) - 1) / sizeof(uint32_t))
+
+
+// hands snapshots from the thread that steps an imu_t to any number of reader threads without
+// locks (seqlock). one writer calls imu_publish() after every update, readers call
+// imu_publisher_read(). publishing never waits, a read retries while a publish is in progress.
+// aligned to its own cache lines so neighbouring data doesn't slow readers down.
+typedef struct imu_publisher
+{
+    // odd while a snapshot is being written
+    uint32_t _seq;
+
+    // imu_snapshot_t, stored word by word with atomic accesses
+    uint32_t _words[IMU_PUBLISHER_WORDS];
+
+} __attribute__((aligned(64))) imu_publisher_t;
+
+
+////////////////////////////////////////////
+
+
+imu_publisher_t imu_publisher_init(void);
+
+
+////////////////////////////////////////////
+
+
+// publishes the current output of imu. only one thread may publish to a publisher.
+void imu_publish(imu_publisher_t * pub, const imu_t * imu);
+
+
+////////////////////////////////////////////
+
+
+// latest published snapshot, never torn. callable from any thread.
+imu_snapshot_t imu_publisher_read(const imu_publisher_t * pub);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
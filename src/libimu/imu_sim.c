@@ -0,0 +1,276 @@
+#include "imu_sim.h"
+#include "imu_algebra.h"
+#include "imu_math.h"
+
+#include <math.h>
+#include <string.h>
+
+// midpoint rotations per sample period the ground truth is integrated with
+#define IMU_SIM_SUBSTEPS    16
+
+////////////////////////////////////////////
+
+
+imu_sim_t imu_sim_init(double rate, double duration)
+{
+    imu_sim_t sim;
+    memset(&sim, 0, sizeof(sim));
+
+    sim.rate = rate;
+    sim.duration = duration;
+    // mpu6050 at ±500 deg/s and ±4 g
+    sim.scale_factor_gyro = 2.0 / 131.0;
+    sim.scale_factor_accelerometer = 2.0 / 16384.0;
+    sim.motion = IMU_SIM_STATIC;
+    sim.magnetic_field[0] = 25.0;
+    sim.magnetic_field[2] = -43.3;
+    sim.scale_factor_magnetometer = 0.15;
+    sim.soft_iron[0] = sim.soft_iron[4] = sim.soft_iron[8] = 1.0;
+    sim.quantize = 1;
+    sim.seed = 1;
+
+    return sim;
+}
+
+
+////////////////////////////////////////////
+
+
+size_t imu_sim_count(const imu_sim_t * sim)
+{
+    return (size_t)(sim->rate * sim->duration);
+}
+
+
+////////////////////////////////////////////
+
+
+static void imu_sim_rate(const imu_sim_t * sim, double t, double w[3])
+{
+    const double a = sim->amplitude, f = sim->frequency;
+
+    switch(sim->motion)
+    {
+    case IMU_SIM_SPIN:
+        w[0] = 0.0;
+        w[1] = 0.0;
+        w[2] = a;
+        break;
+    case IMU_SIM_TILT:
+        w[0] = a * sin(2.0 * PI * f * t);
+        w[1] = a * (2.0 / 3.0) * cos(2.0 * PI * 0.6 * f * t);
+        w[2] = a / 3.0;
+        break;
+    case IMU_SIM_TUMBLE:
+        w[0] = a * sin(2.0 * PI * f * t);
+        w[1] = a * 0.72;
+        w[2] = a * 1.6;
+        break;
+    default:
+        w[0] = w[1] = w[2] = 0.0;
+        break;
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+// xorshift32, the generator has to be reproducible and free of global state
+static double imu_sim_uniform(uint32_t * state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (x + 0.5) / 4294967296.0;
+}
+
+
+// standard normal (box-muller)
+static double imu_sim_gauss(uint32_t * state)
+{
+    double u1 = imu_sim_uniform(state), u2 = imu_sim_uniform(state);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * PI * u2);
+}
+
+
+////////////////////////////////////////////
+
+
+static imu_real_t imu_sim_counts(const imu_sim_t * sim, double value)
+{
+    if(sim->quantize)
+    {
+        value = fmin(fmax(round(value), -32768.0), 32767.0);
+    }
+    return (imu_real_t)value;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_sim_generate(const imu_sim_t * sim, imu_sample_t * samples, imu_quaternion_t * truth)
+{
+    size_t n = imu_sim_count(sim);
+    double h = sim->tilt * (PI / 360.0);
+    double qw = cos(h), qx = sin(h), qy = 0.0, qz = 0.0;
+    double dt = 1.0 / sim->rate;
+    uint32_t state = sim->seed ? sim->seed : 1;
+
+    for(size_t i = 0; i < n; i++)
+    {
+        double t = i * dt;
+        double w[3];
+        if(sim->rate_fn)
+        {
+            sim->rate_fn(t, w, sim->user);
+        }
+        else
+        {
+            imu_sim_rate(sim, t, w);
+        }
+
+        // truth follows the rate between samples too, so it is the orientation of the
+        // continuous motion and not the result of one integrator or another
+        for(int k = 0; i > 0 && k < IMU_SIM_SUBSTEPS; k++)
+        {
+            double ws[3];
+            double ts = t - dt + (k + 0.5) * (dt / IMU_SIM_SUBSTEPS);
+            if(sim->rate_fn)
+            {
+                sim->rate_fn(ts, ws, sim->user);
+            }
+            else
+            {
+                imu_sim_rate(sim, ts, ws);
+            }
+
+            double wl = sqrt(ws[0] * ws[0] + ws[1] * ws[1] + ws[2] * ws[2]);
+            double a = wl * (dt / IMU_SIM_SUBSTEPS) * (PI / 360.0);
+            double s = wl > 0.0 ? sin(a) / wl : 0.0;
+            double dw = cos(a), dx = ws[0] * s, dy = ws[1] * s, dz = ws[2] * s;
+            double nw = qw * dw - qx * dx - qy * dy - qz * dz;
+            double nx = qw * dx + qx * dw + qy * dz - qz * dy;
+            double ny = qw * dy - qx * dz + qy * dw + qz * dx;
+            double nz = qw * dz + qx * dy - qy * dx + qz * dw;
+            double len = sqrt(nw * nw + nx * nx + ny * ny + nz * nz);
+            qw = nw / len; qx = nx / len; qy = ny / len; qz = nz / len;
+        }
+
+        // gravity (0, 0, 1 g) in body frame is the third row of the rotation matrix
+        double g[3] = {
+            2.0 * (qx * qz - qw * qy),
+            2.0 * (qy * qz + qw * qx),
+            1.0 - 2.0 * (qx * qx + qy * qy),
+        };
+
+        double vib = sim->vibration * sin(2.0 * PI * sim->vibration_frequency * t);
+        g[0] += vib;
+        g[1] += vib;
+
+        for(int k = 0; k < 3; k++)
+        {
+            g[k] += sim->accelerometer_noise * imu_sim_gauss(&state);
+            w[k] += sim->gyro_bias[k] + sim->gyro_drift[k] * t + sim->gyro_noise * imu_sim_gauss(&state);
+        }
+
+        samples[i].ax = imu_sim_counts(sim, g[0] / sim->scale_factor_accelerometer);
+        samples[i].ay = imu_sim_counts(sim, g[1] / sim->scale_factor_accelerometer);
+        samples[i].az = imu_sim_counts(sim, g[2] / sim->scale_factor_accelerometer);
+        samples[i].gx = imu_sim_counts(sim, w[0] / sim->scale_factor_gyro);
+        samples[i].gy = imu_sim_counts(sim, w[1] / sim->scale_factor_gyro);
+        samples[i].gz = imu_sim_counts(sim, w[2] / sim->scale_factor_gyro);
+        samples[i].ts = t;
+
+        if(truth)
+        {
+            truth[i] = imu_quaternion_create((imu_real_t)qw, (imu_real_t)qx, (imu_real_t)qy, (imu_real_t)qz);
+        }
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_sim_magnetometer(const imu_sim_t * sim, const imu_quaternion_t * truth, size_t n, imu_vec3_t * out)
+{
+    const double * b = sim->magnetic_field;
+    const double * si = sim->soft_iron;
+    uint32_t state = (sim->seed ? sim->seed : 1) ^ 0x9e3779b9u;
+
+    for(size_t i = 0; i < n; i++)
+    {
+        const double qw = truth[i].w, qx = truth[i].x, qy = truth[i].y, qz = truth[i].z;
+
+        // world field in body frame, R^T b
+        double m[3] = {
+            (1.0 - 2.0 * (qy * qy + qz * qz)) * b[0] + 2.0 * (qx * qy + qw * qz) * b[1] + 2.0 * (qx * qz - qw * qy) * b[2],
+            2.0 * (qx * qy - qw * qz) * b[0] + (1.0 - 2.0 * (qx * qx + qz * qz)) * b[1] + 2.0 * (qy * qz + qw * qx) * b[2],
+            2.0 * (qx * qz + qw * qy) * b[0] + 2.0 * (qy * qz - qw * qx) * b[1] + (1.0 - 2.0 * (qx * qx + qy * qy)) * b[2],
+        };
+
+        double r[3];
+        for(int k = 0; k < 3; k++)
+        {
+            r[k] = si[3 * k] * m[0] + si[3 * k + 1] * m[1] + si[3 * k + 2] * m[2] + sim->hard_iron[k]
+                 + sim->magnetometer_noise * imu_sim_gauss(&state);
+        }
+
+        out[i] = imu_vec3_create(imu_sim_counts(sim, r[0] / sim->scale_factor_magnetometer),
+                                 imu_sim_counts(sim, r[1] / sim->scale_factor_magnetometer),
+                                 imu_sim_counts(sim, r[2] / sim->scale_factor_magnetometer));
+    }
+}
+
+
+////////////////////////////////////////////
+
+
+imu_sim_error_t imu_sim_error(const imu_quaternion_t * estimate, const imu_quaternion_t * truth, size_t n, size_t skip)
+{
+    imu_sim_error_t err = {0.0, 0.0, 0.0, 0.0};
+    if(skip >= n)
+    {
+        return err;
+    }
+
+    for(size_t i = skip; i < n; i++)
+    {
+        const double aw = estimate[i].w, ax = estimate[i].x, ay = estimate[i].y, az = estimate[i].z;
+        const double bw = truth[i].w, bx = truth[i].x, by = truth[i].y, bz = truth[i].z;
+        const double aa = aw * aw + ax * ax + ay * ay + az * az;
+        const double bb = bw * bw + bx * bx + by * by + bz * bz;
+
+        // rotation between both, conj(a) * b. atan2 keeps small angles exact where acos of a
+        // dot product close to 1 would round them away.
+        double rw = aw * bw + ax * bx + ay * by + az * bz;
+        double rx = aw * bx - ax * bw - ay * bz + az * by;
+        double ry = aw * by + ax * bz - ay * bw - az * bx;
+        double rz = aw * bz - ax * by + ay * bx - az * bw;
+        double angle = 2.0 * atan2(sqrt(rx * rx + ry * ry + rz * rz), fabs(rw));
+
+        // gravity in both body frames
+        double ga[3] = {2.0 * (ax * az - aw * ay) / aa, 2.0 * (ay * az + aw * ax) / aa, 1.0 - 2.0 * (ax * ax + ay * ay) / aa};
+        double gb[3] = {2.0 * (bx * bz - bw * by) / bb, 2.0 * (by * bz + bw * bx) / bb, 1.0 - 2.0 * (bx * bx + by * by) / bb};
+        double cx = ga[1] * gb[2] - ga[2] * gb[1];
+        double cy = ga[2] * gb[0] - ga[0] * gb[2];
+        double cz = ga[0] * gb[1] - ga[1] * gb[0];
+        double tilt = atan2(sqrt(cx * cx + cy * cy + cz * cz), ga[0] * gb[0] + ga[1] * gb[1] + ga[2] * gb[2]);
+
+        err.rms += angle * angle;
+        err.max = fmax(err.max, angle);
+        err.tilt_rms += tilt * tilt;
+        err.tilt_max = fmax(err.tilt_max, tilt);
+    }
+
+    err.rms = sqrt(err.rms / (n - skip));
+    err.tilt_rms = sqrt(err.tilt_rms / (n - skip));
+    return err;
+}
+
+
+////////////////////////////////////////////
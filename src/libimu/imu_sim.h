@@ -0,0 +1,161 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_SIM_H
+#define IMU_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imu_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// scripted motions, body angular rate over time
+#define IMU_SIM_STATIC      0x00    // no rotation
+#define IMU_SIM_SPIN        0x01    // constant rate about z
+#define IMU_SIM_TILT        0x02    // sinusoidal rate about x and y, slow rate about z
+#define IMU_SIM_TUMBLE      0x03    // fast rotation about all axes
+
+
+// body angular rate (deg/s) at time t for custom trajectories
+typedef void (*imu_sim_rate_fn)(double t, double w[3], void * user);
+
+
+// synthetic sensor stream. rates and forces are physical units, samples come out in raw
+// counts through the scale factors, like a real sensor feeding imu_set_*_raw().
+typedef struct imu_sim
+{
+    // sample rate (Hz) and length (s) of the stream
+    double rate;
+    double duration;
+
+    // deg/s and g per count, as passed to imu_init()
+    double scale_factor_gyro;
+    double scale_factor_accelerometer;
+
+    // IMU_SIM_*, or a custom rate function when rate_fn is set
+    int8_t motion;
+    imu_sim_rate_fn rate_fn;
+    void * user;
+
+    // initial tilt about x (deg)
+    double tilt;
+    // peak rate of the motion (deg/s) and frequency of its sinusoids (Hz)
+    double amplitude;
+    double frequency;
+
+    // gyro bias (deg/s) at t = 0 and its drift (deg/s per s)
+    double gyro_bias[3];
+    double gyro_drift[3];
+
+    // white noise standard deviations, deg/s and g
+    double gyro_noise;
+    double accelerometer_noise;
+
+    // linear vibration along body x and y, amplitude (g) and frequency (Hz)
+    double vibration;
+    double vibration_frequency;
+
+    // magnetometer: earth field in world frame (uT, x points north), uT per count, hard-iron
+    // offset (uT) and soft-iron matrix (row major) applied in body frame, white noise (uT)
+    double magnetic_field[3];
+    double scale_factor_magnetometer;
+    double hard_iron[3];
+    double soft_iron[9];
+    double magnetometer_noise;
+
+    // round to counts and saturate like a 16 bit sensor
+    int8_t quantize;
+
+    // noise is reproducible for the same seed
+    uint32_t seed;
+
+} imu_sim_t;
+
+
+// orientation error of an estimate against ground truth, radians
+typedef struct imu_sim_error
+{
+    // whole rotation
+    double rms, max;
+    // gravity direction only, what an estimator without magnetometer can observe
+    double tilt_rms, tilt_max;
+} imu_sim_error_t;
+
+
+////////////////////////////////////////////
+
+
+// still, quantized 16 bit sensor at rate Hz for duration seconds with mpu6050 like scale factors.
+// the magnetometer is an ak8963 without iron effects in a 60 degree inclined 50 uT field.
+// everything else is zero, set the fields of the returned struct to script a motion.
+imu_sim_t imu_sim_init(double rate, double duration);
+
+
+////////////////////////////////////////////
+
+
+// number of samples the stream has
+size_t imu_sim_count(const imu_sim_t * sim);
+
+
+////////////////////////////////////////////
+
+
+// writes imu_sim_count() samples and, if truth is not NULL, the true orientation at every
+// sample. truth is integrated in double precision with the filter's convention q = q * dq,
+// the rate at sample i acting over the period before it.
+void imu_sim_generate(const imu_sim_t * sim, imu_sample_t * samples, imu_quaternion_t * truth);
+
+
+////////////////////////////////////////////
+
+
+// raw magnetometer samples (counts) for n true orientations, e.g. the truth of imu_sim_generate().
+// noise comes from its own generator, so accelerometer and gyro samples don't change.
+void imu_sim_magnetometer(const imu_sim_t * sim, const imu_quaternion_t * truth, size_t n, imu_vec3_t * out);
+
+
+////////////////////////////////////////////
+
+
+// error of n estimates against truth, the first skip samples (convergence) are left out
+imu_sim_error_t imu_sim_error(const imu_quaternion_t * estimate, const imu_quaternion_t * truth, size_t n, size_t skip);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
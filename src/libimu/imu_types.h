@@ -32,21 +32,58 @@ extern "C" {
 ////////////////////////////////////////////
 
 
+// scalar type of the whole library. float by default, double if the library
+// and everything including its headers is compiled with -DIMU_REAL_DOUBLE.
+// timestamps stay double in both, float can't hold them for long runs.
+#if defined(IMU_REAL_DOUBLE)
+typedef double imu_real_t;
+#else
+typedef float imu_real_t;
+#endif
+
+// literal of imu_real_t type, folded at compile time
+#define IMU_R(x) ((imu_real_t)(x))
+
+
+////////////////////////////////////////////
+
+
 typedef struct imu_vec3 {
-    float x, y, z;
+    imu_real_t x, y, z;
 } imu_vec3_t;
 
 
 typedef struct imu_quaternion {
-    float w, x, y, z;
+    imu_real_t w, x, y, z;
 } imu_quaternion_t;
 
 
 typedef struct imu_euler {
-    float roll, pitch, yaw;
+    imu_real_t roll, pitch, yaw;
 } imu_euler_t;
 
 
+// rotation matrix, row major. m * v turns body frame vector v into world frame.
+typedef struct imu_mat3 {
+    imu_real_t m[3][3];
+} imu_mat3_t;
+
+
+// 4x4 transform, column major as glLoadMatrixf() and glMultMatrixf() take it.
+// float in double builds too, it is meant to be uploaded as is.
+typedef struct imu_mat4 {
+    float m[16];
+} imu_mat4_t;
+
+
+// one raw accelerometer + gyro reading and the time it was sampled at (seconds).
+typedef struct imu_sample {
+    imu_real_t ax, ay, az;
+    imu_real_t gx, gy, gz;
+    double ts;
+} imu_sample_t;
+
+
 ////////////////////////////////////////////
 
 #ifdef __cplusplus
@@ -0,0 +1,50 @@
+#include "imu_welford.h"
+#include "imu_algebra.h"
+
+////////////////////////////////////////////
+
+
+void imu_welford_reset(imu_welford_t * w)
+{
+    w->mean = w->m2 = imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+    w->n = 0;
+}
+
+
+////////////////////////////////////////////
+
+
+void imu_welford_add(imu_welford_t * w, const imu_vec3_t * x)
+{
+    w->n++;
+    const imu_real_t k = IMU_R(1) / w->n;
+
+    imu_real_t dx = x->x - w->mean.x;
+    imu_real_t dy = x->y - w->mean.y;
+    imu_real_t dz = x->z - w->mean.z;
+
+    w->mean.x += dx * k;
+    w->mean.y += dy * k;
+    w->mean.z += dz * k;
+
+    // old difference times new difference
+    w->m2.x += dx * (x->x - w->mean.x);
+    w->m2.y += dy * (x->y - w->mean.y);
+    w->m2.z += dz * (x->z - w->mean.z);
+}
+
+
+////////////////////////////////////////////
+
+
+imu_vec3_t imu_welford_variance(const imu_welford_t * w)
+{
+    if(w->n < 2)
+    {
+        return imu_vec3_create(IMU_R(0), IMU_R(0), IMU_R(0));
+    }
+    return imu_vec3_scale(&w->m2, IMU_R(1) / (w->n - 1));
+}
+
+
+////////////////////////////////////////////
@@ -0,0 +1,82 @@
+/**
+ * MIT License
+ * Copyright (c) 2022 Hasan Karaman (github.com/grizzlei)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#ifndef IMU_WELFORD_H
+#define IMU_WELFORD_H
+
+#include <stdint.h>
+
+#include "imu_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+////////////////////////////////////////////
+
+
+// running mean and variance of a vector stream (welford's algorithm). stays accurate when
+// the mean is large against the spread, e.g. gravity in raw counts, where a sum of squares
+// would cancel out.
+typedef struct imu_welford
+{
+    imu_vec3_t mean;
+
+    // sum of squared differences from the mean
+    imu_vec3_t m2;
+
+    // number of samples added
+    uint16_t n;
+
+} imu_welford_t;
+
+
+////////////////////////////////////////////
+
+
+void imu_welford_reset(imu_welford_t * w);
+
+
+////////////////////////////////////////////
+
+
+void imu_welford_add(imu_welford_t * w, const imu_vec3_t * x);
+
+
+////////////////////////////////////////////
+
+
+// sample variance per axis, 0 below two samples.
+imu_vec3_t imu_welford_variance(const imu_welford_t * w);
+
+
+////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libimu/imu.h"
+#include "libimu/imu_log.h"
+#include "libimu/imu_math.h"
+
+// samples handed to imu_process_batch() at once
+#define CHUNK 1024
+
+
+////////////////////////////////////////////
+
+
+static void usage(const char * name)
+{
+    printf("usage: %s [-f from] [-t to] [-e every] [-m] log\n", name);
+    printf("  -f from   start at the first sample at or after this time (seconds)\n");
+    printf("  -t to     stop before the first sample at or after this time (seconds)\n");
+    printf("  -e every  print time, roll, pitch, yaw (degrees) every n samples\n");
+    printf("  -m        fast math (imu_set_fast_math())\n");
+}
+
+
+////////////////////////////////////////////
+
+
+int main(int argc, char *argv[])
+{
+    double from = -1.0, to = -1.0;
+    unsigned long every = 0;
+    int fast_math = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, "f:t:e:mh")) != -1)
+    {
+        switch(opt)
+        {
+        case 'f': from = atof(optarg); break;
+        case 't': to = atof(optarg); break;
+        case 'e': every = strtoul(optarg, NULL, 10); break;
+        case 'm': fast_math = 1; break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if(optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    imu_log_t log = imu_log_open(argv[optind]);
+    if(!log.header)
+    {
+        return 1;
+    }
+
+    // same configuration as the recording, time comes from the records
+    imu_t imu = imu_log_init_imu(&log);
+    imu_set_fast_math(&imu, fast_math);
+
+    uint64_t first = from >= 0.0 ? imu_log_seek(&log, from) : 0;
+    uint64_t last = to >= 0.0 ? imu_log_seek(&log, to) : log.count;
+    last = last < first ? first : last;
+
+    imu_sample_t samples[CHUNK];
+    imu_quaternion_t out[CHUNK];
+    double t0 = get_time_sec();
+
+    for(uint64_t i = first; i < last; i += CHUNK)
+    {
+        size_t n = last - i < CHUNK ? (size_t)(last - i) : CHUNK;
+        for(size_t k = 0; k < n; k++)
+        {
+            samples[k] = imu_log_sample(&log, i + k);
+        }
+
+        imu_process_batch(&imu, samples, n, every ? out : NULL);
+
+        for(size_t k = 0; every && k < n; k++)
+        {
+            if((i + k - first) % every == 0)
+            {
+                imu_euler_t e = imu_quaternion_to_euler(&out[k]);
+                printf("%.6f %9.3f %9.3f %9.3f\n", samples[k].ts, r2d(e.roll), r2d(e.pitch), r2d(e.yaw));
+            }
+        }
+    }
+
+    double wall = get_time_sec() - t0;
+    uint64_t count = last - first;
+    double span = count > 1 ? log.records[last - 1].ts - log.records[first].ts : 0.0;
+
+    fprintf(stderr, "replayed %llu samples (%.1f s of data) in %.3f s, %.0f samples/s, %.0fx real time\n",
+        (unsigned long long)count, span, wall, count / wall, span / wall);
+    fprintf(stderr, "final orientation: roll %.3f pitch %.3f yaw %.3f deg\n",
+        r2d(imu.orientation.roll), r2d(imu.orientation.pitch), r2d(imu.orientation.yaw));
+
+    imu_log_close(&log);
+    return 0;
+}